@@ -0,0 +1,108 @@
+// AHEAD-OF-TIME CODE
+// the aot engine runs a block's compiled function whenever the memory under it still holds the
+// rom it was compiled from. everything else goes through step_decoded() one instruction at a
+// time - addresses chip-8-aot never saw a path to (like BNNN targets) and code the rom rewrote
+
+// C LIBRARIES
+#include <stdlib.h>
+#include <string.h>
+
+#include "core.h"
+#include "block.h"
+#include "aot.h"
+
+// the roms compiled into this build - chip-8-aot writes the list, make chip-8-native sets AOT
+#if AOT
+	extern const struct aot_program* const aot_programs[];
+#else
+	static const struct aot_program* const aot_programs[] = {NULL};
+#endif
+
+// whether the memory under the block at start is what the block was compiled from
+static bool matches(const struct chip8_machine* m, const struct aot_program* p, uint32_t start) {
+	return memcmp(&m->mem[start], &p->rom[start - 0x200], 2 * p->blocks[start >> 1].length) == 0;
+}
+
+// the program compiled from the rom in memory, NULL if there isn't one
+static const struct aot_program* find_program(const struct chip8_machine* m) {
+	for (int k = 0; aot_programs[k]; k++) {
+		const struct aot_program* p = aot_programs[k];
+		
+		if (p->mode == m->mode && p->quirks == m->quirks && p->size == m->size && memcmp(&m->mem[0x200], p->rom, p->size) == 0) {
+			return p;
+		}
+	}
+	
+	return NULL;
+}
+
+// checks every block that holds an instruction in [start, end) against the rom again
+// called by invalidate() whenever memory is rewritten - writing the rom back makes a block usable again
+void invalidate_aot(struct chip8_machine* m, uint32_t start, uint32_t end) {
+	struct aot* a = m->aot;
+	
+	// not running compiled code
+	if (!a) {
+		return;
+	}
+	
+	// any block that reaches start must begin at most MAX_BLOCK_LENGTH - 1 instructions before it
+	uint32_t first = start > 2 * (MAX_BLOCK_LENGTH - 1) ? (start & ~1u) - 2 * (MAX_BLOCK_LENGTH - 1) : 0;
+	
+	for (uint32_t s = first; s < end; s += 2) {
+		uint8_t length = a->program->blocks[s >> 1].length;
+		
+		if (length != 0 && s + 2 * length > start) {
+			a->stale[s >> 1] = !matches(m, a->program, s);
+		}
+	}
+}
+
+// runs exactly n instructions, a whole compiled block at a time wherever one fits
+uint32_t run_aot(struct chip8_machine* m, uint32_t n) {
+	// first run on this machine - find its rom's code
+	if (!m->aot) {
+		const struct aot_program* p = find_program(m);
+		
+		if (p) {
+			m->aot = calloc(1, sizeof(struct aot));
+		}
+		
+		if (!m->aot) {
+			if (!m->quiet) {
+				LOG("no ahead-of-time code for this rom, running blocks instead");
+			}
+			m->engine = ENGINE_BLOCKS;
+			return run_blocks(m, n);
+		}
+		
+		// the whole rom matched, so nothing is stale yet
+		m->aot->program = p;
+	}
+	
+	const struct aot_block* blocks = m->aot->program->blocks;
+	const bool*             stale  = m->aot->stale;
+	
+	// stop as soon as the machine halts - run() decides what to do with the rest
+	while (n > 0 && !m->halted) {
+		// odd or out of range addresses can't start a block
+		if (!(m->pc & 0xF001)) {
+			const struct aot_block* b = &blocks[m->pc >> 1];
+			
+			if (b->run && !stale[m->pc >> 1] && b->length <= n) {
+				n -= b->run(m);
+				continue;
+			}
+		}
+		
+		step_decoded(m);
+		n--;
+	}
+	
+	return n;
+}
+
+void free_aot(struct chip8_machine* m) {
+	free(m->aot);
+	m->aot = NULL;
+}
@@ -0,0 +1,48 @@
+// AHEAD-OF-TIME CODE
+// roms compiled to C by chip-8-aot. each block of a rom becomes one C function that is built
+// into the emulator, so the aot engine runs them with nothing to translate when the rom starts
+#ifndef AOT_H
+#define AOT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "core.h"
+
+// runs one block starting at its first instruction, returns how many instructions it ran
+	typedef uint8_t (*aot_fn)(struct chip8_machine* m);
+	
+	struct aot_block {
+		aot_fn  run;		// NULL if no block starts here
+		uint8_t length;		// number of instructions
+	};
+
+// one compiled rom - blocks are looked up by their start address
+	struct aot_program {
+		const char*             name;
+		const uint8_t*          rom;
+		uint16_t                size;
+		const struct aot_block* blocks;
+		enum mode               mode;	// the same bytes mean something else in another mode
+		enum quirks             quirks;	// or with another profile
+	};
+
+// a program's blocks, as far as one machine can still trust them
+	struct aot {
+		const struct aot_program* program;
+	
+	// set while the memory under a block differs from the rom it was compiled from
+		bool stale[CODE_SIZE / 2];
+	};
+
+// the instruction at addr through its decoded[] entry - for anything compiled code can't do inline
+static inline void aot_op(struct chip8_machine* m, uint16_t addr) {
+	const struct decoded* d = &m->decoded[addr >> 1];
+	d->handler(m, d);
+}
+
+void invalidate_aot(struct chip8_machine* m, uint32_t start, uint32_t end);
+uint32_t run_aot(struct chip8_machine* m, uint32_t n);
+void free_aot(struct chip8_machine* m);
+
+#endif
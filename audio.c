@@ -0,0 +1,140 @@
+// BUZZER
+// a frame of samples is put together from two pieces - runs of silence, and runs copied out of
+// the square wave made by buzzer_init() - so making one never allocates and never works a
+// sample out on its own. the runs change over at each sound timer write run() kept
+
+// C LIBRARIES
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "core.h"
+#include "audio.h"
+
+// gets a buzzer ready for a machine, starting from its sound timer and clock as they are now
+void buzzer_init(struct buzzer* b, struct chip8_machine* m) {
+	for (int s = 0; s < AUDIO_FRAME + AUDIO_PERIOD; s++) {
+		b->wave[s] = s % AUDIO_PERIOD < AUDIO_PERIOD / 2 ? AUDIO_VOLUME : -AUDIO_VOLUME;
+	}
+	
+	b->phase       = 0;
+	b->frame_start = m->executed;
+	b->on          = m->sound > 0;
+	
+	// writes from before now have nowhere to go
+	m->sound_write_count = 0;
+}
+
+// fills [from, to) of the frame with the wave or silence
+static void fill(struct buzzer* b, uint32_t from, uint32_t to) {
+	if (to <= from) {
+		return;
+	}
+	
+	if (b->on) {
+		memcpy(&b->samples[from], &b->wave[b->phase], (to - from) * sizeof(int16_t));
+	} else {
+		memset(&b->samples[from], 0, (to - from) * sizeof(int16_t));
+	}
+	
+	// the wave keeps going while it's silent, like a real oscillator being switched in and out
+	b->phase = (b->phase + to - from) % AUDIO_PERIOD;
+}
+
+// makes the samples for the frame that just ran - call it once a frame, after the timers ticked
+// the instructions run since the last call are spread evenly over the frame, and every sound
+// timer write turns the buzzer on or off at its own instruction's sample
+const int16_t* buzzer_frame(struct buzzer* b, struct chip8_machine* m) {
+	uint64_t instructions = m->executed - b->frame_start;
+	uint32_t done = 0;
+	
+	for (uint8_t w = 0; w < m->sound_write_count; w++) {
+		const struct sound_write* write = &m->sound_writes[w];
+		uint32_t at = instructions ? (uint32_t) ((write->at - b->frame_start) * AUDIO_FRAME / instructions) : 0;
+		
+		fill(b, done, at);
+		done = at > done ? at : done;
+		b->on = write->value > 0;
+	}
+	
+	fill(b, done, AUDIO_FRAME);
+	
+	// the tick at the end of the frame is the only thing that can run the timer out
+	m->sound_write_count = 0;
+	b->frame_start = m->executed;
+	b->on = m->sound > 0;
+	
+	return b->samples;
+}
+
+// WAV FILES
+	struct wav {
+		FILE*    file;
+		uint32_t samples;
+	};
+
+// writes a little-endian number whatever the host's byte order
+static void put(FILE* file, uint32_t value, int bytes) {
+	for (int k = 0; k < bytes; k++) {
+		fputc((value >> (8 * k)) & 0xFF, file);
+	}
+}
+
+// the 44-byte header of a 16-bit mono pcm file holding samples samples
+static void write_header(FILE* file, uint32_t samples) {
+	fwrite("RIFF", 1, 4, file);
+	put(file, 36 + samples * 2, 4);
+	fwrite("WAVEfmt ", 1, 8, file);
+	put(file, 16, 4);				// size of the format chunk
+	put(file, 1, 2);				// pcm
+	put(file, 1, 2);				// mono
+	put(file, AUDIO_RATE, 4);
+	put(file, AUDIO_RATE * 2, 4);	// bytes a second
+	put(file, 2, 2);				// bytes a sample
+	put(file, 16, 2);				// bits a sample
+	fwrite("data", 1, 4, file);
+	put(file, samples * 2, 4);
+}
+
+// NULL if the file can't be made
+struct wav* wav_open(const char* name) {
+	struct wav* w = calloc(1, sizeof(struct wav));
+	
+	if (!w) {
+		return NULL;
+	}
+	
+	w->file = fopen(name, "wb");
+	
+	if (!w->file) {
+		LOG("couldn't open wav file %s", name);
+		free(w);
+		return NULL;
+	}
+	
+	// the sizes aren't known yet - wav_close() fills them in
+	write_header(w->file, 0);
+	
+	return w;
+}
+
+void wav_write(struct wav* w, const int16_t* samples, uint32_t count) {
+	for (uint32_t s = 0; s < count; s++) {
+		put(w->file, (uint16_t) samples[s], 2);
+	}
+	
+	w->samples += count;
+}
+
+// writes the real sizes into the header and closes the file
+void wav_close(struct wav* w) {
+	if (!w) {
+		return;
+	}
+	
+	rewind(w->file);
+	write_header(w->file, w->samples);
+	
+	fclose(w->file);
+	free(w);
+}
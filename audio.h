@@ -0,0 +1,48 @@
+// BUZZER
+// turns the sound timer into 60 hz frames of samples - a square wave while it's above zero.
+// starts and stops land on the sample that matches the instruction that caused them, and
+// nothing here needs SDL, so the headless runner can save the same samples to a wav file
+#ifndef AUDIO_H
+#define AUDIO_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// 16-bit mono at this many samples a second
+#define AUDIO_RATE 48000
+
+// samples in one 60 hz frame
+#define AUDIO_FRAME (AUDIO_RATE / 60)
+
+// pitch of the buzzer - it divides AUDIO_RATE, so one period is a whole number of samples
+#define AUDIO_TONE   400
+#define AUDIO_PERIOD (AUDIO_RATE / AUDIO_TONE)
+
+// height of the square wave, out of 32767
+#define AUDIO_VOLUME 3000
+
+struct chip8_machine;
+
+	struct buzzer {
+	// square wave made once, long enough to copy a whole frame out of from any point in a period
+		int16_t wave[AUDIO_FRAME + AUDIO_PERIOD];
+	
+	// the frame buzzer_frame() made last
+		int16_t samples[AUDIO_FRAME];
+	
+	// where the wave is up to, and the machine's clock when this frame began
+		uint32_t phase;
+		uint64_t frame_start;
+		bool     on;
+	};
+	
+	struct wav;
+
+void buzzer_init(struct buzzer* b, struct chip8_machine* m);
+const int16_t* buzzer_frame(struct buzzer* b, struct chip8_machine* m);
+
+struct wav* wav_open(const char* name);
+void wav_write(struct wav* w, const int16_t* samples, uint32_t count);
+void wav_close(struct wav* w);
+
+#endif
@@ -0,0 +1,365 @@
+// BATCH RUNNER
+// every (rom, seed) pair is a task. tasks are dealt out to one deque per worker thread up front;
+// a worker takes from the bottom of its own deque, and when that runs dry it steals from the
+// top of someone else's. results go into a table indexed by task, then into the results file
+// in task order, so the file is the same no matter which thread ran what
+
+// C LIBRARIES
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#ifdef _WIN32
+	#include <windows.h>
+#else
+	#include <unistd.h>
+#endif
+
+#include "core.h"
+#include "batch.h"
+#include "pack.h"
+
+// a rom comes from a file, or from a pack when pack isn't NULL
+	struct task {
+		char*                    rom;
+		const struct pack*       pack;
+		const struct pack_entry* entry;
+		uint32_t                 seed;
+	};
+
+	struct result {
+		uint64_t    instructions;
+		uint64_t    frames;
+		uint64_t    hash;
+		const char* exit_reason;
+	};
+
+// a chase-lev deque that is only ever filled before the workers start - so it never grows
+	struct deque {
+		_Atomic long top;		// thieves take from here
+		_Atomic long bottom;	// the owner takes from here
+		int*         tasks;
+	};
+
+// what the workers share
+	struct pool {
+		struct task*   tasks;
+		struct result* results;
+		struct deque*  deques;
+		int            workers;
+		uint64_t       frames;
+		enum engine    engine;
+	};
+
+	struct worker {
+		struct pool* pool;
+		int          id;
+	};
+
+// owner side - returns -1 if the deque is empty
+static int pop(struct deque* d) {
+	long b = atomic_load(&d->bottom) - 1;
+	atomic_store(&d->bottom, b);
+	atomic_thread_fence(memory_order_seq_cst);
+	long t = atomic_load(&d->top);
+	
+	if (t > b) {
+		atomic_store(&d->bottom, b + 1);
+		return -1;
+	}
+	
+	int task = d->tasks[b];
+	
+	// last task - race the thieves for it
+	if (t == b) {
+		if (!atomic_compare_exchange_strong(&d->top, &t, t + 1)) {
+			task = -1;
+		}
+		atomic_store(&d->bottom, b + 1);
+	}
+	
+	return task;
+}
+
+// thief side - returns -1 if the deque is empty, -2 if another thread got there first
+static int steal(struct deque* d) {
+	long t = atomic_load(&d->top);
+	atomic_thread_fence(memory_order_seq_cst);
+	long b = atomic_load(&d->bottom);
+	
+	if (t >= b) {
+		return -1;
+	}
+	
+	int task = d->tasks[t];
+	
+	if (!atomic_compare_exchange_strong(&d->top, &t, t + 1)) {
+		return -2;
+	}
+	
+	return task;
+}
+
+// runs one task to the end - all of its frames, or until it faults, halts or waits for a key forever
+static void run_task(struct pool* pool, int index) {
+	struct task*   task   = &pool->tasks[index];
+	struct result* result = &pool->results[index];
+	
+	result->exit_reason = "done";
+	
+	struct chip8_machine* m = machine_create(task->seed);
+	
+	if (!m) {
+		result->exit_reason = "out of memory";
+		return;
+	}
+	
+	m->quiet  = true;
+	m->engine = pool->engine;
+	
+	if (task->pack ? !pack_load(m, task->pack, task->entry) : !open_file(m, task->rom)) {
+		result->exit_reason = "failed to open rom";
+		machine_destroy(m);
+		return;
+	}
+	
+	clear_screen(m);
+	
+	for (uint64_t f = 0; f < pool->frames; f++) {
+		run_frame(m, INSTRUCTIONS_PER_TICK);
+		
+		result->instructions += INSTRUCTIONS_PER_TICK;
+		result->frames++;
+		
+		if (m->fault != FAULT_NONE) {
+			result->exit_reason = fault_name(m->fault);
+			break;
+		}
+		
+		if (m->halted == HALT_EXIT) {
+			result->exit_reason = "exited";
+			break;
+		}
+		
+		// nothing left to do - jumping to itself, or waiting on a key that will never come
+		uint16_t op = (m->pc & 0xF001) ? 0 : m->decoded[m->pc >> 1].instr;
+		
+		if (op == (0x1000 | m->pc)) {
+			result->exit_reason = "halted";
+			break;
+		}
+		if ((op & 0xF0FF) == 0xF00A) {
+			result->exit_reason = "waiting for key";
+			break;
+		}
+	}
+	
+	result->hash = screen_hash(m);
+	
+	machine_destroy(m);
+}
+
+static void* worker_main(void* arg) {
+	struct worker* w    = arg;
+	struct pool*   pool = w->pool;
+	
+	while (true) {
+		int task = pop(&pool->deques[w->id]);
+		
+		// out of our own work - go round everyone else until a steal works or they're all empty
+		while (task < 0) {
+			bool contended = false;
+			
+			for (int a = 1; a < pool->workers && task < 0; a++) {
+				task = steal(&pool->deques[(w->id + a) % pool->workers]);
+				contended |= task == -2;
+			}
+			
+			if (task < 0 && !contended) {
+				return NULL;
+			}
+		}
+		
+		run_task(pool, task);
+	}
+}
+
+// number of cores to run on
+static int core_count() {
+#ifdef _WIN32
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return (int) info.dwNumberOfProcessors;
+#else
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+	return count > 0 ? (int) count : 1;
+#endif
+}
+
+int run_batch(int argc, char** argv) {
+	// argv -> ['chip-8.exe', '--batch', results file, frames, seeds per rom, engine, rom, rom, ...]
+	if (argc < 7) {
+		LOG("usage: ./chip-8.exe --batch [results file] [frames] [seeds per rom] [engine] [rom or pack] [rom or pack] ...");
+		return -1;
+	}
+	
+	struct pool pool = {0};
+	pool.frames = strtoull(argv[3], NULL, 10);
+	uint32_t seeds = (uint32_t) strtoul(argv[4], NULL, 10);
+	
+	if (!parse_engine(argv[5], &pool.engine)) {
+		LOG("unknown engine: %s (try interpreter, decoded, blocks, jit or aot)", argv[5]);
+		return -1;
+	}
+	
+	if (seeds == 0) {
+		seeds = 1;
+	}
+	
+	// everything from here on is freed at the end whichever way the batch goes
+	int            status  = -1;
+	int*           slots   = NULL;
+	pthread_t*     threads = NULL;
+	struct worker* workers = NULL;
+	
+	// a pack stands for every rom in it
+	struct pack** packs = calloc(argc, sizeof(struct pack*));
+	int roms = 0;
+	
+	if (!packs) {
+		LOG("failed to allocate batch");
+		return -1;
+	}
+	
+	for (int a = 6; a < argc; a++) {
+		const char* dot = strrchr(argv[a], '.');
+		
+		if (dot && strcmp(dot, PACK_EXTENSION) == 0) {
+			packs[a] = pack_open(argv[a]);
+			
+			if (!packs[a]) {
+				goto done;
+			}
+		}
+		
+		roms += packs[a] ? (int) pack_count(packs[a]) : 1;
+	}
+	
+	int count = roms * seeds;
+	
+	if (count == 0) {
+		LOG("no roms to run");
+		goto done;
+	}
+	
+	pool.workers = core_count();
+	if (pool.workers > count) {
+		pool.workers = count;
+	}
+	
+	pool.tasks   = calloc(count, sizeof(struct task));
+	pool.results = calloc(count, sizeof(struct result));
+	pool.deques  = calloc(pool.workers, sizeof(struct deque));
+	slots        = calloc(count, sizeof(int));
+	threads      = calloc(pool.workers, sizeof(pthread_t));
+	workers      = calloc(pool.workers, sizeof(struct worker));
+	
+	if (!pool.tasks || !pool.results || !pool.deques || !slots || !threads || !workers) {
+		LOG("failed to allocate batch");
+		goto done;
+	}
+	
+	// one task per rom and seed - seeds start at 1
+	int r = 0;
+	
+	for (int a = 6; a < argc; a++) {
+		uint32_t from_arg = packs[a] ? pack_count(packs[a]) : 1;
+		
+		for (uint32_t k = 0; k < from_arg; k++, r++) {
+			const struct pack_entry* entry = packs[a] ? pack_entry(packs[a], k) : NULL;
+			char* rom = entry ? (char*) entry->name : argv[a];
+			
+			for (uint32_t s = 0; s < seeds; s++) {
+				pool.tasks[r * seeds + s] = (struct task) {rom, packs[a], entry, s + 1};
+			}
+		}
+	}
+	
+	// deal the tasks out round robin - each deque gets its own slice of slots
+	int per_worker = (count + pool.workers - 1) / pool.workers;
+	
+	for (int w = 0; w < pool.workers; w++) {
+		pool.deques[w].tasks = &slots[w * per_worker];
+		atomic_init(&pool.deques[w].top, 0);
+		atomic_init(&pool.deques[w].bottom, 0);
+	}
+	
+	for (int t = 0; t < count; t++) {
+		struct deque* d = &pool.deques[t % pool.workers];
+		long b = atomic_load(&d->bottom);
+		d->tasks[b] = t;
+		atomic_store(&d->bottom, b + 1);
+	}
+	
+	int started = 0;
+	
+	for (int w = 0; w < pool.workers; w++) {
+		workers[w] = (struct worker) {&pool, w};
+	}
+	
+	for (; started < pool.workers; started++) {
+		if (pthread_create(&threads[started], NULL, worker_main, &workers[started]) != 0) {
+			LOG("failed to start worker %d, running with %d", started, started + 1);
+			break;
+		}
+	}
+	
+	// short of threads - this one takes the first missing worker's place, and steals the rest of
+	// the missing ones' tasks along with everyone else
+	if (started < pool.workers) {
+		worker_main(&workers[started]);
+	}
+	
+	for (int w = 0; w < started; w++) {
+		pthread_join(threads[w], NULL);
+	}
+	
+	// write the results in task order
+	FILE* out = fopen(argv[2], "w");
+	
+	if (!out) {
+		LOG("failed to open results file: %s", argv[2]);
+		goto done;
+	}
+	
+	fprintf(out, "rom\tseed\tinstructions\tframes\tscreen_hash\texit\n");
+	
+	for (int t = 0; t < count; t++) {
+		struct result* r = &pool.results[t];
+		fprintf(out, "%s\t%u\t%llu\t%llu\t%016llx\t%s\n", pool.tasks[t].rom, pool.tasks[t].seed,
+		        (unsigned long long) r->instructions, (unsigned long long) r->frames,
+		        (unsigned long long) r->hash, r->exit_reason);
+	}
+	
+	fclose(out);
+	
+	printf("ran %d tasks on %d threads, results in %s\n", count, started < pool.workers ? started + 1 : started, argv[2]);
+	status = 0;
+	
+done:
+	free(pool.tasks);
+	free(pool.results);
+	free(pool.deques);
+	free(slots);
+	free(threads);
+	free(workers);
+	
+	for (int a = 6; a < argc; a++) {
+		pack_close(packs[a]);
+	}
+	free(packs);
+	
+	return status;
+}
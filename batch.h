@@ -0,0 +1,9 @@
+// BATCH RUNNER
+// runs many roms and seeds at once, one machine per task, on every core
+#ifndef BATCH_H
+#define BATCH_H
+
+// argv -> ['chip-8.exe', '--batch', results file, frames, seeds per rom, engine, rom, rom, ...]
+int run_batch(int argc, char** argv);
+
+#endif
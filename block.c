@@ -0,0 +1,173 @@
+// BLOCK TRANSLATION
+// a block is a run of instructions that ends at the first jump, call, return or skip.
+// only its last instruction can move pc, so pc is set once for the whole block and the
+// handlers run back to back. each block remembers the blocks that ran after it, so hot
+// loops go block to block without looking anything up
+
+// C LIBRARIES
+#include <stdlib.h>
+#include <string.h>
+
+#include "core.h"
+#include "block.h"
+
+	struct block {
+		const struct decoded* ops;	// first instruction - the rest follow it in decoded[]
+		uint16_t      start;		// address of the first instruction
+		uint16_t      end;			// address right after the last instruction
+		uint8_t       length;		// number of instructions, 0 if this block needs translating
+		struct block* next[2];		// successors seen so far - a skip has two, everything else one
+	};
+
+	struct block_cache {
+	// at most one block can start at each even address, so blocks are looked up by their start
+		struct block blocks[CODE_SIZE / 2];
+	
+	// whether each decoded[] entry is inside some block - writes anywhere else are free
+		bool covered[CODE_SIZE / 2];
+	};
+
+// builds the block starting at start
+static struct block* translate(struct chip8_machine* m, uint16_t start) {
+	struct block* b = &m->blocks->blocks[start >> 1];
+	uint32_t addr = start;
+	uint8_t length = 0;
+	
+	// stop after a branch, or at the end of memory
+	while (length < MAX_BLOCK_LENGTH && addr < CODE_SIZE) {
+		m->blocks->covered[addr >> 1] = true;
+		length++;
+		addr += 2;
+		
+		if (m->decoded[(addr - 2) >> 1].branch) {
+			break;
+		}
+	}
+	
+	b->ops     = &m->decoded[start >> 1];
+	b->start   = start;
+	b->end     = addr;
+	b->length  = length;
+	b->next[0] = NULL;
+	b->next[1] = NULL;
+	
+	return b;
+}
+
+// finds the block at pc, following prev's chain first
+static struct block* find_block(struct chip8_machine* m, struct block* prev) {
+	if (prev) {
+		for (int s = 0; s < 2; s++) {
+			struct block* next = prev->next[s];
+			
+			if (next && next->start == m->pc && next->length != 0) {
+				return next;
+			}
+		}
+	}
+	
+	struct block* b = &m->blocks->blocks[m->pc >> 1];
+	
+	if (b->length == 0 || b->start != m->pc) {
+		b = translate(m, m->pc);
+	}
+	
+	// chain it - the newest successor goes in whichever slot is free, or replaces the second
+	if (prev) {
+		prev->next[prev->next[0] ? 1 : 0] = b;
+	}
+	
+	return b;
+}
+
+// drops every block that holds an instruction in [start, end)
+// called by invalidate() whenever memory is rewritten
+void invalidate_blocks(struct chip8_machine* m, uint32_t start, uint32_t end) {
+	struct block_cache* cache = m->blocks;
+	
+	// nothing translated yet
+	if (!cache) {
+		return;
+	}
+	
+	for (uint32_t a = start & ~1u; a < end; a += 2) {
+		if (!cache->covered[a >> 1]) {
+			continue;
+		}
+		
+		// any block that reaches a must start at most MAX_BLOCK_LENGTH - 1 instructions before it
+		uint32_t first = a > 2 * (MAX_BLOCK_LENGTH - 1) ? a - 2 * (MAX_BLOCK_LENGTH - 1) : 0;
+		
+		for (uint32_t s = first; s <= a; s += 2) {
+			if (cache->blocks[s >> 1].length != 0 && cache->blocks[s >> 1].end > a) {
+				cache->blocks[s >> 1].length = 0;
+			}
+		}
+		
+		cache->covered[a >> 1] = false;
+	}
+}
+
+// runs exactly n instructions, a whole block at a time wherever the block fits in what's left
+uint32_t run_blocks(struct chip8_machine* m, uint32_t n) {
+	struct block* b = NULL;
+	
+	// first run on this machine - make its cache
+	if (!m->blocks) {
+		m->blocks = calloc(1, sizeof(struct block_cache));
+		
+		if (!m->blocks) {
+			LOG("failed to allocate block cache, running decoded instead");
+			m->engine = ENGINE_DECODED;
+			run(m, n);
+			return 0;
+		}
+	}
+	
+	// stop as soon as the machine halts - run() decides what to do with the rest
+	while (n > 0 && !m->halted) {
+		// odd or out of range addresses can't start a block
+		if (m->pc & 0xF001) {
+			step_decoded(m);
+			n--;
+			b = NULL;
+			continue;
+		}
+		
+		b = find_block(m, b);
+		
+		// not enough instructions left for the whole block - finish one at a time
+		if (b->length > n) {
+			step_decoded(m);
+			n--;
+			b = NULL;
+			continue;
+		}
+		
+		// non-branching instructions never read pc, so it can be moved to the end up front
+		m->pc = b->end;
+		
+		for (int k = 0; k < b->length; k++) {
+			b->ops[k].handler(m, &b->ops[k]);
+			
+			// the block rewrote itself - carry on from the next instruction on the slow path
+			if (b->length == 0) {
+				m->pc = b->start + 2 * (k + 1);
+				n -= k + 1;
+				b = NULL;
+				break;
+			}
+		}
+		
+		if (b) {
+			n -= b->length;
+		}
+	}
+	
+	return n;
+}
+
+void free_blocks(struct chip8_machine* m) {
+	free(m->blocks);
+	m->blocks = NULL;
+}
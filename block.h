@@ -0,0 +1,17 @@
+// BLOCK TRANSLATION
+// caches straight-line runs of predecoded instructions as basic blocks, chained to their successors
+#ifndef BLOCK_H
+#define BLOCK_H
+
+#include <stdint.h>
+
+// longest run of instructions that goes into one block
+#define MAX_BLOCK_LENGTH 32
+
+struct chip8_machine;
+
+void invalidate_blocks(struct chip8_machine* m, uint32_t start, uint32_t end);
+uint32_t run_blocks(struct chip8_machine* m, uint32_t n);
+void free_blocks(struct chip8_machine* m);
+
+#endif
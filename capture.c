@@ -0,0 +1,452 @@
+// VIDEO CAPTURE
+// slots are handed to the encoder in order, like trace buffers. the slot being filled holds the
+// newest screen, and a frame that's the same only adds one to its count - it's handed over once a
+// different one comes. a realtime capture never makes the emulator wait: when the encoder is a
+// whole ring behind, the new frame is dropped and the slot being filled is shown for its time
+// instead, so the video stays in step with the rom. otherwise capture_frame() waits for room.
+// a .gif stores only the rectangle that changed since the frame before, and a frame's delay is
+// rounded so it ends at the nearest 1/100 s to where it really does, so the total stays exact
+
+// C LIBRARIES
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "core.h"
+#include "capture.h"
+
+// the longest delay one gif frame can hold, in 1/100 s
+#define GIF_MAX_DELAY 0xFFFF
+
+// gif codes are at most 12 bits, and palette indices 2 - code 4 clears the table, 5 ends the image
+#define LZW_CODES  4096
+#define LZW_COLORS 4
+#define LZW_CLEAR  LZW_COLORS
+#define LZW_END    (LZW_COLORS + 1)
+
+	enum capture_format {
+		CAPTURE_Y4M,
+		CAPTURE_GIF
+	};
+	
+	struct capture {
+		FILE*               file;
+		enum capture_format format;
+		int                 width;		// 64x32 for CHIP-8, which has no hires - 128x64 for the others
+		int                 height;
+		bool                realtime;
+	
+	// handed counts the slots given to the encoder, written the ones it has saved, so slot
+	// handed % CAPTURE_SLOTS is the one being filled
+		struct capture_slot slots[CAPTURE_SLOTS];
+		uint64_t            handed;
+		uint64_t            written;
+		bool                filling;	// the slot being filled has a frame in it
+		bool                closing;
+		
+		uint64_t frames;	// every frame capture_frame() got
+		uint64_t dropped;	// the ones that were shown as the frame before instead
+		
+		pthread_t       encoder;
+		pthread_mutex_t lock;
+		pthread_cond_t  changed;
+	
+	// the encoder's own - palette indices for the frame being written and the one before it
+		uint8_t  pixels[SCREEN_HEIGHT * SCREEN_WIDTH];
+		uint8_t  previous[SCREEN_HEIGHT * SCREEN_WIDTH];
+		uint64_t shown;		// frames written so far
+	
+	// y4m - the three planes of a frame, and each palette color's y, u and v
+		uint8_t planes[3][SCREEN_HEIGHT * SCREEN_WIDTH];
+		uint8_t yuv[4][3];
+	
+	// gif - the lzw table as a tree, one child per color, and the bits waiting to go out
+		uint8_t  rgb[4][3];
+		uint16_t children[LZW_CODES][LZW_COLORS];
+		uint32_t bits;
+		int      bit_count;
+		uint8_t  block[255];
+		int      block_length;
+	};
+
+// whether a file name asks for a capture
+bool is_capture_file(const char* name) {
+	size_t length = strlen(name);
+	
+	return length > 4 && (strcmp(".y4m", name + length - 4) == 0 || strcmp(".gif", name + length - 4) == 0);
+}
+
+// PIXELS
+// the palette index of every pixel of a slot, at the capture's size - a lores screen in a
+// 128x64 capture is drawn at 2x2 a pixel
+static void to_pixels(struct capture* c, const struct capture_slot* s) {
+	int shift = c->width == SCREEN_WIDTH && !s->hires;
+	
+	for (int y = 0; y < c->height; y++) {
+		int row = y >> shift;
+		
+		for (int x = 0; x < c->width; x++) {
+			int column = x >> shift;
+			int word   = column >> 6;
+			int bit    = 63 - (column & 63);
+			
+			c->pixels[y * c->width + x] = (s->screen[0][row][word] >> bit & 1) | (s->screen[1][row][word] >> bit & 1) << 1;
+		}
+	}
+}
+
+// Y4M
+// full range bt.601, so the palette's colors stay apart
+static void make_yuv(struct capture* c, const uint32_t palette[4]) {
+	for (int k = 0; k < 4; k++) {
+		int r = palette[k] >> 16 & 0xFF;
+		int g = palette[k] >> 8  & 0xFF;
+		int b = palette[k]       & 0xFF;
+		
+		c->yuv[k][0] = (uint8_t) ((  299 * r + 587 * g + 114 * b + 500) / 1000);
+		c->yuv[k][1] = (uint8_t) ((-1687 * r - 3313 * g + 5000 * b + 1280000 + 5000) / 10000);
+		c->yuv[k][2] = (uint8_t) (( 5000 * r - 4187 * g -  813 * b + 1280000 + 5000) / 10000);
+	}
+}
+
+// y4m has a fixed frame rate, so a frame shown for longer is written that many times
+static void write_y4m(struct capture* c, uint32_t frames) {
+	int size = c->width * c->height;
+	
+	for (int p = 0; p < size; p++) {
+		for (int plane = 0; plane < 3; plane++) {
+			c->planes[plane][p] = c->yuv[c->pixels[p]][plane];
+		}
+	}
+	
+	for (uint32_t f = 0; f < frames; f++) {
+		fputs("FRAME\n", c->file);
+		
+		for (int plane = 0; plane < 3; plane++) {
+			fwrite(c->planes[plane], 1, size, c->file);
+		}
+	}
+}
+
+// GIF
+static void put16(FILE* file, uint16_t value) {
+	fputc(value & 0xFF, file);
+	fputc(value >> 8, file);
+}
+
+// codes go out least significant bit first, in blocks of up to 255 bytes
+static void put_code(struct capture* c, uint16_t code, int size) {
+	c->bits      |= (uint32_t) code << c->bit_count;
+	c->bit_count += size;
+	
+	while (c->bit_count >= 8) {
+		c->block[c->block_length++] = c->bits & 0xFF;
+		c->bits      >>= 8;
+		c->bit_count -= 8;
+		
+		if (c->block_length == 255) {
+			fputc(255, c->file);
+			fwrite(c->block, 1, 255, c->file);
+			c->block_length = 0;
+		}
+	}
+}
+
+// a fresh table - 0 is never a child, since code 0 is a color and never anyone's child
+static void lzw_reset(struct capture* c) {
+	memset(c->children, 0, sizeof(c->children));
+}
+
+// the pixels in a rectangle, lzw compressed, as the data of one image
+static void write_lzw(struct capture* c, int left, int top, int width, int height) {
+	int      size = 3;
+	uint16_t next = LZW_END + 1;
+	
+	lzw_reset(c);
+	c->bits         = 0;
+	c->bit_count    = 0;
+	c->block_length = 0;
+	
+	fputc(2, c->file);	// smallest code size - 2 bits of color
+	put_code(c, LZW_CLEAR, size);
+	
+	uint16_t code = c->pixels[top * c->width + left];
+	
+	for (int p = 1; p < width * height; p++) {
+		uint8_t pixel = c->pixels[(top + p / width) * c->width + left + p % width];
+		
+		// the run so far plus this pixel is in the table already - keep going
+		if (c->children[code][pixel]) {
+			code = c->children[code][pixel];
+			continue;
+		}
+		
+		put_code(c, code, size);
+		
+		if (next < LZW_CODES) {
+			if (next == 1 << size) {
+				size++;
+			}
+			c->children[code][pixel] = next++;
+		} else {
+			put_code(c, LZW_CLEAR, size);
+			lzw_reset(c);
+			size = 3;
+			next = LZW_END + 1;
+		}
+		
+		code = pixel;
+	}
+	
+	// the decoder adds one more code after reading the last one, and may be a bit wider already
+	put_code(c, code, size);
+	
+	if (next < LZW_CODES && next == 1 << size) {
+		size++;
+	}
+	put_code(c, LZW_END, size);
+	
+	// whatever's left over, then the empty block that ends the data
+	if (c->bit_count > 0) {
+		put_code(c, 0, 8 - c->bit_count);
+	}
+	if (c->block_length > 0) {
+		fputc(c->block_length, c->file);
+		fwrite(c->block, 1, c->block_length, c->file);
+	}
+	fputc(0, c->file);
+}
+
+// one image of the animation - left on screen under the ones after it
+static void write_image(struct capture* c, int left, int top, int width, int height, uint16_t delay) {
+	fputc(0x21, c->file);
+	fputc(0xF9, c->file);
+	fputc(4, c->file);
+	fputc(1 << 2, c->file);		// don't dispose
+	put16(c->file, delay);
+	fputc(0, c->file);			// no transparent color
+	fputc(0, c->file);
+	
+	fputc(0x2C, c->file);
+	put16(c->file, (uint16_t) left);
+	put16(c->file, (uint16_t) top);
+	put16(c->file, (uint16_t) width);
+	put16(c->file, (uint16_t) height);
+	fputc(0, c->file);			// no color table of its own, not interlaced
+	
+	write_lzw(c, left, top, width, height);
+}
+
+static void write_gif(struct capture* c, uint32_t frames) {
+	// delays are in 1/100 s, and 60 hz doesn't go into that - so each frame ends at the nearest
+	// one to where it really ends, and the rounding never adds up
+	uint64_t start = (c->shown * 100 + 30) / 60;
+	uint64_t end   = ((c->shown + frames) * 100 + 30) / 60;
+	uint64_t delay = end - start;
+	
+	// only what changed since the last frame - the first frame has nothing under it
+	int left = c->width, right = -1, top = c->height, bottom = -1;
+	
+	for (int y = 0; y < c->height; y++) {
+		for (int x = 0; x < c->width; x++) {
+			int p = y * c->width + x;
+			
+			if (c->shown == 0 || c->pixels[p] != c->previous[p]) {
+				left   = x < left ? x : left;
+				right  = x > right ? x : right;
+				top    = y < top ? y : top;
+				bottom = y > bottom ? y : bottom;
+			}
+		}
+	}
+	
+	// a different screen can still look the same - one pixel that doesn't change carries the delay
+	if (right < 0) {
+		left = right = top = bottom = 0;
+	}
+	
+	uint16_t first = delay < GIF_MAX_DELAY ? (uint16_t) delay : GIF_MAX_DELAY;
+	write_image(c, left, top, right - left + 1, bottom - top + 1, first);
+	
+	// a screen that stays up longer than one delay can hold gets more of that one pixel
+	for (delay -= first; delay > 0; ) {
+		uint16_t more = delay < GIF_MAX_DELAY ? (uint16_t) delay : GIF_MAX_DELAY;
+		write_image(c, 0, 0, 1, 1, more);
+		delay -= more;
+	}
+}
+
+// ENCODER THREAD
+// writes handed slots until the capture is closed and every one is out
+static void* encoder(void* arg) {
+	struct capture* c = arg;
+	
+	pthread_mutex_lock(&c->lock);
+	
+	while (true) {
+		while (c->written == c->handed && !c->closing) {
+			pthread_cond_wait(&c->changed, &c->lock);
+		}
+		
+		if (c->written == c->handed) {
+			break;
+		}
+		
+		// nobody touches a handed slot until it's written, so the lock can go while encoding it
+		const struct capture_slot* s = &c->slots[c->written % CAPTURE_SLOTS];
+		pthread_mutex_unlock(&c->lock);
+		
+		to_pixels(c, s);
+		
+		if (c->format == CAPTURE_Y4M) {
+			write_y4m(c, s->frames);
+		} else {
+			write_gif(c, s->frames);
+		}
+		
+		memcpy(c->previous, c->pixels, sizeof(c->pixels));
+		c->shown += s->frames;
+		
+		pthread_mutex_lock(&c->lock);
+		c->written++;
+		pthread_cond_signal(&c->changed);
+	}
+	
+	pthread_mutex_unlock(&c->lock);
+	
+	return NULL;
+}
+
+// CAPTURING
+// starts a capture of a machine that has its rom loaded, so its mode picks the size. palette is
+// the frontend's colors as 0xAARRGGBB - background, first plane, second plane, both. NULL if the
+// file can't be made
+struct capture* capture_open(const char* name, const struct chip8_machine* m, const uint32_t palette[4], bool realtime) {
+	if (!is_capture_file(name)) {
+		LOG("can't capture to %s - try a .y4m or .gif file", name);
+		return NULL;
+	}
+	
+	struct capture* c = calloc(1, sizeof(struct capture));
+	
+	if (!c) {
+		LOG("failed to allocate capture");
+		return NULL;
+	}
+	
+	c->file = fopen(name, "wb");
+	
+	if (!c->file) {
+		LOG("couldn't open capture file %s", name);
+		free(c);
+		return NULL;
+	}
+	
+	c->format   = strcmp(".gif", name + strlen(name) - 4) == 0 ? CAPTURE_GIF : CAPTURE_Y4M;
+	c->width    = m->mode == MODE_CHIP8 ? 64 : SCREEN_WIDTH;
+	c->height   = m->mode == MODE_CHIP8 ? 32 : SCREEN_HEIGHT;
+	c->realtime = realtime;
+	
+	if (c->format == CAPTURE_Y4M) {
+		make_yuv(c, palette);
+		fprintf(c->file, "YUV4MPEG2 W%d H%d F60:1 Ip A1:1 C444 XCOLORRANGE=FULL\n", c->width, c->height);
+	} else {
+		fwrite("GIF89a", 1, 6, c->file);
+		put16(c->file, (uint16_t) c->width);
+		put16(c->file, (uint16_t) c->height);
+		fputc(0x80 | 1 << 4 | 1, c->file);	// a global table of 4 colors
+		fputc(0, c->file);					// background color
+		fputc(0, c->file);					// square pixels
+		
+		for (int k = 0; k < 4; k++) {
+			fputc(palette[k] >> 16 & 0xFF, c->file);
+			fputc(palette[k] >> 8  & 0xFF, c->file);
+			fputc(palette[k]       & 0xFF, c->file);
+		}
+		
+		// loop forever
+		fwrite("\x21\xFF\x0BNETSCAPE2.0\x03\x01\x00\x00\x00", 1, 19, c->file);
+	}
+	
+	pthread_mutex_init(&c->lock, NULL);
+	pthread_cond_init(&c->changed, NULL);
+	pthread_create(&c->encoder, NULL, encoder, c);
+	
+	return c;
+}
+
+// adds the machine's screen as it is now as the next frame - call it once every 60 hz frame
+void capture_frame(struct capture* c, const struct chip8_machine* m) {
+	struct capture_slot* s = &c->slots[c->handed % CAPTURE_SLOTS];
+	c->frames++;
+	
+	// the same screen as the frame before - it's just shown for longer
+	if (c->filling && s->hires == m->hires && memcmp(s->screen, m->screen, sizeof(s->screen)) == 0) {
+		s->frames++;
+		return;
+	}
+	
+	// hand the one before over, if there's a slot for this one after it
+	if (c->filling) {
+		pthread_mutex_lock(&c->lock);
+		
+		while (!c->realtime && c->handed + 1 - c->written == CAPTURE_SLOTS) {
+			pthread_cond_wait(&c->changed, &c->lock);
+		}
+		
+		bool room = c->handed + 1 - c->written < CAPTURE_SLOTS;
+		
+		if (room) {
+			c->handed++;
+			pthread_cond_signal(&c->changed);
+		}
+		
+		pthread_mutex_unlock(&c->lock);
+		
+		if (!room) {
+			s->frames++;
+			c->dropped++;
+			return;
+		}
+		
+		s = &c->slots[c->handed % CAPTURE_SLOTS];
+	}
+	
+	memcpy(s->screen, m->screen, sizeof(s->screen));
+	s->hires    = m->hires;
+	s->frames   = 1;
+	c->filling  = true;
+}
+
+// hands over the last frame, waits for the encoder to write everything, then finishes the file
+void capture_close(struct capture* c) {
+	if (!c) {
+		return;
+	}
+	
+	pthread_mutex_lock(&c->lock);
+	
+	if (c->filling) {
+		c->handed++;
+	}
+	
+	c->closing = true;
+	pthread_cond_signal(&c->changed);
+	pthread_mutex_unlock(&c->lock);
+	
+	pthread_join(c->encoder, NULL);
+	
+	if (c->format == CAPTURE_GIF) {
+		fputc(0x3B, c->file);
+	}
+	
+	if (c->dropped) {
+		LOG("capture dropped %llu of %llu frames - the encoder fell behind", (unsigned long long) c->dropped, (unsigned long long) c->frames);
+	}
+	
+	fclose(c->file);
+	pthread_mutex_destroy(&c->lock);
+	pthread_cond_destroy(&c->changed);
+	free(c);
+}
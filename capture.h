@@ -0,0 +1,31 @@
+// VIDEO CAPTURE
+// records every frame a machine makes into a .y4m (raw yuv 4:4:4, for tools like ffmpeg) or an
+// animated .gif. a frame is copied into a ring of slots as it's made, and a thread of its own
+// turns the slots into pixels and writes them, so the emulator only pays for one copy of the
+// screen a frame - and not even that when the screen is the same as the frame before
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "core.h"
+
+// frames that can be waiting for the encoder - a little over 4 seconds at 60 hz
+#define CAPTURE_SLOTS 256
+
+// one screen, and how many frames in a row it was shown for
+	struct capture_slot {
+		uint64_t screen[PLANES][SCREEN_HEIGHT][2];
+		bool     hires;
+		uint32_t frames;
+	};
+	
+	struct capture;
+
+bool is_capture_file(const char* name);
+struct capture* capture_open(const char* name, const struct chip8_machine* m, const uint32_t palette[4], bool realtime);
+void capture_frame(struct capture* c, const struct chip8_machine* m);
+void capture_close(struct capture* c);
+
+#endif
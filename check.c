@@ -0,0 +1,457 @@
+// CONFORMANCE CHECK
+// a suite file has one line per rom: where it is, how many frames to run and how many
+// instructions each, the keys to press, the hash the screen should end up with, and how fast the
+// default engine ran it when the line was written - and, if the line goes on, the platform to run
+// it as, which picks the mode and its quirks whatever the extension.
+// every engine has to end on the same hash with the same key presses. then the default engine
+// runs the rom flat out, taking turns with the interpreter on a calibration loop, and its speed is
+// how many times the calibration's it got. a host that's slower or busier slows both down the same,
+// so the speed stays put from machine to machine, and it fails if it's below the suite's by more
+// than the tolerance. 'update' instead of a tolerance writes the hashes and speeds it got back
+
+// C LIBRARIES
+#include <time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+	#include <unistd.h>
+	#include <sys/wait.h>
+	#include <sys/resource.h>
+#endif
+
+#include "core.h"
+#include "check.h"
+
+// frames a scripted key is held down for
+#define KEY_FRAMES 6
+
+// frames of INSTRUCTIONS_PER_TICK in a timed run, and how many runs a rom gets - each one after a
+// run of the calibration loop just as long
+#define TIMED_FRAMES 1000
+#define TIMED_RUNS   7
+
+// timed runs never skip, so a rom waiting on a key or a timer runs its loop like the hardware
+// would. only one that exits (00FD) gets through too few instructions to time - below this many
+// it has no speed, and only its screen is checked
+#define TIMED_MINIMUM 1000000
+
+// how much slower than the suite's speed a rom can run, unless the args give another
+#define DEFAULT_TOLERANCE 0.25
+
+// the calibration loop: sets I, counts in v0, adds and xors it into v1 and v2, writes v2 out as
+// bcd and reads it back, draws, and clears the screen when that collides - a bit of everything,
+// and it never waits on a key or a timer
+static const uint8_t CALIBRATION[] = {
+	0xA3, 0x00,		// i = 0x300
+	0x70, 0x01,		// v0 += 1
+	0x81, 0x04,		// v1 += v0
+	0x82, 0x13,		// v2 ^= v1
+	0xF2, 0x33,		// bcd v2
+	0xF2, 0x65,		// load v0 - v2
+	0xD0, 0x05,		// sprite v0 v0 5
+	0x3F, 0x00,		// if vf != 0 then
+	0x00, 0xE0,		// clear
+	0x12, 0x00,		// jump 0x200
+};
+
+#define MAX_LINES   256
+#define MAX_LINE    512
+#define MAX_PRESSES 16
+
+	struct press {
+		uint8_t  key;
+		uint32_t frame;		// held down from this frame for KEY_FRAMES frames
+	};
+
+// one rom of the suite
+	struct entry {
+		char         rom[256];
+		uint32_t     frames;
+		uint32_t     per_frame;
+		char         keys[128];		// as written in the suite, so an update can write it back
+		struct press presses[MAX_PRESSES];
+		int          press_count;
+		uint64_t     hash;			// 0 if the suite doesn't have one yet
+		double       speed;			// times the calibration's, 0 if the suite doesn't have one yet
+		char         platform[16];	// a mode's name, empty for the one the extension picks
+	};
+
+// what checking one rom came back with
+	struct result {
+		uint64_t hash;
+		double   speed;			// instructions a second
+		double   relative;		// times the calibration's - what the suite keeps
+		long     peak_rss_kb;	// -1 where it couldn't be measured
+		char     problem[64];	// empty if nothing went wrong
+	};
+
+// current time in seconds
+static double now() {
+	struct timespec ts;
+	timespec_get(&ts, TIME_UTC);
+	
+	return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
+
+// SUITE FILES
+// keys are '-' for none, or key@frame pairs split by commas - "5@30,a@90" holds 5 from frame 30
+// and A from frame 90
+static bool parse_keys(struct entry* e) {
+	e->press_count = 0;
+	
+	if (strcmp(e->keys, "-") == 0) {
+		return true;
+	}
+	
+	for (const char* c = e->keys; *c; ) {
+		unsigned key, frame;
+		int used;
+		
+		if (e->press_count == MAX_PRESSES || sscanf(c, "%x@%u%n", &key, &frame, &used) != 2 || key > 0xF) {
+			return false;
+		}
+		
+		e->presses[e->press_count++] = (struct press) {(uint8_t) key, frame};
+		c += used;
+		c += *c == ',';
+	}
+	
+	return true;
+}
+
+// a line of the suite - false if it isn't one (a comment, or blank)
+static bool parse_entry(const char* line, struct entry* e) {
+	char hash[32], speed[32];
+	enum mode mode;
+	e->platform[0] = '\0';
+	
+	if (sscanf(line, "%255s %u %u %127s %31s %31s %15s", e->rom, &e->frames, &e->per_frame, e->keys, hash, speed, e->platform) < 6 || e->rom[0] == '#') {
+		return false;
+	}
+	
+	if (e->platform[0] && !parse_mode(e->platform, &mode)) {
+		LOG("unknown platform %s for %s", e->platform, e->rom);
+		return false;
+	}
+	
+	e->hash  = strtoull(hash, NULL, 16);
+	e->speed = strtod(speed, NULL);
+	
+	return parse_keys(e);
+}
+
+static void format_entry(const struct entry* e, char* out, size_t size) {
+	char speed[32] = "-";
+	
+	if (e->speed > 0) {
+		snprintf(speed, sizeof(speed), "%.3f", e->speed);
+	}
+	
+	int length = snprintf(out, size, "%-28s %6u %9u   %-16s %016llx %12s",
+	                      e->rom, e->frames, e->per_frame, e->keys, (unsigned long long) e->hash, speed);
+	
+	snprintf(out + length, size - length, e->platform[0] ? "   %s\n" : "%s\n", e->platform);
+}
+
+// RUNNING
+// the keypad for frame f of the script
+static void press_keys(struct chip8_machine* m, const struct entry* e, uint32_t f) {
+	memset(m->keypad, 0, sizeof(m->keypad));
+	
+	for (int p = 0; p < e->press_count; p++) {
+		if (f >= e->presses[p].frame && f < e->presses[p].frame + KEY_FRAMES) {
+			m->keypad[e->presses[p].key] = true;
+		}
+	}
+}
+
+// runs frames frames of per_frame instructions on an engine, skipping halts and idle loops unless
+// it's timing - returns the machine, NULL if the rom wouldn't load. whoever gets it destroys it
+static struct chip8_machine* play(const struct entry* e, enum engine engine, uint32_t frames, uint32_t per_frame, bool timing) {
+	struct chip8_machine* m = machine_create(1);
+	
+	if (!m) {
+		return NULL;
+	}
+	
+	m->quiet      = true;
+	m->engine     = engine;
+	m->never_skip = timing;
+	
+	if (!open_file(m, (char*) e->rom)) {
+		machine_destroy(m);
+		return NULL;
+	}
+	
+	// every rom in the suite fits in any mode's memory, so the mode can change after loading
+	enum mode mode;
+	
+	if (e->platform[0] && parse_mode(e->platform, &mode)) {
+		set_mode(m, mode);
+	}
+	
+	clear_screen(m);
+	
+	for (uint32_t f = 0; f < frames; f++) {
+		press_keys(m, e, f);
+		run_frame(m, per_frame);
+	}
+	
+	return m;
+}
+
+// instructions a second the interpreter runs the calibration loop at
+static double calibrate() {
+	struct chip8_machine* m = machine_create(1);
+	
+	if (!m) {
+		return 0;
+	}
+	
+	m->quiet  = true;
+	m->engine = ENGINE_INTERPRETER;
+	load_rom(m, "calibration.ch8", CALIBRATION, sizeof(CALIBRATION));
+	
+	double start = now();
+	
+	for (uint32_t f = 0; f < TIMED_FRAMES; f++) {
+		run_frame(m, INSTRUCTIONS_PER_TICK);
+	}
+	
+	double elapsed = now() - start;
+	uint64_t ran = m->executed - m->skipped;
+	machine_destroy(m);
+	
+	return ran / (elapsed > 0 ? elapsed : 1e-9);
+}
+
+// how fast the default engine runs the rom flat out, in instructions a second and times the
+// calibration's, counting only instructions that really ran. a run of the calibration goes right
+// before every run of the rom, so whatever else the host is busy with lands on both, and the
+// speed is the median of the TIMED_RUNS pairs - one pair that got unlucky doesn't move it. 0 if
+// too few ran
+static double time_rom(const struct entry* e, double* relative) {
+	double best = 0;
+	double ratios[TIMED_RUNS];
+	*relative = 0;
+	
+	for (int k = 0; k < TIMED_RUNS; k++) {
+		double calibration = calibrate();
+		
+		double start = now();
+		struct chip8_machine* m = play(e, ENGINE_BLOCKS, TIMED_FRAMES, INSTRUCTIONS_PER_TICK, true);
+		double elapsed = now() - start;
+		
+		uint64_t ran = m ? m->executed - m->skipped : 0;
+		machine_destroy(m);
+		
+		if (ran < TIMED_MINIMUM || calibration <= 0) {
+			return 0;
+		}
+		
+		double speed = ran / (elapsed > 0 ? elapsed : 1e-9);
+		best = speed > best ? speed : best;
+		
+		// kept in order as they come in
+		int at = k;
+		
+		for (; at > 0 && ratios[at - 1] > speed / calibration; at--) {
+			ratios[at] = ratios[at - 1];
+		}
+		ratios[at] = speed / calibration;
+	}
+	
+	*relative = ratios[TIMED_RUNS / 2];
+	
+	return best;
+}
+
+// checks one rom - what went wrong goes in the result's problem, and the hash and speed it measured
+static void check_rom(const struct entry* e, bool update, double tolerance, struct result* r) {
+	*r = (struct result) {0};
+	
+	// the interpreter is the reference the other engines are held to
+	for (int engine = 0; engine < ENGINE_COUNT; engine++) {
+		struct chip8_machine* m = play(e, engine, e->frames, e->per_frame, false);
+		
+		if (!m) {
+			snprintf(r->problem, sizeof(r->problem), "failed to open rom");
+			return;
+		}
+		
+		uint64_t h = screen_hash(m);
+		machine_destroy(m);
+		
+		if (engine == ENGINE_INTERPRETER) {
+			r->hash = h;
+		}
+		
+		if (h != r->hash) {
+			snprintf(r->problem, sizeof(r->problem), "%s disagrees with the interpreter", engine_name(engine));
+			return;
+		}
+	}
+	
+	r->speed = time_rom(e, &r->relative);
+	
+	if (update) {
+		return;
+	}
+	if (r->hash != e->hash) {
+		snprintf(r->problem, sizeof(r->problem), "wrong screen");
+	}
+	else if (e->speed > 0 && r->relative < e->speed * (1 - tolerance)) {
+		snprintf(r->problem, sizeof(r->problem), "too slow");
+	}
+}
+	
+#ifndef _WIN32
+// most memory this process has held at once so far, in kb
+static long max_rss_kb() {
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	
+	#ifdef __APPLE__
+		return usage.ru_maxrss / 1024;	// bytes on macos
+	#else
+		return usage.ru_maxrss;
+	#endif
+}
+#endif
+
+// checks one rom in a process of its own, whose peak memory starts out as what it was forked
+// with - how far checking the rom pushes it past that is the rom's own, however much any rom
+// before it needed. windows can't fork, so it checks the rom in this process and has no peak -
+// and so does a fork that fails
+static void measure_rom(const struct entry* e, bool update, double tolerance, struct result* r) {
+#ifndef _WIN32
+	int ends[2];
+	
+	if (pipe(ends) == 0) {
+		fflush(stdout);
+		pid_t child = fork();
+		
+		if (child == 0) {
+			close(ends[0]);
+			
+			long before = max_rss_kb();
+			check_rom(e, update, tolerance, r);
+			r->peak_rss_kb = max_rss_kb() - before;
+			
+			bool sent = write(ends[1], r, sizeof(*r)) == sizeof(*r);
+			_exit(sent ? 0 : 1);
+		}
+		
+		close(ends[1]);
+		
+		if (child > 0) {
+			bool got = read(ends[0], r, sizeof(*r)) == sizeof(*r);
+			close(ends[0]);
+			
+			int status;
+			
+			if (waitpid(child, &status, 0) == child && got) {
+				return;
+			}
+			
+			*r = (struct result) {.peak_rss_kb = -1};
+			snprintf(r->problem, sizeof(r->problem), "check crashed");
+			return;
+		}
+		
+		close(ends[0]);
+	}
+#endif
+	
+	check_rom(e, update, tolerance, r);
+	r->peak_rss_kb = -1;
+}
+
+int run_check(int argc, char** argv) {
+	// argv -> ['chip-8.exe', '--check', suite file, report file, tolerance or 'update']
+	const char* suite_name  = argc > 2 ? argv[2] : "roms/check.txt";
+	const char* report_name = argc > 3 ? argv[3] : "check.tsv";
+	bool        update      = argc > 4 && strcmp(argv[4], "update") == 0;
+	double      tolerance   = argc > 4 && !update ? strtod(argv[4], NULL) : DEFAULT_TOLERANCE;
+	
+	// the whole suite is kept, comments and all, so an update only changes the numbers
+	static char lines[MAX_LINES][MAX_LINE];
+	int line_count = 0;
+	
+	FILE* suite = fopen(suite_name, "r");
+	
+	if (!suite) {
+		LOG("couldn't open suite %s", suite_name);
+		return -1;
+	}
+	
+	while (line_count < MAX_LINES && fgets(lines[line_count], MAX_LINE, suite)) {
+		line_count++;
+	}
+	fclose(suite);
+	
+	FILE* report = fopen(report_name, "w");
+	
+	if (!report) {
+		LOG("couldn't open report %s", report_name);
+		return -1;
+	}
+	
+	fprintf(report, "rom\tplatform\tframes\tscreen_hash\texpected\tinstructions_per_sec\tspeed\tbaseline\tpeak_rss_kb\tresult\n");
+	
+	int roms = 0;
+	int failed = 0;
+	
+	for (int l = 0; l < line_count; l++) {
+		struct entry e;
+		
+		if (!parse_entry(lines[l], &e)) {
+			continue;
+		}
+		
+		struct result r;
+		measure_rom(&e, update, tolerance, &r);
+		
+		const char* problem = r.problem[0] ? r.problem : NULL;
+		char peak[32] = "-";
+		
+		if (r.peak_rss_kb >= 0) {
+			snprintf(peak, sizeof(peak), "%ld", r.peak_rss_kb);
+		}
+		
+		roms++;
+		failed += problem != NULL;
+		
+		printf("%-28s %-8s %12.0f instructions/sec %7.3fx   %s\n", e.rom, e.platform, r.speed, r.relative, problem ? problem : "ok");
+		fprintf(report, "%s\t%s\t%u\t%016llx\t%016llx\t%.0f\t%.3f\t%.3f\t%s\t%s\n", e.rom, e.platform, e.frames,
+		        (unsigned long long) r.hash, (unsigned long long) e.hash, r.speed, r.relative, e.speed, peak, problem ? problem : "ok");
+		
+		if (update && !problem) {
+			e.hash  = r.hash;
+			e.speed = r.relative;
+			format_entry(&e, lines[l], MAX_LINE);
+		}
+	}
+	
+	fclose(report);
+	
+	if (update) {
+		suite = fopen(suite_name, "w");
+		
+		if (!suite) {
+			LOG("couldn't write suite %s", suite_name);
+			return -1;
+		}
+		
+		for (int l = 0; l < line_count; l++) {
+			fputs(lines[l], suite);
+		}
+		fclose(suite);
+	}
+	
+	printf("%d of %d roms passed\n", roms - failed, roms);
+	
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,11 @@
+// CONFORMANCE CHECK
+// runs a suite of roms with scripted key presses on every engine, checks each final screen
+// against the suite's hash and each rom's speed, relative to a calibration loop, against the
+// speed the suite remembers
+#ifndef CHECK_H
+#define CHECK_H
+
+// argv -> ['chip-8.exe', '--check', suite file, report file, tolerance or 'update']
+int run_check(int argc, char** argv);
+
+#endif
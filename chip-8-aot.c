@@ -0,0 +1,454 @@
+// ahead-of-time compiler - turns roms into C for the aot engine
+// usage: ./chip-8-aot [output file] [rom] [rom] ...
+// starts at 0x200 and follows jumps, calls, returns and skips to every block it can reach, then
+// writes each block as one C function. BNNN targets can't be known before the rom runs, so
+// they're left to the interpreter, along with anything the rom rewrites while it runs
+// .sc8 and .xo8 roms are compiled for SUPER-CHIP and XO-CHIP, like open_file() loads them - the
+// instructions those add go through their handlers, and only the first 4 kb can hold code. each
+// rom is compiled with its mode's quirks, so a machine running it with another profile doesn't use it
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "core.h"
+#include "block.h"
+
+// one rom being compiled
+	struct rom {
+		uint8_t   mem[MEMORY_SIZE];			// the rom at 0x200, the way a machine sees it
+		uint32_t  end;						// address right after the last byte of the rom
+		enum mode mode;						// what the extension says it runs on
+		uint8_t   quirks;					// QUIRK_ bits of the mode's profile
+		uint8_t   length[CODE_SIZE / 2];	// instructions in the block starting at each address, 0 if none
+		bool      reached[CODE_SIZE / 2];	// whether a block has to start at each address
+	};
+
+// what write_rom() calls each mode and profile in the C it writes
+static const char* mode_constants[]   = {"MODE_CHIP8", "MODE_SCHIP", "MODE_XOCHIP"};
+static const char* quirks_constants[] = {"QUIRKS_CHIP8", "QUIRKS_SCHIP", "QUIRKS_XOCHIP"};
+
+static uint16_t fetch(const struct rom* r, uint16_t addr) {
+	return r->mem[addr] << 8 | r->mem[addr + 1];
+}
+
+// the same instructions decode() ends a block at
+static bool is_branch(const struct rom* r, uint16_t op) {
+	uint8_t top = op >> 12;
+	
+	return top == 0x1 || top == 0x2 || top == 0xB || op == 0x00EE
+	    || top == 0x3 || top == 0x4 || top == 0x5 || top == 0x9 || top == 0xE
+	    || (top == 0xF && ((op & 0x00FF) == 0x0A || (op & 0x00FF) == 0x18))
+	    || (r->mode != MODE_CHIP8 && op == 0x00FD)
+	    || (r->mode == MODE_XOCHIP && op == 0xF000);
+}
+
+// how far a taken skip at addr goes, the way decode() works it out
+static uint16_t skip_length(const struct rom* r, uint16_t addr) {
+	return r->mode == MODE_XOCHIP && fetch(r, addr + 2) == 0xF000 ? 4 : 2;
+}
+
+// FINDING CODE
+// every address a block has to start at, waiting to be looked at
+	static uint16_t pending[CODE_SIZE / 2];
+	static int      pending_count;
+
+static void reach(struct rom* r, uint16_t addr) {
+	// compiled code only ever covers the rom itself, at even addresses
+	if (addr & 1 || addr < 0x200 || addr + 2u > r->end || addr >= CODE_SIZE || r->reached[addr >> 1]) {
+		return;
+	}
+	
+	// each address goes on the list once, so it never holds more than one per even address
+	r->reached[addr >> 1] = true;
+	pending[pending_count++] = addr;
+}
+
+// marks every block reachable from 0x200
+static void find_blocks(struct rom* r) {
+	pending_count = 0;
+	reach(r, 0x200);
+	
+	while (pending_count > 0) {
+		uint16_t start = pending[--pending_count];
+		
+		// stop after a branch, at the end of the rom, or once the block is as long as blocks get
+		uint16_t addr = start;
+		uint16_t op = 0;
+		uint8_t length = 0;
+		
+		while (length < MAX_BLOCK_LENGTH && addr + 2u <= r->end && addr < CODE_SIZE) {
+			op = fetch(r, addr);
+			length++;
+			addr += 2;
+			
+			if (is_branch(r, op)) {
+				break;
+			}
+		}
+		
+		r->length[start >> 1] = length;
+		
+		// where it can go next - addr is right after the last instruction
+		if (!is_branch(r, op)) {
+			reach(r, addr);
+			continue;
+		}
+		
+		switch (op >> 12) {
+			case 0x0:	// 00EE - back to whoever called, which was reached from the call. 00FD - nowhere
+			case 0xB:	// computed - found out while running
+				break;
+			case 0x1:
+				reach(r, op & 0x0FFF);
+				break;
+			case 0x2:
+				reach(r, op & 0x0FFF);
+				reach(r, addr);
+				break;
+			case 0xF:	// Fx0A, Fx18 - and F000, which goes on after its address
+				reach(r, op == 0xF000 ? addr + 2 : addr);
+				break;
+			default:	// skips
+				reach(r, addr);
+				reach(r, addr + skip_length(r, addr - 2));
+		}
+	}
+}
+
+// WRITING C
+// the statement for one instruction - the block set pc to its end before the first one, like run_blocks()
+// anything left undefined in CHIP-8 goes through its handler, which knows what the machine's mode makes of it
+static void write_instruction(FILE* out, const struct rom* r, uint16_t addr, uint16_t op) {
+	// a taken skip - XO-CHIP's depends on the next instruction, which this block doesn't cover
+	char skip[32] = "2";
+	
+	if (r->mode == MODE_XOCHIP) {
+		snprintf(skip, sizeof(skip), "m->decoded[0x%03x >> 1].skip", addr);
+	}
+	
+	uint8_t  x   = (op & 0x0F00) >> 8;
+	uint8_t  y   = (op & 0x00F0) >> 4;
+	uint8_t  n   = (op & 0x000F);
+	uint8_t  nn  = (op & 0x00FF);
+	uint16_t nnn = (op & 0x0FFF);
+	
+	// the register 8xy6 and 8xyE shift
+	uint8_t from = r->quirks & QUIRK_SHIFT_VY ? y : x;
+	
+	switch (op >> 12) {
+		case 0x0:
+			if (op == 0x00E0) {
+				fprintf(out, "\tclear_screen(m);\n");
+			} else if (op == 0x00EE) {
+				fprintf(out, "\tif (m->stack_addr > -1) {\n");
+				fprintf(out, "\t\tm->pc = m->stack[m->stack_addr];\n");
+				fprintf(out, "\t\tm->stack[m->stack_addr--] = 0;\n");
+				fprintf(out, "\t} else {\n");
+				fprintf(out, "\t\traise_fault(m, FAULT_STACK_UNDERFLOW, \"stack underflow error\");\n");
+				fprintf(out, "\t}\n");
+			} else {
+				fprintf(out, "\taot_op(m, 0x%03x);\n", addr);
+			}
+			break;
+		case 0x1:
+			// a jump that might close an idle loop goes through its handler, so it can halt the machine
+			if (nnn == addr || nnn + 4 == addr) {
+				fprintf(out, "\taot_op(m, 0x%03x);\n", addr);
+			} else {
+				fprintf(out, "\tm->pc = 0x%03x;\n", nnn);
+			}
+			break;
+		case 0x2:
+			fprintf(out, "\tif (m->stack_addr < 11) {\n");
+			fprintf(out, "\t\tm->stack[++m->stack_addr] = m->pc;\n");
+			fprintf(out, "\t\tm->pc = 0x%03x;\n", nnn);
+			fprintf(out, "\t} else {\n");
+			fprintf(out, "\t\traise_fault(m, FAULT_STACK_OVERFLOW, \"stack overflow error\");\n");
+			fprintf(out, "\t}\n");
+			break;
+		case 0x3:
+			fprintf(out, "\tm->pc += m->v[0x%x] == 0x%02x ? %s : 0;\n", x, nn, skip);
+			break;
+		case 0x4:
+			fprintf(out, "\tm->pc += m->v[0x%x] != 0x%02x ? %s : 0;\n", x, nn, skip);
+			break;
+		case 0x5:
+			if (n == 0) {
+				fprintf(out, "\tm->pc += m->v[0x%x] == m->v[0x%x] ? %s : 0;\n", x, y, skip);
+			} else {
+				fprintf(out, "\taot_op(m, 0x%03x);\n", addr);
+			}
+			break;
+		case 0x6:
+			fprintf(out, "\tm->v[0x%x] = 0x%02x;\n", x, nn);
+			break;
+		case 0x7:
+			fprintf(out, "\tm->v[0x%x] += 0x%02x;\n", x, nn);
+			break;
+		case 0x8:
+			switch (n) {
+				case 0x0:
+					fprintf(out, "\tm->v[0x%x] = m->v[0x%x];\n", x, y);
+					break;
+				case 0x1:
+				case 0x2:
+				case 0x3:
+					fprintf(out, "\tm->v[0x%x] %c= m->v[0x%x];\n", x, "|&^"[n - 1], y);
+					if (r->quirks & QUIRK_VF_RESET) {
+						fprintf(out, "\tm->v[0xf] = 0;\n");
+					}
+					break;
+				case 0x4:
+					fprintf(out, "\t{\n");
+					fprintf(out, "\t\tuint16_t sum = m->v[0x%x] + m->v[0x%x];\n", x, y);
+					fprintf(out, "\t\tm->v[0x%x] = (uint8_t) sum;\n", x);
+					fprintf(out, "\t\tm->v[0xf] = sum > 0xFF;\n");
+					fprintf(out, "\t}\n");
+					break;
+				case 0x5:
+					fprintf(out, "\t{\n");
+					fprintf(out, "\t\tbool borrow = m->v[0x%x] < m->v[0x%x];\n", x, y);
+					fprintf(out, "\t\tm->v[0x%x] -= m->v[0x%x];\n", x, y);
+					fprintf(out, "\t\tm->v[0xf] = !borrow;\n");
+					fprintf(out, "\t}\n");
+					break;
+				case 0x6:
+					fprintf(out, "\t{\n");
+					fprintf(out, "\t\tbool half = m->v[0x%x] & 0x01;\n", from);
+					fprintf(out, "\t\tm->v[0x%x] = m->v[0x%x] >> 1;\n", x, from);
+					fprintf(out, "\t\tm->v[0xf] = half;\n");
+					fprintf(out, "\t}\n");
+					break;
+				case 0x7:
+					fprintf(out, "\t{\n");
+					fprintf(out, "\t\tbool borrow = m->v[0x%x] < m->v[0x%x];\n", y, x);
+					fprintf(out, "\t\tm->v[0x%x] = m->v[0x%x] - m->v[0x%x];\n", x, y, x);
+					fprintf(out, "\t\tm->v[0xf] = !borrow;\n");
+					fprintf(out, "\t}\n");
+					break;
+				case 0xE:
+					fprintf(out, "\t{\n");
+					fprintf(out, "\t\tbool overflow = (m->v[0x%x] & 0x80) == 0x80;\n", from);
+					fprintf(out, "\t\tm->v[0x%x] = m->v[0x%x] << 1;\n", x, from);
+					fprintf(out, "\t\tm->v[0xf] = overflow;\n");
+					fprintf(out, "\t}\n");
+					break;
+				default:
+					fprintf(out, "\traise_fault(m, FAULT_UNDEFINED, \"undefined\");\n");
+			}
+			break;
+		case 0x9:
+			fprintf(out, "\tm->pc += m->v[0x%x] != m->v[0x%x] ? %s : 0;\n", x, y, skip);
+			break;
+		case 0xA:
+			fprintf(out, "\tm->i = 0x%03x;\n", nnn);
+			break;
+		case 0xB:
+			fprintf(out, "\tm->pc = m->v[0x%x] + 0x%03x;\n", r->quirks & QUIRK_JUMP_VX ? x : 0, nnn);
+			break;
+		case 0xC:
+			// the random numbers live in core.c
+			fprintf(out, "\taot_op(m, 0x%03x);\n", addr);
+			break;
+		case 0xD:
+			fprintf(out, "\t%s(m, m->v[0x%x], m->v[0x%x], %d);\n", r->quirks & QUIRK_WRAP ? "draw_instr_wrap" : "draw_instr", x, y, n);
+			break;
+		case 0xE:
+			if (nn == 0x9E || nn == 0xA1) {
+				fprintf(out, "\tm->pc += m->keypad[m->v[0x%x] & 0xF] ? %s : %s;\n", x, nn == 0x9E ? skip : "0", nn == 0x9E ? "0" : skip);
+			} else {
+				fprintf(out, "\traise_fault(m, FAULT_UNDEFINED, \"undefined\");\n");
+			}
+			break;
+		default:	// 0xF
+			switch (nn) {
+				case 0x07:
+					fprintf(out, "\tm->v[0x%x] = m->delay;\n", x);
+					break;
+				case 0x0A:
+					fprintf(out, "\twait_for_key(m, 0x%x);\n", x);
+					break;
+				case 0x15:
+					fprintf(out, "\tm->delay = m->v[0x%x];\n", x);
+					break;
+				case 0x18:
+					fprintf(out, "\tm->sound = m->v[0x%x];\n", x);
+					fprintf(out, "\tm->halted = HALT_SOUND;\n");
+					break;
+				case 0x1E:
+					fprintf(out, "\tm->i += m->v[0x%x];\n", x);
+					if (r->mode == MODE_CHIP8) {
+						fprintf(out, "\tm->v[0xf] = m->i > 0xFFF;\n");
+					}
+					break;
+				case 0x29:
+					fprintf(out, "\tm->i = (m->v[0x%x] & 0x0F) * 5;\n", x);
+					break;
+				case 0x33:
+				case 0x55:
+					// writes memory - the handler keeps decoded[] and every cache up to date
+					fprintf(out, "\taot_op(m, 0x%03x);\n", addr);
+					break;
+				case 0x65:
+					fprintf(out, "\tfor (int a = 0; a <= 0x%x; a++) {\n", x);
+					fprintf(out, "\t\tm->v[a] = m->mem[(uint16_t) (m->i + a)];\n");
+					fprintf(out, "\t}\n");
+					if (r->quirks & QUIRK_INCREMENT_I) {
+						fprintf(out, "\tm->i += %d;\n", x + 1);
+					}
+					break;
+				default:
+					fprintf(out, "\taot_op(m, 0x%03x);\n", addr);
+			}
+	}
+}
+
+// one C function for the block at start
+static void write_block(FILE* out, const struct rom* r, int index, uint16_t start) {
+	uint8_t  length = r->length[start >> 1];
+	uint16_t end    = start + 2 * length;
+	
+	fprintf(out, "static uint8_t rom%d_%03x(struct chip8_machine* m) {\n", index, start);
+	fprintf(out, "\tm->pc = 0x%03x;\n", end);
+	
+	for (uint8_t k = 0; k < length; k++) {
+		uint16_t addr = start + 2 * k;
+		uint16_t op   = fetch(r, addr);
+		char text[32];
+		
+		format_instruction(op, text, sizeof(text));
+		fprintf(out, "\t\n\t// %03x  %s\n", addr, text);
+		write_instruction(out, r, addr, op);
+		
+		// if the write landed on this block, the rest of it is no longer what's in memory - XO-CHIP's
+		// 5xy2 writes memory too
+		uint8_t nn     = op & 0x00FF;
+		bool    writes = (op >> 12 == 0xF && (nn == 0x33 || nn == 0x55))
+		              || (r->mode == MODE_XOCHIP && (op & 0xF00F) == 0x5002);
+		
+		if (writes && k + 1 < length) {
+			fprintf(out, "\tif (m->aot->stale[0x%03x >> 1]) {\n", start);
+			fprintf(out, "\t\tm->pc = 0x%03x;\n", addr + 2);
+			fprintf(out, "\t\treturn %d;\n", k + 1);
+			fprintf(out, "\t}\n");
+		}
+	}
+	
+	fprintf(out, "\t\n\treturn %d;\n}\n\n", length);
+}
+
+// the rom's bytes, its blocks and the table that finds them
+static void write_rom(FILE* out, const struct rom* r, int index, const char* name) {
+	fprintf(out, "// %s\n", name);
+	fprintf(out, "static const uint8_t rom%d[] = {", index);
+	
+	for (uint32_t a = 0x200; a < r->end; a++) {
+		fprintf(out, "%s0x%02x,", (a - 0x200) % 16 == 0 ? "\n\t" : " ", r->mem[a]);
+	}
+	
+	fprintf(out, "\n};\n\n");
+	
+	for (uint16_t a = 0x200; a < r->end && a < CODE_SIZE; a += 2) {
+		if (r->length[a >> 1] != 0) {
+			write_block(out, r, index, a);
+		}
+	}
+	
+	fprintf(out, "static const struct aot_block rom%d_blocks[CODE_SIZE / 2] = {\n", index);
+	
+	for (uint16_t a = 0x200; a < r->end && a < CODE_SIZE; a += 2) {
+		if (r->length[a >> 1] != 0) {
+			fprintf(out, "\t[0x%03x >> 1] = {rom%d_%03x, %d},\n", a, index, a, r->length[a >> 1]);
+		}
+	}
+	
+	fprintf(out, "};\n\n");
+	fprintf(out, "static const struct aot_program rom%d_program = {\"", index);
+	
+	// paths can have backslashes in them
+	for (const char* c = name; *c; c++) {
+		fprintf(out, *c == '\\' || *c == '"' ? "\\%c" : "%c", *c);
+	}
+	
+	fprintf(out, "\", rom%d, sizeof(rom%d), rom%d_blocks, %s, %s};\n\n", index, index, index,
+	        mode_constants[r->mode], quirks_constants[quirks_for_mode(r->mode)]);
+}
+
+// reads a rom into r, false if it can't be
+static bool load(struct rom* r, const char* name) {
+	FILE* file = fopen(name, "rb");
+	
+	if (!file) {
+		LOG("couldn't open %s", name);
+		return false;
+	}
+	
+	memset(r, 0, sizeof(*r));
+	r->mode   = mode_for_file(name);
+	r->quirks = quirk_set(quirks_for_mode(r->mode));
+	size_t size = fread(&r->mem[0x200], 1, (r->mode == MODE_XOCHIP ? MEMORY_SIZE : 0x1000) - 0x200, file);
+	fclose(file);
+	
+	if (size == 0) {
+		LOG("%s is empty", name);
+		return false;
+	}
+	
+	r->end = 0x200 + size;
+	
+	return true;
+}
+
+int main(int argc, char** argv) {
+	if (argc < 3) {
+		LOG("usage: ./chip-8-aot [output file] [rom] [rom] ...");
+		return -1;
+	}
+	
+	FILE* out = fopen(argv[1], "w");
+	
+	if (!out) {
+		LOG("couldn't open %s", argv[1]);
+		return -1;
+	}
+	
+	fprintf(out, "// made by chip-8-aot - don't edit, run it again instead\n\n");
+	fprintf(out, "#include \"aot.h\"\n\n");
+	
+	static struct rom r;
+	int roms = 0;
+	
+	for (int a = 2; a < argc; a++) {
+		if (!load(&r, argv[a])) {
+			fclose(out);
+			return -1;
+		}
+		
+		find_blocks(&r);
+		write_rom(out, &r, roms++, argv[a]);
+		
+		// how much of the rom turned out to be reachable code
+		int blocks = 0;
+		int instructions = 0;
+		
+		for (int b = 0; b < CODE_SIZE / 2; b++) {
+			blocks += r.length[b] != 0;
+			instructions += r.length[b];
+		}
+		
+		printf("%-32s %5d blocks %6d instructions\n", argv[a], blocks, instructions);
+	}
+	
+	// the list aot.c looks roms up in
+	fprintf(out, "const struct aot_program* const aot_programs[] = {\n");
+	
+	for (int k = 0; k < roms; k++) {
+		fprintf(out, "\t&rom%d_program,\n", k);
+	}
+	
+	fprintf(out, "\tNULL\n};\n");
+	fclose(out);
+	
+	return 0;
+}
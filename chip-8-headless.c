@@ -0,0 +1,42 @@
+// entry point for machines without SDL
+// usage: ./chip-8-headless [rom location] [frames/instructions] [count] [engine] [quirks, trace, .wav and/or .y4m or .gif file]
+//        ./chip-8-headless --batch [results file] [frames] [seeds per rom] [engine] [rom or pack] [rom or pack] ...
+//        ./chip-8-headless --lockstep [rom location] [frames]
+//        ./chip-8-headless --check [suite file] [report file] [tolerance or 'update']
+//        ./chip-8-headless --fuzz [rom location] [seconds] [instructions per frame] [crash file prefix]
+
+#include <stddef.h>
+#include <string.h>
+
+#include "headless.h"
+#include "batch.h"
+#include "lockstep.h"
+#include "check.h"
+#include "fuzz.h"
+
+int main(int argc, char** argv) {
+	if (argc > 1 && strcmp("--batch", argv[1]) == 0) {
+		return run_batch(argc, argv);
+	}
+	
+	if (argc > 1 && strcmp("--lockstep", argv[1]) == 0) {
+		return run_lockstep(argc, argv);
+	}
+	
+	if (argc > 1 && strcmp("--check", argv[1]) == 0) {
+		return run_check(argc, argv);
+	}
+	
+	if (argc > 1 && strcmp("--fuzz", argv[1]) == 0) {
+		return run_fuzz(argc, argv);
+	}
+	
+	// shift the args over so they line up with ./chip-8.exe --bench
+	char* args[10] = {argv[0], "--bench", NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL};
+	
+	for (int a = 1; a < argc && a < 9; a++) {
+		args[a + 1] = argv[a];
+	}
+	
+	return run_headless(argc + 1 > 10 ? 10 : argc + 1, args);
+}
@@ -0,0 +1,40 @@
+// pack builder - puts every rom in a directory into one pack file, or lists what's in a pack
+// usage: ./chip-8-pack [pack file] [rom directory]   builds
+//        ./chip-8-pack [pack file]                   lists, checking every rom against its hash
+
+#include <stdio.h>
+
+#include "core.h"
+#include "pack.h"
+
+int main(int argc, char** argv) {
+	if (argc < 2 || argc > 3) {
+		LOG("usage: ./chip-8-pack [pack file] [rom directory]");
+		return -1;
+	}
+	
+	if (argc == 3 && !pack_build(argv[1], argv[2])) {
+		return -1;
+	}
+	
+	struct pack* p = pack_open(argv[1]);
+	
+	if (!p) {
+		return -1;
+	}
+	
+	int bad = 0;
+	
+	for (uint32_t e = 0; e < pack_count(p); e++) {
+		const struct pack_entry* entry = pack_entry(p, e);
+		bool ok = pack_hash(pack_data(p, entry), entry->size) == entry->hash;
+		
+		printf("%-40s %6u bytes  %016llx  %s\n", entry->name, entry->size, (unsigned long long) entry->hash, ok ? "ok" : "bad hash");
+		bad += !ok;
+	}
+	
+	printf("%u roms in %s\n", pack_count(p), argv[1]);
+	pack_close(p);
+	
+	return bad ? 1 : 0;
+}
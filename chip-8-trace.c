@@ -0,0 +1,57 @@
+// trace decoder - turns a binary trace back into text, one instruction per line
+// usage: ./chip-8-trace [trace file]
+// prints: pc, opcode, mnemonic, index register, and the register that changed
+
+#include <stdio.h>
+#include <string.h>
+
+#include "core.h"
+#include "trace.h"
+
+int main(int argc, char** argv) {
+	if (argc < 2) {
+		LOG("usage: ./chip-8-trace [trace file]");
+		return -1;
+	}
+	
+	FILE* file = fopen(argv[1], "rb");
+	
+	if (!file) {
+		LOG("couldn't open %s", argv[1]);
+		return -1;
+	}
+	
+	// make sure it's a trace this version knows how to read
+	struct trace_header header;
+	
+	if (fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.magic, TRACE_MAGIC, 4) != 0
+	    || header.version != TRACE_VERSION || header.record_size != sizeof(struct trace_record)) {
+		LOG("%s isn't a version %d trace", argv[1], TRACE_VERSION);
+		fclose(file);
+		return -1;
+	}
+	
+	// read a buffer's worth at a time, the same size the writer used
+	static struct trace_record records[TRACE_BUFFER_RECORDS];
+	size_t count;
+	
+	while ((count = fread(records, sizeof(struct trace_record), TRACE_BUFFER_RECORDS, file)) > 0) {
+		for (size_t k = 0; k < count; k++) {
+			const struct trace_record* r = &records[k];
+			char text[32];
+			
+			format_instruction(r->instr, text, sizeof(text));
+			printf("%03x  %04x  %-20s i=%03x", r->pc, r->instr, text, r->i);
+			
+			if (r->reg != TRACE_NO_REGISTER) {
+				printf("  v%x=%02x", r->reg, r->value);
+			}
+			
+			putchar('\n');
+		}
+	}
+	
+	fclose(file);
+	
+	return 0;
+}
@@ -2,67 +2,27 @@
 #include <time.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <stdbool.h>
 
 // SDL
 #include <SDL3/SDL.h>
 
-// lookup table for reversing a bit string - useful in draw instruction
-	static const uint8_t reverse_table[256] = {
-        0x00, 0x80, 0x40, 0xc0, 0x20, 0xa0, 0x60, 0xe0,
-        0x10, 0x90, 0x50, 0xd0, 0x30, 0xb0, 0x70, 0xf0,
-        0x08, 0x88, 0x48, 0xc8, 0x28, 0xa8, 0x68, 0xe8,
-        0x18, 0x98, 0x58, 0xd8, 0x38, 0xb8, 0x78, 0xf8,
-        0x04, 0x84, 0x44, 0xc4, 0x24, 0xa4, 0x64, 0xe4,
-        0x14, 0x94, 0x54, 0xd4, 0x34, 0xb4, 0x74, 0xf4,
-        0x0c, 0x8c, 0x4c, 0xcc, 0x2c, 0xac, 0x6c, 0xec,
-        0x1c, 0x9c, 0x5c, 0xdc, 0x3c, 0xbc, 0x7c, 0xfc,
-        0x02, 0x82, 0x42, 0xc2, 0x22, 0xa2, 0x62, 0xe2,
-        0x12, 0x92, 0x52, 0xd2, 0x32, 0xb2, 0x72, 0xf2,
-        0x0a, 0x8a, 0x4a, 0xca, 0x2a, 0xaa, 0x6a, 0xea,
-        0x1a, 0x9a, 0x5a, 0xda, 0x3a, 0xba, 0x7a, 0xfa,
-        0x06, 0x86, 0x46, 0xc6, 0x26, 0xa6, 0x66, 0xe6,
-        0x16, 0x96, 0x56, 0xd6, 0x36, 0xb6, 0x76, 0xf6,
-        0x0e, 0x8e, 0x4e, 0xce, 0x2e, 0xae, 0x6e, 0xee,
-        0x1e, 0x9e, 0x5e, 0xde, 0x3e, 0xbe, 0x7e, 0xfe,
-        0x01, 0x81, 0x41, 0xc1, 0x21, 0xa1, 0x61, 0xe1,
-        0x11, 0x91, 0x51, 0xd1, 0x31, 0xb1, 0x71, 0xf1,
-        0x09, 0x89, 0x49, 0xc9, 0x29, 0xa9, 0x69, 0xe9,
-        0x19, 0x99, 0x59, 0xd9, 0x39, 0xb9, 0x79, 0xf9,
-        0x05, 0x85, 0x45, 0xc5, 0x25, 0xa5, 0x65, 0xe5,
-        0x15, 0x95, 0x55, 0xd5, 0x35, 0xb5, 0x75, 0xf5,
-        0x0d, 0x8d, 0x4d, 0xcd, 0x2d, 0xad, 0x6d, 0xed,
-        0x1d, 0x9d, 0x5d, 0xdd, 0x3d, 0xbd, 0x7d, 0xfd,
-        0x03, 0x83, 0x43, 0xc3, 0x23, 0xa3, 0x63, 0xe3,
-        0x13, 0x93, 0x53, 0xd3, 0x33, 0xb3, 0x73, 0xf3,
-        0x0b, 0x8b, 0x4b, 0xcb, 0x2b, 0xab, 0x6b, 0xeb,
-        0x1b, 0x9b, 0x5b, 0xdb, 0x3b, 0xbb, 0x7b, 0xfb,
-        0x07, 0x87, 0x47, 0xc7, 0x27, 0xa7, 0x67, 0xe7,
-        0x17, 0x97, 0x57, 0xd7, 0x37, 0xb7, 0x77, 0xf7,
-        0x0f, 0x8f, 0x4f, 0xcf, 0x2f, 0xaf, 0x6f, 0xef,
-        0x1f, 0x9f, 0x5f, 0xdf, 0x3f, 0xbf, 0x7f, 0xff,
-    };
-
-// fontset - goes into memory at the start
-	static const uint8_t chip8_fontset[80] =
-	{ 
-		0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
-		0x20, 0x60, 0x20, 0x20, 0x70, // 1
-		0xF0, 0x10, 0xF0, 0x80, 0xF0, // 2
-		0xF0, 0x10, 0xF0, 0x10, 0xF0, // 3
-		0x90, 0x90, 0xF0, 0x10, 0x10, // 4
-		0xF0, 0x80, 0xF0, 0x10, 0xF0, // 5
-		0xF0, 0x80, 0xF0, 0x90, 0xF0, // 6
-		0xF0, 0x10, 0x20, 0x40, 0x40, // 7
-		0xF0, 0x90, 0xF0, 0x90, 0xF0, // 8
-		0xF0, 0x90, 0xF0, 0x10, 0xF0, // 9
-		0xF0, 0x90, 0xF0, 0x90, 0x90, // A
-		0xE0, 0x90, 0xE0, 0x90, 0xE0, // B
-		0xF0, 0x80, 0x80, 0x80, 0xF0, // C
-		0xE0, 0x90, 0x90, 0x90, 0xE0, // D
-		0xF0, 0x80, 0xF0, 0x80, 0xF0, // E
-		0xF0, 0x80, 0xF0, 0x80, 0x80  // F
-	};
+// CHIP-8 CORE
+#include "core.h"
+#include "headless.h"
+#include "batch.h"
+#include "lockstep.h"
+#include "check.h"
+#include "fuzz.h"
+#include "snapshot.h"
+#include "input.h"
+#include "trace.h"
+#include "profile.h"
+#include "audio.h"
+#include "pacer.h"
+#include "capture.h"
+#include "scale.h"
 
 // config
 	struct color {
@@ -75,65 +35,104 @@
 	struct color fg_color;
 	struct color bg_color;
 	
-	uint8_t    SCALE;
-	bool   	   debug;
+	uint8_t     SCALE;
+	bool   	    debug;
+	bool        tracing;	// debug set to 'trace' - every instruction goes to TRACE_FILE
+	bool        profiling;	// debug set to 'profile' - counts go to PROFILE_REPORT and PROFILE_FOLDED on exit
+	enum engine engine = ENGINE_BLOCKS;
+	uint32_t    instructions_per_frame = INSTRUCTIONS_PER_FRAME;
+	bool        vsync;		// let the display's refresh hold each present, instead of sleeping until the next frame
+	bool        quirked;	// run the rom with quirks, instead of its mode's
+	enum quirks quirks;
+	char*       recording;	// a .y4m or .gif every frame goes to, NULL for none
+	enum filter filter = FILTER_NEAREST;	// scales the screen up on the cpu before SDL stretches it to the window
+
+// where tracing writes - read it with chip-8-trace
+#define TRACE_FILE "chip-8.trace"
+
+// where profiling writes - a sorted text report, and call stacks for flamegraph.pl
+#define PROFILE_REPORT "chip-8.profile"
+#define PROFILE_FOLDED "chip-8.folded"
+
+// samples the sound card asks for at a time - 256 is 5.3 ms at AUDIO_RATE, though a sound card
+// can insist on more
+#define AUDIO_DEVICE_SAMPLES 256
+
+// room for sound that's been made and not played - a sound card would have to ask for most of
+// this at once before it could all fill up
+#define AUDIO_PENDING_SIZE (8 * AUDIO_FRAME)
 
 // emulator state
 // TODO: make into an enum and handle pausing
 	bool running = false;
 
+// the chip-8 being played
+	struct chip8_machine* machine = NULL;
+
+// keypad layout - which keyboard key is each chip-8 key
+//   1 2 3 C        1 2 3 4
+//   4 5 6 D   <-   Q W E R
+//   7 8 9 E        A S D F
+//   A 0 B F        Z X C V
+	const SDL_Scancode key_layout[16] = {
+		SDL_SCANCODE_X, SDL_SCANCODE_1, SDL_SCANCODE_2, SDL_SCANCODE_3,
+		SDL_SCANCODE_Q, SDL_SCANCODE_W, SDL_SCANCODE_E, SDL_SCANCODE_A,
+		SDL_SCANCODE_S, SDL_SCANCODE_D, SDL_SCANCODE_Z, SDL_SCANCODE_C,
+		SDL_SCANCODE_4, SDL_SCANCODE_R, SDL_SCANCODE_F, SDL_SCANCODE_V
+	};
+
+// the same layout turned around for lookups - 0xFF for keys that aren't on the keypad
+	uint8_t scancode_keys[SDL_SCANCODE_COUNT];
+
+// keypad changes on their way to the machine
+	struct input_queue input;
+
+// history for rewinding - one frame per timer tick, stepped back through while backspace is held
+// 4 mb is many minutes for most roms, the frame limit is 10 minutes
+	struct rewind* history   = NULL;
+	bool           rewinding = false;
+
 // sdl tools
 	SDL_Window*   window   = NULL;
 	SDL_Renderer* renderer = NULL;
+	SDL_Texture*  texture  = NULL;	// 128x64 times the filter's factor - SDL scales the part in use up to the window
+	
+	SDL_AudioStream* audio = NULL;	// NULL if there's no sound card - the buzzer still keeps time
+	struct buzzer    buzzer;
+	
+// sound made but not handed to the sound card yet - it takes it one ask at a time, so the stream
+// never holds more than the few ms it's about to play. more than two asks waiting when a frame's
+// goes in means the host clock is running ahead of the sound card's, and the backlog is dropped
+// rather than heard late
+	int16_t audio_pending[AUDIO_PENDING_SIZE];
+	int     audio_pending_count = 0;
+	int     audio_ask           = AUDIO_DEVICE_SAMPLES;
 
-// array for display
-	bool screen[32][64];	// each pixel's value
-	
-// array for keypad inputs
-	bool keypad[16];		// whether this key is pressed now
-
-// memory - 4kb
-	uint8_t mem[4096];
-	
-// size of the rom
-	long size = 0;
-	
-// current instruction
-	uint16_t instr 	= 0;
-	uint8_t  first 	= 0;  
-	uint8_t  second = 0;
-	uint8_t  third  = 0;
-	uint8_t  fourth = 0;
-	uint8_t  last_2 = 0;
-	uint16_t last_3 = 0;
-
-// 16 bit registers - program index, memory index
-	uint16_t pc = 0x200;
-	uint16_t i  = 0x0;
-	
-// general purpose 8-bit registers
-	uint8_t v[16] = {0};
+// when each frame is due, and how the ones that reached the screen were spaced
+	struct pacer pacer;
 
-// stack - holds 12 addresses
-	uint16_t stack[12]  = {0};
-	short    stack_addr = -1;
+// the video being recorded - encoded on its own thread, and frames are dropped rather than
+// holding up the rom if it falls behind
+	struct capture* capture = NULL;
 
-// 8 bit timers - delay, sound
-	uint8_t delay = 0;
-	uint8_t sound = 0;
+// texel colors for the texture, packed as 0xAARRGGBB - one for each pair of plane bits, so
+// background, the first plane, the second plane, and both
+	uint32_t palette[4];
 
 // HOUSEKEEPING FUNCTIONS
 // sets all of the default config values using args passed when executable is run
 void set_config(int argc, char** argv) {
-	// argv -> ['chip-8.exe', rom name, debug, scale, foreground color, background color]
-	if (argc > 2 && argc != 6) {
-		SDL_Log("usage:   ./chip-8.exe  [rom location]    [debug] [scale factor] [foreground color] [background color]");
-		SDL_Log("default: ./chip-8.exe roms/ibm_logo.ch8   false        10            FFFFFFFF           000000FF");
-		SDL_Log("takes:   ./chip-8.exe     string          bool      integer       32-bit integer     32-bit integer");
+	// argv -> ['chip-8.exe', rom name, debug, scale, foreground color, background color, (optional) engine, (optional) instructions per frame, (optional) 'vsync', quirks, filter and/or a .y4m or .gif file]
+	if (argc > 2 && (argc < 6 || argc > 12)) {
+		SDL_Log("usage:   ./chip-8.exe  [rom location]    [debug] [scale factor] [foreground color] [background color] [engine]                       [instructions per frame] [vsync] [quirks]              [filter]                              [record]");
+		SDL_Log("default: ./chip-8.exe roms/ibm_logo.ch8   false        10            FFFFFFFF           000000FF        blocks                         12                       -       the mode's            nearest                               -");
+		SDL_Log("takes:   ./chip-8.exe     string    bool/trace/profile integer       32-bit integer     32-bit integer  interpreter/decoded/blocks/jit  integer                  vsync   chip-8/schip/xo-chip  nearest/scale2x/scale3x/scale4x/hq2x  .y4m/.gif file");
 		SDL_Log("color format: 0x[red][green][blue][alpha]\n	> each value is 1 byte\n	> as alpha increases, so does the opacity");
-	} else if (argc == 6){
+	} else if (argc >= 6){
 		SCALE	 = (uint8_t) strtol(argv[3], NULL, 10);			// parse an integer scale value
 		debug	 = strcmp("true", argv[2]) == 0 ? true : false;	// if 'true' is written in args, set debug flag to true
+		tracing  = strcmp("trace", argv[2]) == 0;				// 'trace' records every instruction instead of logging
+		profiling = strcmp("profile", argv[2]) == 0;			// 'profile' counts where the rom spends its time
 		
 		// parse a long long int from the foreground, background colors' args
 		uint32_t pre_fg = strtoll(argv[4], NULL, 16);
@@ -142,6 +141,35 @@ void set_config(int argc, char** argv) {
 		// bit masking for each of r, g, b, a values for fg and bg colors
 		fg_color = (struct color) {(pre_fg & 0xFF000000) >> 24, (pre_fg & 0x00FF0000) >> 16, (pre_fg & 0x0000FF00) >> 8, pre_fg & 0x000000FF};
 		bg_color = (struct color) {(pre_bg & 0xFF000000) >> 24, (pre_bg & 0x00FF0000) >> 16, (pre_bg & 0x0000FF00) >> 8, pre_bg & 0x000000FF};
+		
+		// pick the execution engine - keep the default if the name is unknown
+		if (argc >= 7 && !parse_engine(argv[6], &engine)) {
+			SDL_Log("unknown engine %s, using %s", argv[6], engine_name(engine));
+		}
+		
+		// how fast the chip-8 runs - the timers always tick at 60 hz no matter what this is
+		if (argc >= 8) {
+			instructions_per_frame = (uint32_t) strtoul(argv[7], NULL, 10);
+			
+			if (instructions_per_frame == 0) {
+				SDL_Log("instructions per frame must be at least 1, using %d", INSTRUCTIONS_PER_FRAME);
+				instructions_per_frame = INSTRUCTIONS_PER_FRAME;
+			}
+		}
+		
+		// last, in any order - 'vsync', a profile's name to run the rom with its quirks, a filter to
+		// scale the screen with, and a file to record to
+		for (int a = 8; a < argc; a++) {
+			if (strcmp("vsync", argv[a]) == 0) {
+				vsync = true;
+			} else if (parse_quirks(argv[a], &quirks)) {
+				quirked = true;
+			} else if (is_capture_file(argv[a])) {
+				recording = argv[a];
+			} else if (!parse_filter(argv[a], &filter)) {
+				SDL_Log("unknown option %s", argv[a]);
+			}
+		}
 	} else {	// default values
 		SCALE = 10;
 		debug = false;
@@ -151,224 +179,60 @@ void set_config(int argc, char** argv) {
 	}
 }
 
-// copies fontset to memory
-void copy_fonts() {
-	// 80 is the size of the fontset
-	for (int a = 0; a < 80; a++) {
-		mem[a] = chip8_fontset[a];
-	}
-}
-
-// opens the rom to play
-// if no rom is specified, just open roms/ibm_logo.ch8
-bool open_file(char* name) {
-	// open the file
-	FILE* rom = NULL;
-	
-	if (name == NULL) {
-		printf("no file name given! opening roms/ibm_logo.ch8\n\n");
-		rom = fopen("roms/ibm_logo.ch8", "rb");
-	} else {
-		printf("opening %s\n", name);
-		rom = fopen(name, "rb");
-	}
-	
-	if (!rom) {
-		SDL_Log("failed to open file: %s", name);
-		return false;
-	}
-	
-	// get file size
-	fseek(rom, 0, SEEK_END);
-	size = ftell(rom);
-	const long size_max = sizeof(mem) - pc; // get the maximum possible file size for this emulator
-	rewind(rom);
-	
-	// make sure file is of correct size
-	if (size <= 0) {
-		SDL_Log("file too small/invalid");
-		return false;
-	}
-	if (size > size_max) {
-		SDL_Log("file too big");
-		return false;
-	}
-	
-	// read file to memory starting at pc
-	if (fread(&mem[pc], 1, size, rom) != (size_t)size) {
-		SDL_Log("failed to read file to emulator memory");
-		fclose(rom);
-		return false;
-	}
-	
-	fclose(rom);
-	
-	return true;
-}
-
-// decrements both timers
-void decrement_timers() {
-	delay -= delay > 0 ? 1 : 0;
-	sound -= sound > 0 ? 1 : 0;
-}
-
 // clean up all of the sdl tools and arrays that have been made
 void end() {
+	SDL_DestroyTexture(texture);
 	SDL_DestroyWindow(window);
 	SDL_DestroyRenderer(renderer);
+	SDL_DestroyAudioStream(audio);
 	
 	window = NULL;
 	renderer = NULL;
+	texture = NULL;
+	audio = NULL;
 	
 	SDL_QuitSubSystem(SDL_INIT_AUDIO | SDL_INIT_VIDEO);
 	
 	SDL_Quit();
+	
+	if (debug) {
+		SDL_Log("idle loops skipped: %llu", (unsigned long long) machine->idle_skips);
+		SDL_Log("frame times: p50 %.1f ms, p90 %.1f ms, p99 %.1f ms, longest %.1f ms",
+		        pacer_percentile(&pacer, 0.50) / 1e6, pacer_percentile(&pacer, 0.90) / 1e6,
+		        pacer_percentile(&pacer, 0.99) / 1e6, pacer.longest / 1e6);
+		SDL_Log("presents: %llu, frames dropped: %llu, duplicated: %llu, resyncs: %llu",
+		        (unsigned long long) pacer.presents, (unsigned long long) pacer.dropped,
+		        (unsigned long long) pacer.duplicated, (unsigned long long) pacer.resyncs);
+	}
+	
+	trace_close(machine->trace);
+	capture_close(capture);
+	capture = NULL;
+	
+	if (machine->profile) {
+		profile_write(machine->profile, machine, PROFILE_REPORT, PROFILE_FOLDED);
+		profile_destroy(machine->profile);
+	}
+	
+	machine_destroy(machine);
+	machine = NULL;
+	
+	rewind_destroy(history);
+	history = NULL;
 }
 
-// DECODE STAGE - disassembler
-// turns the binary code to human-readable assembly
-void print_instruction() {	
-	switch (first){
-		case 0x0:
-			switch (last_2) {
-				case 0xE0:
-					SDL_Log("CLS");
-					break;
-				case 0xEE:
-					SDL_Log("RET");
-					break;
-				default:
-					SDL_Log("undefined - 0");
-			}
-			break;
-		case 0x1:
-			SDL_Log("JP %x", last_3);
-			break;
-		case 0x2:
-			SDL_Log("CALL 0x%x", last_3);
-			break;
-		case 0x3:
-			SDL_Log("SE v%x, 0x%x", second, last_2);
-			break;
-		case 0x4:
-			SDL_Log("SNE v%x, 0x%x", second, last_2);
-			break;
-		case 0x5:
-			switch (fourth) {
-				case 0x0:
-					SDL_Log("SE v%x, v%x", second, third);
-					break;
-				default:
-					SDL_Log("undefined - 5");
-			}
-			break;
-		case 0x6:
-			SDL_Log("LD v%x, 0x%x", second, last_2);
-			break;
-		case 0x7:
-			SDL_Log("ADD v%x, 0x%x", second, last_2);
-			break;
-		case 0x8:
-			switch (fourth) {
-				case 0x0:
-					SDL_Log("LD v%x, v%x", second, third);
-					break;
-				case 0x1:
-					SDL_Log("OR v%x, v%x", second, third);
-					break;
-				case 0x2:
-					SDL_Log("AND v%x, v%x", second, third);
-					break;
-				case 0x3:
-					SDL_Log("XOR v%x, v%x", second, third);
-					break;
-				case 0x4:
-					SDL_Log("ADD v%x, v%x", second, third);
-					break;
-				case 0x5:
-					SDL_Log("SUB v%x, v%x", second, third);
-					break;				
-				case 0x6:
-					SDL_Log("SHR v%x, v%x", second, third);
-					break;
-				case 0x7:
-					SDL_Log("SUBN v%x, v%x", second, third);
-					break;
-				case 0xE:
-					SDL_Log("SHL v%x, v%x", second, third);
-					break;
-				default:
-					SDL_Log("undefined - 8");
-			}
-			break;
-		case 0x9:
-			SDL_Log("SNE v%x, v%x", second, third);
-			break;
-		case 0xA:
-			SDL_Log("LD instr, 0x%x", last_3);
-			break;
-		case 0xB:
-			SDL_Log("JP v0, 0x%x", last_3);
-			break;
-		case 0xC:
-			SDL_Log("RND v%x, 0x%x", second, last_2);
-			break;
-		case 0xD:
-			SDL_Log("DRW v%x, v%x, 0x%x", second, third, fourth);
-			break;
-		case 0xE:
-			switch (last_2) {
-				case 0x9E:
-					SDL_Log("SKP v%x", second);
-					break;
-				case 0xA1:
-					SDL_Log("SKNP v%x", second);
-					break;
-				default:
-					SDL_Log("undefined - e");
-			}
-			break;
-		case 0xF:
-			switch (last_2) {
-				case 0x07:
-					SDL_Log("LD v%x, DT", second);
-					break;
-				case 0x0A:
-					SDL_Log("LD v%x, K", second);
-					break;
-				case 0x15:
-					SDL_Log("LD DT, v%x", second);
-					break;					
-				case 0x18:
-					SDL_Log("LD ST, v%x", second);
-					break;
-				case 0x1E:
-					SDL_Log("ADD instr, v%x", second);
-					break;
-				case 0x29:
-					SDL_Log("LD F, v%x", second);
-					break;
-				case 0x33:
-					SDL_Log("LD B, v%x", second);
-					break;
-				case 0x55:
-					SDL_Log("LD [instr], v%x", second);
-					break;
-				case 0x65:
-					SDL_Log("LD v%x, [instr]", second);
-					break;
-				default:
-					SDL_Log("undefined - f");
-			}
-			break;
-		default:
-			SDL_Log("undefined");
+// INPUT HANDLING
+// fills in scancode_keys from key_layout
+void build_key_map() {
+	memset(scancode_keys, 0xFF, sizeof(scancode_keys));
+	
+	for (uint8_t k = 0; k < 16; k++) {
+		scancode_keys[key_layout[k]] = k;
 	}
 }
 
-// INPUT HANDLING
 // handle all input to the emulator
-// TODO: more elegant way of setting key values (although not really necessary; this is probably the fastest implementation)
+// keypad changes are queued with the time they happened, the machine picks them up when it runs
 bool handle_input() {
 	SDL_Event event;
 	SDL_zero(event);
@@ -378,49 +242,27 @@ bool handle_input() {
 			case SDL_EVENT_QUIT:		// if we want to quit the program, return false
 				return false;
 			
-			case SDL_EVENT_KEY_DOWN:	// if a key is pressed, set its corresponding bool to true
-				switch(event.key.scancode){
-					case 30:	keypad[0x1] = true; break;
-					case 31:	keypad[0x2] = true; break;
-					case 32:	keypad[0x3] = true; break;
-					case 33:	keypad[0xC] = true; break;
-					case 20:	keypad[0x4] = true; break;
-					case 26:	keypad[0x5] = true; break;
-					case  8:	keypad[0x6] = true; break;
-					case 21:	keypad[0xD] = true; break;
-					case  4:	keypad[0x7] = true; break;
-					case 22:	keypad[0x8] = true; break;
-					case  7:	keypad[0x9] = true; break;
-					case  9:	keypad[0xE] = true; break;
-					case 29:	keypad[0xA] = true; break;
-					case 27:	keypad[0x0] = true; break;
-					case  6:	keypad[0xB] = true; break;
-					case 25:	keypad[0xF] = true; break;
-					default:	break;
+			case SDL_EVENT_KEY_DOWN:	// if a key is pressed or released, queue it for the keypad
+			case SDL_EVENT_KEY_UP: {
+				bool down = event.type == SDL_EVENT_KEY_DOWN;
+				
+				// held keys repeat, but the keypad only cares about changes
+				if (event.key.repeat) {
+					break;
 				}
-				break;
-			
-			case SDL_EVENT_KEY_UP:		// if a key is released, set its corresponding bool to false
-				switch(event.key.scancode){
-					case 30:	keypad[0x1] = false; break;
-					case 31:	keypad[0x2] = false; break;
-					case 32:	keypad[0x3] = false; break;
-					case 33:	keypad[0xC] = false; break;
-					case 20:	keypad[0x4] = false; break;
-					case 26:	keypad[0x5] = false; break;
-					case  8:	keypad[0x6] = false; break;
-					case 21:	keypad[0xD] = false; break;
-					case  4:	keypad[0x7] = false; break;
-					case 22:	keypad[0x8] = false; break;
-					case  7:	keypad[0x9] = false; break;
-					case  9:	keypad[0xE] = false; break;
-					case 29:	keypad[0xA] = false; break;
-					case 27:	keypad[0x0] = false; break;
-					case  6:	keypad[0xB] = false; break;
-					case 25:	keypad[0xF] = false; break;
-					default:	break;
+				
+				if (event.key.scancode == SDL_SCANCODE_BACKSPACE) {
+					rewinding = down;
+					break;
+				}
+				
+				uint8_t key = scancode_keys[event.key.scancode];
+				
+				if (key != 0xFF && !input_push(&input, (struct key_event) {event.key.timestamp, key, down})) {
+					SDL_Log("input queue full, dropped a key");
 				}
 				break;
+			}
 			
 			default: break;
 		}
@@ -430,358 +272,338 @@ bool handle_input() {
 	return true;
 }
 
-// HELPER FUNCTIONS FOR EXECUTION
-// slay all.
-void clear_screen() {
-	// set all values in screen[][] to false
-	for (int r = 0; r < 32; r++) {
-		for (int c = 0; c < 64; c++) {
-			screen[r][c] = false;
-		}
-	}
+// a color a share of the way from one to another, out of 3
+static uint32_t blend(struct color from, struct color to, int share) {
+	uint8_t a = from.alpha + (to.alpha - from.alpha) * share / 3;
+	uint8_t r = from.red   + (to.red   - from.red)   * share / 3;
+	uint8_t g = from.green + (to.green - from.green) * share / 3;
+	uint8_t b = from.blue  + (to.blue  - from.blue)  * share / 3;
+	
+	return (uint32_t) a << 24 | (uint32_t) r << 16 | (uint32_t) g << 8 | b;
 }
 
-// reads num_rows bytes from memory, starting at address i
-// display these rows XOR'd with what's on screen now starting at (start_x, start_y)
-// set v[0xF] to 1 if this erases any pixels on screen, else 0
-// TODO: rewrite only the area affected by the sprite (do in update_draw_buffer())
-void draw_instr(uint8_t x_coord, uint8_t y_coord, uint8_t num_rows) {	
-	// zero out the flags register
-	v[0xF] = 0;
-	
-	// iterate through rows
-	for (int r = 0; r < num_rows; r++) {
-		if (y_coord + r < 32) {	// logic to check we're not drawing out of bounds vertically
-			// for some reason bytes are stored in reverse bit order, so reverse the bits
-			uint8_t curr_row = reverse_table[mem[i + r]];
-			// iterate through columns
-			for (int c = 0; c < 8; c++) {
-				if (x_coord + c < 64) {	// logic to check we're not drawing out of bounds horizontally
-					bool screen_pixel = screen[y_coord + r] [x_coord + c];
-					bool row_pixel	  = (curr_row & (1 << c)) > 0 ? true : false;
-					
-					// update pixel erasure flag
-					v[0xF] = (screen_pixel && row_pixel) ? 1 : v[0xF];
-					
-					// xor the current pixel onto the screen
-					screen[(y_coord + r)] [(x_coord + c)] = screen_pixel ^ row_pixel;
-				}
-			}
-		}
+// turns row r of both planes into texels, as wide as the current resolution
+static void row_to_texels(int r, uint32_t* texels) {
+	int width = screen_width(machine);
+	
+	for (int c = 0; c < width; c++) {
+		int word  = c >> 6;
+		int shift = 63 - (c & 63);
+		int color = (machine->screen[0][r][word] >> shift & 1) | (machine->screen[1][r][word] >> shift & 1) << 1;
+		
+		texels[c] = palette[color];
 	}
 }
 
-// turns the bool array in screen[][] to rectangles to be rendered in the window
+// uploads the rows that changed since the last call to the texture, then renders the part of the
+// texture the current resolution uses to the window. a filter redoes the whole screen when any of
+// it changed, since a row's pixels depend on the rows beside it
 void update_draw_buffer() {
-	// make a rectangle at every pixel in screen[][] (set color as needed) then send it to the renderer
-	for (int r = 0; r < 32; r++) {
-		for (int c = 0; c < 64; c++) {
-			if (screen[r][c]) {
-				// set draw color to foreground color
-				SDL_SetRenderDrawColor(renderer, fg_color.red, fg_color.green, fg_color.blue, fg_color.alpha);
-			} else {
-				// set draw color to background color
-				SDL_SetRenderDrawColor(renderer, bg_color.red, bg_color.green, bg_color.blue, bg_color.alpha);	
-			}
-			
-			SDL_FRect pixel = {.x = c * SCALE, .y = r * SCALE, .w = SCALE, .h = SCALE};
-			SDL_RenderFillRect(renderer, &pixel);
+	static uint32_t texels[SCREEN_HEIGHT][SCREEN_WIDTH];
+	int height = screen_height(machine);
+	int factor = filter_factor(filter);
+	
+	if (filter != FILTER_NEAREST && machine->dirty_rows != 0) {
+		void* pixels;
+		int   pitch;
+		
+		if (SDL_LockTexture(texture, NULL, &pixels, &pitch)) {
+			scale_screen(filter, machine, palette, pixels, pitch);
+			SDL_UnlockTexture(texture);
+		}
+		
+		machine->dirty_rows = 0;
+	}
+	
+	// only touch the texture if something changed
+	int r = 0;
+	while (machine->dirty_rows != 0 && r < height) {
+		// skip rows that are already up to date
+		if (!(machine->dirty_rows & (1ULL << r))) {
+			r++;
+			continue;
+		}
+		
+		// find the end of this run of changed rows, so each run is one upload
+		int start = r;
+		while (r < height && (machine->dirty_rows & (1ULL << r))) {
+			row_to_texels(r, texels[r]);
+			r++;
 		}
+		
+		SDL_Rect rows = {.x = 0, .y = start, .w = screen_width(machine), .h = r - start};
+		SDL_UpdateTexture(texture, &rows, texels[start], sizeof(texels[0]));
 	}
+	
+	machine->dirty_rows = 0;
+	
+	SDL_FRect used = {0, 0, (float) (screen_width(machine) * factor), (float) (height * factor)};
+	SDL_RenderTexture(renderer, texture, &used, NULL);
 }
 
-void wait_for_key() {
-	// this is the key we'll put inside the given register.
-	uint8_t key = 0xFF;
-	
-	// loop through the keypad, and save the first key to be pressed
-	for (int a = 0; a < 0x10; a++) {
-		if (keypad[a]) {
-			key = a;
-		}
+// draws the screen and shows it - timed when profiling
+void present() {
+	struct profile* p = machine->profile;
+	
+	if (!p) {
+		update_draw_buffer();
+		SDL_RenderPresent(renderer);
+		return;
 	}
 	
-	// while that key is pressed down, decrement timers and handle input
-	while (keypad[key]) {
-		SDL_Delay(16.67f);
-		decrement_timers();
-		handle_input();
+	uint64_t start = SDL_GetTicksNS();
+	update_draw_buffer();
+	
+	uint64_t uploaded = SDL_GetTicksNS();
+	SDL_RenderPresent(renderer);
+	
+	profile_time(p, PROFILE_UPLOAD, uploaded - start);
+	profile_time(p, PROFILE_PRESENT, SDL_GetTicksNS() - uploaded);
+}
+
+// queues the sound for the frame that just ran
+void play_sound() {
+	const int16_t* samples = buzzer_frame(&buzzer, machine);
+	
+	if (!audio) {
+		return;
 	}
 	
-	// loop this instruction while we have not pressed a key yet
-	if (key == 0xFF) {
-		pc -= 2;
-	} else {
-		v[second] = key;
-	} 
+	// the sound card's thread takes from the same buffer, with the stream locked
+	SDL_LockAudioStream(audio);
+	
+	if (audio_pending_count > 2 * audio_ask || audio_pending_count + AUDIO_FRAME > AUDIO_PENDING_SIZE) {
+		audio_pending_count = 0;
+	}
+	
+	memcpy(&audio_pending[audio_pending_count], samples, AUDIO_FRAME * sizeof(int16_t));
+	audio_pending_count += AUDIO_FRAME;
+	
+	SDL_UnlockAudioStream(audio);
 }
 
-// EXECUTE STAGE
-// executes an instruction
-void execute_instruction() {
-	switch (first){
-		case 0x0:
-			switch (last_2) {
-				case 0xE0:	// clear screen
-					clear_screen();
-					break;
-				case 0xEE:	// return
-					if (stack_addr > -1) {
-						pc = stack[stack_addr];
-						stack[stack_addr] = 0;
-						stack_addr--;
-					} else {
-						SDL_Log("stack underflow error");
-					}
-					break;
-				default:
-					SDL_Log("undefined - 0");
-			}
-			break;
-		case 0x1:	// jump
-			pc = last_3;
-			break;
-		case 0x2:	// call
-			if (stack_addr < 11) {
-				stack_addr++;
-				stack[stack_addr] = pc;
-				pc = last_3;
-			} else {
-				SDL_Log("stack overflow error");
-			}
-			break;
-		case 0x3:	// skip-equals immediate
-			if (v[second] == last_2) {
-				pc += 2;
-			}
-			break;
-		case 0x4:	// skip-not-equals immediate
-			if (v[second] != last_2) {
-				pc += 2;
-			}
-			break;
-		case 0x5:	// skip-equals register
-			switch (fourth) {
-				case 0x0:
-					pc += (v[second] == v[third]) ? 2 : 0;
-					break;
-				default:
-					SDL_Log("undefined - 5");
-			}
-			break;
-		case 0x6:	// load immediate
-			v[second] = last_2;
-			break;
-		case 0x7:	// add
-			v[second] = v[second] + last_2;
-			break;
-		case 0x8:	// register-register ops
-			switch (fourth) {
-				case 0x0:	// load register
-					v[second] = v[third];
-					break;
-				case 0x1:	// or
-					v[second] |= v[third];
-					v[0xF] = 0;
-					break;
-				case 0x2:	// and
-					v[second] &= v[third];
-					v[0xF] = 0;
-					break;
-				case 0x3:	// xor
-					v[second] ^= v[third];
-					v[0xF] = 0;
-					break;
-				case 0x4:	// add with carry flag in vF
-					uint16_t sum = v[second] + v[third];
-					v[second] = (uint8_t) sum;
-					v[0xF] = (sum > 0xFF) ? 1 : 0;
-					break;
-				case 0x5:	// subtract with !(borrow) flag in vF
-					bool borrow_5 = v[second] < v[third];
-					v[second] -= v[third];
-					v[0xF] = !borrow_5 ? 1 : 0;
-					break;				
-				case 0x6:	// shift right with half flag in vF
-					bool half_6 = ((v[third] & 0x01) == 1);
-					v[second] = v[third] >> 1;
-					v[0xF] = half_6 ? 1 : 0;
-					break;
-				case 0x7:	// negated subtraction with !(borrow) flag in vF
-					bool borrow_7 = v[third] < v[second];
-					v[second] = v[third] - v[second];
-					v[0xF] = !borrow_7 ? 1 : 0;
-					break;
-				case 0xE:	// shift left with overflow flag in vF
-					bool overflow_e = ((v[third] & 0x80) == 0x80);
-					v[second] = v[third] << 1;
-					v[0xF] = overflow_e ? 1 : 0;
-					break;
-				default:
-					SDL_Log("undefined - 8");
-			}
-			break;
-		case 0x9:	// skip-not-equals register
-			pc += (v[second] != v[third]) ? 2 : 0;
-			break;
-		case 0xA:	// load to index
-			i = last_3;
-			break;
-		case 0xB:	// jump to v0 + last 3 digits of instruction
-			pc = v[0] + last_3;
-			break;
-		case 0xC:	// vx and random byte
-			v[second] = (uint8_t) (rand() % 256) & last_2;
-			break;
-		case 0xD:	// draw instruction
-			draw_instr(v[second] % 64, v[third] % 32, fourth);
-			break;
-		case 0xE:	// key press instructions
-		// if v[second] is in [0x0, 0xF] and handle_input()'s return matches the key corresponding to v[second]'s value
-		// do to pc what must be done
-			switch (last_2) {
-				case 0x9E:	// skip next if key pressed
-					pc += keypad[v[second]] ? 2 : 0;
-					break;
-				case 0xA1:	// skip next if key isn't pressed
-					pc += keypad[v[second]] ? 0 : 2;
-					break;
-				default:
-					SDL_Log("undefined - e");
-			}
-			break;
-		case 0xF:
-			switch (last_2) {
-				case 0x07:	// load delay register
-					v[second] = delay;
-					break;
-				case 0x0A:	// wait until key press, then store key in v[second]
-					wait_for_key();	
-					break;
-				case 0x15:	// set delay timer to v[second]
-					delay = v[second];
-					break;					
-				case 0x18:	// set sound timer to v[second]
-					sound = v[second];
-					break;
-				case 0x1E:	// add v[second] to memory index
-					i += v[second];
-					v[0xF] = i > 0xFFF ? 1 : 0;
-					break;
-				case 0x29:	// set index to point to character in fonts corresponding to bottom nibble of v[second]
-					//	(bottom nibble)		(number of bytes per character in fontset)
-					i = (v[second] & 0x0F) * 5;
-					break;
-				case 0x33:	// convert v[second] to decimal, then store each digit in successive memory indices
-					mem[i] 	   = v[second] / 100 % 10;
-					mem[i + 1] = v[second] / 10  % 10;
-					mem[i + 2] = v[second] /*/1*/% 10;
-					break;
-				case 0x55:	// store registers to memory, then increment mem index accordingly
-					for (int a = 0; a <= second; a++) {
-						mem[i + a] = v[a];
-					}
-					i += second + 1;					
-					break;
-				case 0x65:	// pull memory to registers, then increment mem index accordingly
-					for (int a = 0; a <= second; a++) {
-						v[a] = mem[i + a];
-					}
-					i += second + 1;
-					break;
-				default:
-					SDL_Log("undefined - f");
-			}
-			break;
-		default:
-			SDL_Log("undefined");
+// called on the sound card's thread when it wants more - it gets only what it asked for, and only
+// once that much is waiting. coming up short leaves that ask silent, and what's pending then has
+// a whole ask in hand the next time, so after a late frame it stays one ask ahead. an ask bigger
+// than the buffer could ever hold gets what there is
+static void SDLCALL feed_audio(void* userdata, SDL_AudioStream* stream, int additional_amount, int total_amount) {
+	(void) userdata;
+	(void) total_amount;
+	
+	int wanted = additional_amount / (int) sizeof(int16_t);
+	
+	if (wanted <= 0) {
+		return;
 	}
+	
+	audio_ask = wanted;
+	
+	if (2 * wanted + AUDIO_FRAME > AUDIO_PENDING_SIZE) {
+		wanted = audio_pending_count;
+	}
+	if (wanted > audio_pending_count) {
+		return;
+	}
+	
+	SDL_PutAudioStreamData(stream, audio_pending, wanted * (int) sizeof(int16_t));
+	
+	audio_pending_count -= wanted;
+	memmove(audio_pending, &audio_pending[wanted], audio_pending_count * sizeof(int16_t));
 }
 
 // emulation goes HERE!
 int main(int argc, char** argv) {
+	// headless benchmark - runs without ever touching SDL
+	if (argc > 1 && strcmp("--bench", argv[1]) == 0) {
+		return run_headless(argc, argv);
+	}
+	
+	// batch runner - lots of roms at once, also without SDL
+	if (argc > 1 && strcmp("--batch", argv[1]) == 0) {
+		return run_batch(argc, argv);
+	}
+	
+	// one rom, many seeds, in lockstep
+	if (argc > 1 && strcmp("--lockstep", argv[1]) == 0) {
+		return run_lockstep(argc, argv);
+	}
+	
+	// the rom suite - screens against their hashes, speed against the last update
+	if (argc > 1 && strcmp("--check", argv[1]) == 0) {
+		return run_check(argc, argv);
+	}
+	
+	// coverage-guided fuzzing of one rom's inputs
+	if (argc > 1 && strcmp("--fuzz", argv[1]) == 0) {
+		return run_fuzz(argc, argv);
+	}
+	
 	// read the user config and use it
 	set_config(argc, argv);
+	build_key_map();
 	
-	// set seed for random number gen
-	srand(time(NULL));
-
-	// put fontset into memory
-	copy_fonts();
+	// make the machine, with the time as the seed for random number gen
+	// the fontset is put into its memory here too
+	machine = machine_create((uint32_t) time(NULL));
+	
+	if (!machine) {
+		return -1;
+	}
+	
+	machine->engine = engine;
+	
+	history = rewind_create(4 << 20, 60 * 60 * 10);
+	
+	if (!history) {
+		machine_destroy(machine);
+		return -1;
+	}
+	
+	// the trace is written on its own thread, so this barely changes how the rom runs
+	if (tracing) {
+		machine->trace = trace_open(TRACE_FILE);
+	}
+	
+	if (profiling) {
+		machine->profile = profile_create();
+	}
 	
 	// copy the rom file to memory
-	if (!open_file(argv[1])) {
+	if (!open_file(machine, argv[1])) {
+		machine_destroy(machine);
 		return -1;
 	}
 	
+	if (quirked) {
+		set_quirks(machine, quirks);
+	}
+	
 	// initialize necessary subsystems, create the window and renderer
 	if (!SDL_Init(SDL_INIT_AUDIO | SDL_INIT_VIDEO) || !SDL_CreateWindowAndRenderer("my chip-8 :D", 64 * SCALE, 32 * SCALE, 0, &window, &renderer)) {
 		SDL_Log("failed to initialize: %s\n", SDL_GetError());
 		return -1;
 	}
 	
+	// the whole display lives in one small texture - no blending, so alpha behaves like it does for a plain fill
+	int factor = filter_factor(filter);
+	texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, SCREEN_WIDTH * factor, SCREEN_HEIGHT * factor);
+	
+	if (!texture) {
+		SDL_Log("failed to create texture: %s\n", SDL_GetError());
+		return -1;
+	}
+	
+	// the buzzer gets its own stream - a rom with no sound plays silence, and no sound card means none at all
+	char device_samples[16];
+	snprintf(device_samples, sizeof(device_samples), "%d", AUDIO_DEVICE_SAMPLES);
+	SDL_SetHint(SDL_HINT_AUDIO_DEVICE_SAMPLE_FRAMES, device_samples);
+	
+	const SDL_AudioSpec spec = {SDL_AUDIO_S16, 1, AUDIO_RATE};
+	audio = SDL_OpenAudioDeviceStream(SDL_AUDIO_DEVICE_DEFAULT_PLAYBACK, &spec, feed_audio, NULL);
+	
+	if (audio) {
+		SDL_ResumeAudioStreamDevice(audio);
+	} else {
+		SDL_Log("no sound: %s", SDL_GetError());
+	}
+	
+	buzzer_init(&buzzer, machine);
+	
+	SDL_SetTextureScaleMode(texture, SDL_SCALEMODE_NEAREST);
+	SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_NONE);
+	
+	// only XO-CHIP ever draws on the second plane - it gets shades between the two colors
+	palette[0] = blend(bg_color, fg_color, 0);
+	palette[1] = blend(bg_color, fg_color, 3);
+	palette[2] = blend(bg_color, fg_color, 1);
+	palette[3] = blend(bg_color, fg_color, 2);
+	
+	// the video gets the window's colors
+	if (recording) {
+		capture = capture_open(recording, machine, palette, true);
+	}
+	
 	// if window and renderer and texture are created and file is valid, then the emulator can run
 	running = true;
 	
+	// vsync is asked for, but the sleeps take over if the display won't do it
+	if (vsync && !SDL_SetRenderVSync(renderer, 1)) {
+		SDL_Log("no vsync: %s", SDL_GetError());
+		vsync = false;
+	}
+	
 	// clear screen before beginning, then set draw flag to true
-	clear_screen();
-	update_draw_buffer();
-	SDL_RenderPresent(renderer);
+	clear_screen(machine);
+	present();
 	
-	// initialize values to help with screen updates
-	uint64_t time_a;
-	uint64_t time_diff;
-	uint64_t time_freq = SDL_GetPerformanceFrequency();
+	// one frame is 1/60 of a second of emulated time - each one runs its instructions and ticks
+	// the timers once. every frame that's due is run, then the screen is presented once, so a
+	// display slower than 60 hz skips frames and a faster one shows some twice, while the rom
+	// always runs at the same speed
+	const uint64_t frame_length = SDL_NS_PER_SECOND / 60;
 	
-	// used for timing timer decrements
-	uint16_t loop_count;
+	pacer_init(&pacer, SDL_GetTicksNS(), 60);
 	
 	// main emulation loop
 	while (running) {
-		//fetch
-		instr = mem[pc] << 8 | mem[pc + 1];
-
-		// increment pc and loop_count since we already have current instruction
-		pc += 2;
-		loop_count++;
+		// if the host is running late, the frames go back to back until it catches up
+		while (running && pacer_due(&pacer, SDL_GetTicksNS())) {
+			// handle the input and update running accordingly - once per frame
+			running = (handle_input());
 		
-		// execute!
-		// mask the digits we need in the opcode
-		first  = (instr & 0xF000) >> 12;
-		second = (instr & 0x0F00) >> 8;
-		third  = (instr & 0X00F0) >> 4;
-		fourth = (instr & 0X000F);
-		last_2 = (instr & 0x00FF);
-		last_3 = (instr & 0x0FFF);
+			// keys from the last frame's worth of host time go in at the matching instructions of this one
+			uint64_t frame_time  = pacer_frame_start(&pacer);
+			uint64_t input_start = frame_time > frame_length ? frame_time - frame_length : 0;
 		
-		// get elapsed time before executing an instruction
-		time_a = SDL_GetPerformanceCounter();
+			if (rewinding) {
+				// while rewinding, show one older frame per frame instead of running
+				rewind_step_back(history, machine);
+				
+				// the keypad should still match the keys that are down
+				input_apply_all(&input, machine);
+			} else {
+				run_frame_with_input(machine, &input, instructions_per_frame, input_start, frame_length);
+				rewind_push(history, machine);
+				play_sound();
+			}
+			
+			// every frame goes in the video, even ones the display skips
+			if (capture) {
+				capture_frame(capture, machine);
+			}
+			
+			pacer_frame_done(&pacer);
+		}
 		
-		// execute
-		execute_instruction();
+		// only the rows that changed get uploaded, so a still screen costs just the present
+		present();
+		pacer_presented(&pacer, SDL_GetTicksNS());
 		
-		// decrement timers on the correct loop
-		// this should be config-able
-		if (loop_count == 0x3333) {
-			loop_count = 0; 
-			decrement_timers();
+		// with vsync, the present already waited for the display
+		if (vsync) {
+			continue;
 		}
 		
-		// get time it took to execute the instruction
-		time_diff = (((double) SDL_GetPerformanceCounter() - (double) time_a) * 1000) / ((double) time_freq);		
+		// wait for the next frame
+		uint64_t next_frame = pacer_frame_start(&pacer);
+		uint64_t time_now   = SDL_GetTicksNS();
 		
-		// if it was a draw instruction i saw, then wait for the beginning of the next frame
-		// delay to get 60 hz refresh rate (my display is 48 hz though ):) 
-		// by delaying at most 1000 ms/sec * 1 sec/60 frames = 16.67 ms/frame
-		// TODO: fix timer decrementing
-		if (instr == 0x00E0 || first == 0xD) {
-			SDL_Delay(16.67f - time_diff);
-			update_draw_buffer();
-			SDL_RenderPresent(renderer);
+		// halted on Fx0A - sleep on the event queue instead of spinning. the frame it's waiting for
+		// still runs when it's due and not before, with every instruction it would have had, so a
+		// key only wakes the loop up and the rom runs the same as if it had been pressed mid-frame
+		while (running && !rewinding && is_halted(machine) && time_now + SDL_NS_PER_MS < next_frame) {
+			SDL_WaitEventTimeout(NULL, (int32_t) ((next_frame - time_now) / SDL_NS_PER_MS));
+			
+			// keys stay queued with their times - the next frame puts each in at its instruction
+			running  = (handle_input());
+			time_now = SDL_GetTicksNS();
 		}
 		
-		// handle the input and update running accordingly
-		running = (handle_input());
+		// SDL_DelayPrecise sleeps most of the way and spins the rest, so frames land within
+		// microseconds of when they're due instead of a scheduler tick late
+		if (running && time_now < next_frame) {
+			SDL_DelayPrecise(next_frame - time_now);
+		}
 	}
 	
 	// clean up
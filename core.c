@@ -0,0 +1,1761 @@
+// CHIP-8 CORE
+// everything needed to fetch, decode and execute instructions lives here.
+// nothing in this file touches SDL, so the core can run on machines without a display
+
+// C LIBRARIES
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "core.h"
+#include "block.h"
+#include "jit.h"
+#include "aot.h"
+#include "trace.h"
+#include "profile.h"
+#include "fuzz.h"
+
+// the functions quirks are passed to as constants have to be inlined for the constants to do
+// anything, so they're made to be wherever the compiler allows it
+#ifdef __GNUC__
+	#define ALWAYS_INLINE inline __attribute__((always_inline))
+#else
+	#define ALWAYS_INLINE inline
+#endif
+
+// fontset - goes into memory at the start
+	static const uint8_t chip8_fontset[80] =
+	{ 
+		0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
+		0x20, 0x60, 0x20, 0x20, 0x70, // 1
+		0xF0, 0x10, 0xF0, 0x80, 0xF0, // 2
+		0xF0, 0x10, 0xF0, 0x10, 0xF0, // 3
+		0x90, 0x90, 0xF0, 0x10, 0x10, // 4
+		0xF0, 0x80, 0xF0, 0x10, 0xF0, // 5
+		0xF0, 0x80, 0xF0, 0x90, 0xF0, // 6
+		0xF0, 0x10, 0x20, 0x40, 0x40, // 7
+		0xF0, 0x90, 0xF0, 0x90, 0xF0, // 8
+		0xF0, 0x90, 0xF0, 0x10, 0xF0, // 9
+		0xF0, 0x90, 0xF0, 0x90, 0x90, // A
+		0xE0, 0x90, 0xE0, 0x90, 0xE0, // B
+		0xF0, 0x80, 0x80, 0x80, 0xF0, // C
+		0xE0, 0x90, 0x90, 0x90, 0xE0, // D
+		0xF0, 0x80, 0xF0, 0x80, 0xF0, // E
+		0xF0, 0x80, 0xF0, 0x80, 0x80  // F
+	};
+
+// 8x10 digits for Fx30 - SUPER-CHIP only has 0-9, XO-CHIP adds A-F. goes in at BIG_FONT
+	static const uint8_t big_fontset[160] =
+	{
+		0xFF, 0xFF, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, // 0
+		0x18, 0x78, 0x78, 0x18, 0x18, 0x18, 0x18, 0x18, 0xFF, 0xFF, // 1
+		0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // 2
+		0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 3
+		0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0x03, 0x03, // 4
+		0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 5
+		0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 6
+		0xFF, 0xFF, 0x03, 0x03, 0x06, 0x0C, 0x18, 0x18, 0x18, 0x18, // 7
+		0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 8
+		0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 9
+		0x7E, 0xFF, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xC3, // A
+		0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, // B
+		0x3C, 0xFF, 0xC3, 0xC0, 0xC0, 0xC0, 0xC0, 0xC3, 0xFF, 0x3C, // C
+		0xFC, 0xFE, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFE, 0xFC, // D
+		0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // E
+		0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xC0, 0xC0  // F
+	};
+
+// MACHINES
+// makes a machine that is ready to have a rom loaded into it
+// the seed picks the random numbers Cxkk will see - 0 is turned into 1, since xorshift never leaves 0
+struct chip8_machine* machine_create(uint32_t seed) {
+	struct chip8_machine* m = calloc(1, sizeof(struct chip8_machine));
+	
+	if (!m) {
+		LOG("failed to allocate machine");
+		return NULL;
+	}
+	
+	m->pc         = 0x200;
+	m->stack_addr = -1;
+	m->held_key   = 0xFF;
+	m->rng        = seed ? seed : 1;
+	m->engine     = ENGINE_BLOCKS;
+	m->planes     = 1;
+	
+	copy_fonts(m);
+	invalidate(m, 0, CODE_SIZE);
+	
+	return m;
+}
+
+void machine_destroy(struct chip8_machine* m) {
+	if (!m) {
+		return;
+	}
+	
+	free_blocks(m);
+	free_jit(m);
+	free_aot(m);
+	free(m);
+}
+
+// HOUSEKEEPING FUNCTIONS
+// copies fontset to memory - and the big one, for the modes that have Fx30
+void copy_fonts(struct chip8_machine* m) {
+	// 80 is the size of the fontset
+	for (int a = 0; a < 80; a++) {
+		m->mem[a] = chip8_fontset[a];
+	}
+	
+	if (m->mode != MODE_CHIP8) {
+		memcpy(&m->mem[BIG_FONT], big_fontset, sizeof(big_fontset));
+	}
+}
+
+// switches the instruction set - call it before loading a rom, since it decides how big one can be
+// every instruction is decoded again, as the same opcode can mean something else now
+void set_mode(struct chip8_machine* m, enum mode mode) {
+	m->mode   = mode;
+	m->quirks = quirks_for_mode(mode);
+	
+	copy_fonts(m);
+	invalidate(m, 0, CODE_SIZE);
+}
+
+// the profile a mode gets unless the rom asks for another
+enum quirks quirks_for_mode(enum mode mode) {
+	static const enum quirks mode_quirks[MODE_COUNT] = {QUIRKS_CHIP8, QUIRKS_SCHIP, QUIRKS_XOCHIP};
+	
+	return mode_quirks[mode];
+}
+
+// runs the rom with another platform's quirks than its mode's - call it after loading the rom,
+// which picks the mode's. every instruction is decoded again for the profile's handlers
+void set_quirks(struct chip8_machine* m, enum quirks quirks) {
+	m->quirks = quirks;
+	
+	invalidate(m, 0, CODE_SIZE);
+}
+
+// the mode a rom file's extension asks for - .sc8 is SUPER-CHIP, .xo8 XO-CHIP, anything else CHIP-8
+enum mode mode_for_file(const char* name) {
+	const char* dot = name ? strrchr(name, '.') : NULL;
+	
+	if (dot && strcmp(dot, ".sc8") == 0) {
+		return MODE_SCHIP;
+	}
+	if (dot && strcmp(dot, ".xo8") == 0) {
+		return MODE_XOCHIP;
+	}
+	
+	return MODE_CHIP8;
+}
+
+// whether a rom of size bytes fits in memory from pc, in the mode set already
+static bool rom_fits(struct chip8_machine* m, long size) {
+	const long size_max = memory_size(m) - m->pc; // get the maximum possible file size for this mode
+	
+	// make sure file is of correct size
+	if (size <= 0) {
+		LOG("file too small/invalid");
+		return false;
+	}
+	if (size > size_max) {
+		LOG("file too big");
+		return false;
+	}
+	
+	return true;
+}
+
+// opens the rom to play, in the mode its extension asks for
+// if no rom is specified, just open roms/ibm_logo.ch8
+bool open_file(struct chip8_machine* m, char* name) {
+	// open the file
+	FILE* rom = NULL;
+	
+	if (name == NULL) {
+		if (!m->quiet) {
+			printf("no file name given! opening roms/ibm_logo.ch8\n\n");
+		}
+		rom = fopen("roms/ibm_logo.ch8", "rb");
+	} else {
+		if (!m->quiet) {
+			printf("opening %s\n", name);
+		}
+		rom = fopen(name, "rb");
+	}
+	
+	if (!rom) {
+		LOG("failed to open file: %s", name);
+		return false;
+	}
+	
+	set_mode(m, mode_for_file(name));
+	
+	// get file size
+	fseek(rom, 0, SEEK_END);
+	m->size = ftell(rom);
+	rewind(rom);
+	
+	if (!rom_fits(m, m->size)) {
+		fclose(rom);
+		return false;
+	}
+	
+	// read file to memory starting at pc
+	if (fread(&m->mem[m->pc], 1, m->size, rom) != (size_t)m->size) {
+		LOG("failed to read file to emulator memory");
+		fclose(rom);
+		return false;
+	}
+	
+	fclose(rom);
+	
+	// the rom is in memory now, so its instructions can be decoded ahead of time
+	invalidate(m, 0, CODE_SIZE);
+	
+	return true;
+}
+
+// puts a rom that's already in memory somewhere (like a pack) into the machine - name only picks
+// the mode, the same way open_file() does
+bool load_rom(struct chip8_machine* m, const char* name, const uint8_t* rom, long size) {
+	set_mode(m, mode_for_file(name));
+	
+	if (!rom_fits(m, size)) {
+		return false;
+	}
+	
+	m->size = size;
+	memcpy(&m->mem[m->pc], rom, size);
+	
+	invalidate(m, 0, CODE_SIZE);
+	
+	return true;
+}
+
+// decrements both timers
+void decrement_timers(struct chip8_machine* m) {
+	m->delay -= m->delay > 0 ? 1 : 0;
+	m->sound -= m->sound > 0 ? 1 : 0;
+	
+	// an idle loop might end now
+	if (m->halted == HALT_IDLE) {
+		m->halted = HALT_NONE;
+	}
+}
+
+
+// DECODE STAGE - disassembler
+// turns the binary code to human-readable assembly, writing at most size bytes into out
+#define SAY(...) snprintf(out, size, __VA_ARGS__)
+
+void format_instruction(uint16_t instr, char* out, size_t size) {
+	uint8_t  first  = (instr & 0xF000) >> 12;
+	uint8_t  second = (instr & 0x0F00) >> 8;
+	uint8_t  third  = (instr & 0x00F0) >> 4;
+	uint8_t  fourth = (instr & 0x000F);
+	uint8_t  last_2 = (instr & 0x00FF);
+	uint16_t last_3 = (instr & 0x0FFF);
+	
+	switch (first){
+		case 0x0:
+			// only 00xx are instructions - 0NNN would call machine code, which isn't emulated
+			if (second != 0) {
+				SAY("undefined - 0");
+				break;
+			}
+			
+			switch (last_2) {
+				case 0xE0:
+					SAY("CLS");
+					break;
+				case 0xEE:
+					SAY("RET");
+					break;
+				case 0xFB:
+					SAY("SCR");
+					break;
+				case 0xFC:
+					SAY("SCL");
+					break;
+				case 0xFD:
+					SAY("EXIT");
+					break;
+				case 0xFE:
+					SAY("LOW");
+					break;
+				case 0xFF:
+					SAY("HIGH");
+					break;
+				default:
+					if (third == 0xC) {
+						SAY("SCD 0x%x", fourth);
+					} else if (third == 0xD) {
+						SAY("SCU 0x%x", fourth);
+					} else {
+						SAY("undefined - 0");
+					}
+			}
+			break;
+		case 0x1:
+			SAY("JP %x", last_3);
+			break;
+		case 0x2:
+			SAY("CALL 0x%x", last_3);
+			break;
+		case 0x3:
+			SAY("SE v%x, 0x%x", second, last_2);
+			break;
+		case 0x4:
+			SAY("SNE v%x, 0x%x", second, last_2);
+			break;
+		case 0x5:
+			switch (fourth) {
+				case 0x0:
+					SAY("SE v%x, v%x", second, third);
+					break;
+				case 0x2:
+					SAY("SAVE v%x - v%x", second, third);
+					break;
+				case 0x3:
+					SAY("LOAD v%x - v%x", second, third);
+					break;
+				default:
+					SAY("undefined - 5");
+			}
+			break;
+		case 0x6:
+			SAY("LD v%x, 0x%x", second, last_2);
+			break;
+		case 0x7:
+			SAY("ADD v%x, 0x%x", second, last_2);
+			break;
+		case 0x8:
+			switch (fourth) {
+				case 0x0:
+					SAY("LD v%x, v%x", second, third);
+					break;
+				case 0x1:
+					SAY("OR v%x, v%x", second, third);
+					break;
+				case 0x2:
+					SAY("AND v%x, v%x", second, third);
+					break;
+				case 0x3:
+					SAY("XOR v%x, v%x", second, third);
+					break;
+				case 0x4:
+					SAY("ADD v%x, v%x", second, third);
+					break;
+				case 0x5:
+					SAY("SUB v%x, v%x", second, third);
+					break;				
+				case 0x6:
+					SAY("SHR v%x, v%x", second, third);
+					break;
+				case 0x7:
+					SAY("SUBN v%x, v%x", second, third);
+					break;
+				case 0xE:
+					SAY("SHL v%x, v%x", second, third);
+					break;
+				default:
+					SAY("undefined - 8");
+			}
+			break;
+		case 0x9:
+			SAY("SNE v%x, v%x", second, third);
+			break;
+		case 0xA:
+			SAY("LD instr, 0x%x", last_3);
+			break;
+		case 0xB:
+			SAY("JP v0, 0x%x", last_3);
+			break;
+		case 0xC:
+			SAY("RND v%x, 0x%x", second, last_2);
+			break;
+		case 0xD:
+			SAY("DRW v%x, v%x, 0x%x", second, third, fourth);
+			break;
+		case 0xE:
+			switch (last_2) {
+				case 0x9E:
+					SAY("SKP v%x", second);
+					break;
+				case 0xA1:
+					SAY("SKNP v%x", second);
+					break;
+				default:
+					SAY("undefined - e");
+			}
+			break;
+		case 0xF:
+			switch (last_2) {
+				case 0x00:
+					SAY(instr == 0xF000 ? "LD I, long" : "undefined - f");
+					break;
+				case 0x01:
+					SAY("PLANE 0x%x", second);
+					break;
+				case 0x02:
+					SAY(instr == 0xF002 ? "AUDIO" : "undefined - f");
+					break;
+				case 0x07:
+					SAY("LD v%x, DT", second);
+					break;
+				case 0x0A:
+					SAY("LD v%x, K", second);
+					break;
+				case 0x15:
+					SAY("LD DT, v%x", second);
+					break;					
+				case 0x18:
+					SAY("LD ST, v%x", second);
+					break;
+				case 0x1E:
+					SAY("ADD instr, v%x", second);
+					break;
+				case 0x29:
+					SAY("LD F, v%x", second);
+					break;
+				case 0x30:
+					SAY("LD HF, v%x", second);
+					break;
+				case 0x3A:
+					SAY("PITCH v%x", second);
+					break;
+				case 0x33:
+					SAY("LD B, v%x", second);
+					break;
+				case 0x55:
+					SAY("LD [instr], v%x", second);
+					break;
+				case 0x65:
+					SAY("LD v%x, [instr]", second);
+					break;
+				case 0x75:
+					SAY("LD R, v%x", second);
+					break;
+				case 0x85:
+					SAY("LD v%x, R", second);
+					break;
+				default:
+					SAY("undefined - f");
+			}
+			break;
+		default:
+			SAY("undefined");
+	}
+}
+
+#undef SAY
+
+// logs the instruction step() is on
+void print_instruction(struct chip8_machine* m) {
+	char text[32];
+	
+	format_instruction(m->instr, text, sizeof(text));
+	LOG("%s", text);
+}
+
+// HELPER FUNCTIONS FOR EXECUTION
+// remembers the first fault, and logs every one unless the machine is quiet
+void raise_fault(struct chip8_machine* m, enum fault f, const char* message) {
+	if (m->fault == FAULT_NONE) {
+		m->fault = f;
+	}
+	
+	if (!m->quiet) {
+		LOG("%s at 0x%03x", message, m->pc - 2);
+	}
+}
+
+// xorshift32 - a random byte from this machine's own generator
+static uint8_t random_byte(struct chip8_machine* m) {
+	m->rng ^= m->rng << 13;
+	m->rng ^= m->rng >> 17;
+	m->rng ^= m->rng << 5;
+	
+	return m->rng >> 24;
+}
+
+// slay all. (on the planes that are selected)
+void clear_screen(struct chip8_machine* m) {
+	for (int p = 0; p < PLANES; p++) {
+		if (m->planes >> p & 1) {
+			memset(m->screen[p], 0, sizeof(m->screen[p]));
+		}
+	}
+	m->dirty_rows = ~0ULL;
+}
+
+// reads num_rows bytes from memory, starting at address i
+// display these rows XOR'd with what's on screen now starting at (x_coord, y_coord), which wrap
+// around the screen - the sprite itself is clipped at the edges, or wraps too with QUIRK_WRAP
+// outside CHIP-8, num_rows = 0 draws a 16x16 sprite, two bytes a row. with two planes selected the
+// second plane's sprite follows the first one's in memory
+// set v[0xF] to 1 if this erases any pixels on screen, else 0
+// a sprite that runs past the memory its mode can address is a fault, though it still gets drawn
+// wrap is always a constant, so each of draw_instr() and draw_instr_wrap() only has its own half
+static ALWAYS_INLINE void draw_sprite(struct chip8_machine* m, uint8_t x_coord, uint8_t y_coord, uint8_t num_rows, const bool wrap) {
+	int height = screen_height(m);
+	int x      = x_coord & (screen_width(m) - 1);
+	int y      = y_coord & (height - 1);
+	
+	bool wide  = num_rows == 0 && m->mode != MODE_CHIP8;
+	int  rows  = wide ? 16 : num_rows;
+	int  bytes = wide ? 2 : 1;
+	
+	// don't draw out of bounds vertically, unless the rows come back in at the top
+	int drawn = wrap || y + rows < height ? rows : height - y;
+	
+	// a row is two words, and which one the sprite starts in is picked with masks instead of
+	// branches - in_right is all ones from x = 64 on, and lores never spills into the second word.
+	// when wrapping, what goes past the right edge comes back in at the left - in hires that's
+	// whatever falls off the second word, in lores whatever falls off the first
+	uint64_t in_right = -(uint64_t) (x >> 6);
+	uint64_t spill    = -(uint64_t) m->hires;
+	uint64_t around   = wrap ? in_right | ~spill : 0;
+	int      shift    = x & 63;
+	
+	// collects every pixel that got erased
+	uint64_t erased = 0;
+	uint16_t addr   = m->i;
+	
+	int planes = (m->planes & 1) + (m->planes >> 1 & 1);
+	
+	if (planes > 0 && m->i + (uint32_t) ((planes - 1) * rows + drawn) * bytes > memory_size(m)) {
+		raise_fault(m, FAULT_SPRITE_BOUNDS, "sprite out of bounds");
+	}
+	
+	for (int p = 0; p < PLANES; p++) {
+		if (!(m->planes >> p & 1)) {
+			continue;
+		}
+		
+		for (int k = 0; k < drawn; k++) {
+			int      r  = wrap ? (y + k) & (height - 1) : y + k;
+			uint16_t at = addr + k * bytes;
+		
+			// line the sprite up with the left edge - the second byte only counts for wide sprites
+			uint64_t sprite = (uint64_t) m->mem[at] << 56 | (uint64_t) (m->mem[(uint16_t) (at + 1)] & -(uint8_t) wide) << 48;
+			
+			// move it over to x, and work out what falls off the end of the word into the next one -
+			// shifting in two steps makes a shift of 0 spill nothing. pixels that go past the right
+			// edge of the screen are shifted out, which clips them for free
+			uint64_t near  = sprite >> shift;
+			uint64_t far   = (sprite << 1) << (63 - shift);
+			uint64_t left  = (near & ~in_right) | (far & around);
+			uint64_t right = ((far & ~in_right) | (near & in_right)) & spill;
+			
+			uint64_t* line = m->screen[p][r];
+			erased  |= (line[0] & left) | (line[1] & right);
+			line[0] ^= left;
+			line[1] ^= right;
+			
+			// an all-zero sprite row leaves the screen as it was
+			m->dirty_rows |= (uint64_t) ((left | right) != 0) << r;
+		}
+		
+		addr += rows * bytes;
+	}
+	
+	// update pixel erasure flag
+	m->v[0xF] = erased != 0;
+}
+
+void draw_instr(struct chip8_machine* m, uint8_t x_coord, uint8_t y_coord, uint8_t num_rows) {
+	draw_sprite(m, x_coord, y_coord, num_rows, false);
+}
+
+void draw_instr_wrap(struct chip8_machine* m, uint8_t x_coord, uint8_t y_coord, uint8_t num_rows) {
+	draw_sprite(m, x_coord, y_coord, num_rows, true);
+}
+
+// SCROLLING
+// rows are whole words, so every scroll is a few word moves a row whatever the distance, and
+// the selected planes are the only ones that move. distances are in pixels of the current resolution
+void scroll_down(struct chip8_machine* m, uint8_t rows) {
+	int height = screen_height(m);
+	
+	for (int p = 0; p < PLANES; p++) {
+		if (m->planes >> p & 1) {
+			memmove(m->screen[p][rows], m->screen[p][0], (height - rows) * sizeof(m->screen[p][0]));
+			memset(m->screen[p][0], 0, rows * sizeof(m->screen[p][0]));
+		}
+	}
+	m->dirty_rows = ~0ULL;
+}
+
+void scroll_up(struct chip8_machine* m, uint8_t rows) {
+	int height = screen_height(m);
+	
+	for (int p = 0; p < PLANES; p++) {
+		if (m->planes >> p & 1) {
+			memmove(m->screen[p][0], m->screen[p][rows], (height - rows) * sizeof(m->screen[p][0]));
+			memset(m->screen[p][height - rows], 0, rows * sizeof(m->screen[p][0]));
+		}
+	}
+	m->dirty_rows = ~0ULL;
+}
+
+// 4 pixels right - whatever leaves the first word goes into the second, which lores masks away
+void scroll_right(struct chip8_machine* m) {
+	uint64_t spill  = -(uint64_t) m->hires;
+	int      height = screen_height(m);
+	
+	for (int p = 0; p < PLANES; p++) {
+		if (m->planes >> p & 1) {
+			for (int r = 0; r < height; r++) {
+				uint64_t* line = m->screen[p][r];
+				line[1] = (line[1] >> 4 | line[0] << 60) & spill;
+				line[0] >>= 4;
+			}
+		}
+	}
+	m->dirty_rows = ~0ULL;
+}
+
+// 4 pixels left - the second word is always empty in lores, so nothing comes in from it
+void scroll_left(struct chip8_machine* m) {
+	int height = screen_height(m);
+	
+	for (int p = 0; p < PLANES; p++) {
+		if (m->planes >> p & 1) {
+			for (int r = 0; r < height; r++) {
+				uint64_t* line = m->screen[p][r];
+				line[0] = line[0] << 4 | line[1] >> 60;
+				line[1] <<= 4;
+			}
+		}
+	}
+	m->dirty_rows = ~0ULL;
+}
+
+// 00FE / 00FF - switching resolution clears every plane, selected or not
+void set_hires(struct chip8_machine* m, bool hires) {
+	m->hires = hires;
+	memset(m->screen, 0, sizeof(m->screen));
+	m->dirty_rows = ~0ULL;
+}
+
+// 00FD - pc is rewound so the machine stays on it, halted for good
+static void exit_machine(struct chip8_machine* m) {
+	m->pc -= 2;
+	m->halted = HALT_EXIT;
+}
+
+// 5xy2 / 5xy3 - vx to vy to or from memory at i, in either direction, i itself stays put
+static void save_range(struct chip8_machine* m, uint8_t x, uint8_t y) {
+	int dir   = x <= y ? 1 : -1;
+	int count = (x <= y ? y - x : x - y) + 1;
+	
+	for (int a = 0; a < count; a++) {
+		m->mem[(uint16_t) (m->i + a)] = m->v[x + a * dir];
+	}
+	invalidate(m, m->i, count);
+}
+
+static void load_range(struct chip8_machine* m, uint8_t x, uint8_t y) {
+	int dir   = x <= y ? 1 : -1;
+	int count = (x <= y ? y - x : x - y) + 1;
+	
+	for (int a = 0; a < count; a++) {
+		m->v[x + a * dir] = m->mem[(uint16_t) (m->i + a)];
+	}
+}
+
+// how far a taken skip at pc goes - XO-CHIP skips the whole of F000 NNNN
+static uint8_t skip_length(const struct chip8_machine* m) {
+	if (m->mode == MODE_XOCHIP && m->mem[m->pc] == 0xF0 && m->mem[(uint16_t) (m->pc + 1)] == 0x00) {
+		return 4;
+	}
+	
+	return 2;
+}
+
+// the keypad as one bit per key
+static uint16_t keypad_bits(const struct chip8_machine* m) {
+	uint16_t bits = 0;
+	
+	for (int a = 0; a < 0x10; a++) {
+		bits |= (uint16_t) m->keypad[a] << a;
+	}
+	
+	return bits;
+}
+
+// the core never blocks: while no key has been pressed and released, pc is rewound and the
+// machine halts until the keypad changes, so the frontend can sleep until then
+void wait_for_key(struct chip8_machine* m, uint8_t reg) {
+	// no key held yet - remember the first one to be pressed
+	if (m->held_key == 0xFF) {
+		for (int a = 0; a < 0x10; a++) {
+			if (m->keypad[a]) {
+				m->held_key = a;
+				break;
+			}
+		}
+	}
+	
+	// loop this instruction while we have not pressed a key yet, or while it is still held down
+	if (m->held_key == 0xFF || m->keypad[m->held_key]) {
+		m->pc -= 2;
+		
+		if (!m->never_skip) {
+			m->halted = HALT_KEY;
+			m->halted_keys = keypad_bits(m);
+		}
+	} else {
+		m->v[reg] = m->held_key;
+		m->held_key = 0xFF;
+		m->halted = HALT_NONE;
+	}
+}
+
+// length of the loop the jump at addr closes, if only a timer tick can ever get out of it - 0 otherwise
+//   1NNN to itself                                   - 1 instruction
+//   Fx07 / 3xNN or 4xNN / 1NNN back to the Fx07      - 3 instructions, polling the delay timer
+static uint8_t idle_cycle(const struct chip8_machine* m, uint16_t addr, uint16_t target) {
+	if (target == addr) {
+		return 1;
+	}
+	
+	if (target + 4 == addr && !(target & 0xF001)) {
+		const struct decoded* read = &m->decoded[target >> 1];
+		const struct decoded* test = read + 1;
+		uint8_t top = test->instr >> 12;
+		
+		// the loop only repeats exactly once Fx07 has read the delay timer since it last changed
+		if ((read->instr & 0xF0FF) == 0xF007 && (top == 0x3 || top == 0x4) && test->x == read->x && m->v[read->x] == m->delay) {
+			return 3;
+		}
+	}
+	
+	return 0;
+}
+
+// called after a jump from addr to target - halts the machine if it's idling
+static void check_idle(struct chip8_machine* m, uint16_t addr, uint16_t target) {
+	uint8_t cycle = m->never_skip ? 0 : idle_cycle(m, addr, target);
+	
+	if (cycle) {
+		m->halted = HALT_IDLE;
+		m->idle_cycle = cycle;
+	}
+}
+
+// whether running would only repeat itself
+bool is_halted(const struct chip8_machine* m) {
+	switch (m->halted) {
+		case HALT_KEY:	return keypad_bits(m) == m->halted_keys;
+		case HALT_IDLE:	return true;
+		case HALT_EXIT:	return true;
+		default:		return false;
+	}
+}
+
+// EXECUTE STAGE
+// executes an instruction with a profile's quirks - always a constant, see execute_instruction()
+static ALWAYS_INLINE void execute_quirked(struct chip8_machine* m, const uint8_t quirks) {
+	switch (m->first){
+		case 0x0:
+			// only 00xx are instructions, the same as the decoded engines see it - 0NNN would call
+			// machine code, which isn't emulated
+			if (m->second != 0) {
+				raise_fault(m, FAULT_UNDEFINED, "undefined - 0");
+				break;
+			}
+			
+			switch (m->last_2) {
+				case 0xE0:	// clear screen
+					clear_screen(m);
+					break;
+				case 0xEE:	// return
+					if (m->stack_addr > -1) {
+						m->pc = m->stack[m->stack_addr];
+						m->stack[m->stack_addr] = 0;
+						m->stack_addr--;
+					} else {
+						raise_fault(m, FAULT_STACK_UNDERFLOW, "stack underflow error");
+					}
+					break;
+				case 0xFB:	// scroll right
+				case 0xFC:	// scroll left
+				case 0xFD:	// exit
+				case 0xFE:	// lores
+				case 0xFF:	// hires
+					if (m->mode == MODE_CHIP8) {
+						raise_fault(m, FAULT_UNDEFINED, "undefined - 0");
+					} else if (m->last_2 == 0xFB) {
+						scroll_right(m);
+					} else if (m->last_2 == 0xFC) {
+						scroll_left(m);
+					} else if (m->last_2 == 0xFD) {
+						exit_machine(m);
+					} else {
+						set_hires(m, m->last_2 == 0xFF);
+					}
+					break;
+				default:
+					if (m->third == 0xC && m->mode != MODE_CHIP8) {				// scroll down
+						scroll_down(m, m->fourth);
+					} else if (m->third == 0xD && m->mode == MODE_XOCHIP) {	// scroll up
+						scroll_up(m, m->fourth);
+					} else {
+						raise_fault(m, FAULT_UNDEFINED, "undefined - 0");
+					}
+			}
+			break;
+		case 0x1:	// jump
+			check_idle(m, m->pc - 2, m->last_3);
+			m->pc = m->last_3;
+			break;
+		case 0x2:	// call
+			if (m->stack_addr < 11) {
+				m->stack_addr++;
+				m->stack[m->stack_addr] = m->pc;
+				m->pc = m->last_3;
+			} else {
+				raise_fault(m, FAULT_STACK_OVERFLOW, "stack overflow error");
+			}
+			break;
+		case 0x3:	// skip-equals immediate
+			if (m->v[m->second] == m->last_2) {
+				m->pc += skip_length(m);
+			}
+			break;
+		case 0x4:	// skip-not-equals immediate
+			if (m->v[m->second] != m->last_2) {
+				m->pc += skip_length(m);
+			}
+			break;
+		case 0x5:	// skip-equals register
+			switch (m->fourth) {
+				case 0x0:
+					m->pc += (m->v[m->second] == m->v[m->third]) ? skip_length(m) : 0;
+					break;
+				case 0x2:	// save vx to vy
+				case 0x3:	// load vx to vy
+					if (m->mode != MODE_XOCHIP) {
+						raise_fault(m, FAULT_UNDEFINED, "undefined - 5");
+					} else if (m->fourth == 0x2) {
+						save_range(m, m->second, m->third);
+					} else {
+						load_range(m, m->second, m->third);
+					}
+					break;
+				default:
+					raise_fault(m, FAULT_UNDEFINED, "undefined - 5");
+			}
+			break;
+		case 0x6:	// load immediate
+			m->v[m->second] = m->last_2;
+			break;
+		case 0x7:	// add
+			m->v[m->second] = m->v[m->second] + m->last_2;
+			break;
+		case 0x8:	// register-register ops
+			switch (m->fourth) {
+				case 0x0:	// load register
+					m->v[m->second] = m->v[m->third];
+					break;
+				case 0x1:	// or
+					m->v[m->second] |= m->v[m->third];
+					if (quirks & QUIRK_VF_RESET) {
+						m->v[0xF] = 0;
+					}
+					break;
+				case 0x2:	// and
+					m->v[m->second] &= m->v[m->third];
+					if (quirks & QUIRK_VF_RESET) {
+						m->v[0xF] = 0;
+					}
+					break;
+				case 0x3:	// xor
+					m->v[m->second] ^= m->v[m->third];
+					if (quirks & QUIRK_VF_RESET) {
+						m->v[0xF] = 0;
+					}
+					break;
+				case 0x4:	// add with carry flag in vF
+					uint16_t sum = m->v[m->second] + m->v[m->third];
+					m->v[m->second] = (uint8_t) sum;
+					m->v[0xF] = (sum > 0xFF) ? 1 : 0;
+					break;
+				case 0x5:	// subtract with !(borrow) flag in vF
+					bool borrow_5 = m->v[m->second] < m->v[m->third];
+					m->v[m->second] -= m->v[m->third];
+					m->v[0xF] = !borrow_5 ? 1 : 0;
+					break;				
+				case 0x6:	// shift right with half flag in vF - vy into vx, or vx in place
+					uint8_t from_6 = m->v[quirks & QUIRK_SHIFT_VY ? m->third : m->second];
+					bool half_6 = ((from_6 & 0x01) == 1);
+					m->v[m->second] = from_6 >> 1;
+					m->v[0xF] = half_6 ? 1 : 0;
+					break;
+				case 0x7:	// negated subtraction with !(borrow) flag in vF
+					bool borrow_7 = m->v[m->third] < m->v[m->second];
+					m->v[m->second] = m->v[m->third] - m->v[m->second];
+					m->v[0xF] = !borrow_7 ? 1 : 0;
+					break;
+				case 0xE:	// shift left with overflow flag in vF - vy into vx, or vx in place
+					uint8_t from_e = m->v[quirks & QUIRK_SHIFT_VY ? m->third : m->second];
+					bool overflow_e = ((from_e & 0x80) == 0x80);
+					m->v[m->second] = from_e << 1;
+					m->v[0xF] = overflow_e ? 1 : 0;
+					break;
+				default:
+					raise_fault(m, FAULT_UNDEFINED, "undefined - 8");
+			}
+			break;
+		case 0x9:	// skip-not-equals register
+			m->pc += (m->v[m->second] != m->v[m->third]) ? skip_length(m) : 0;
+			break;
+		case 0xA:	// load to index
+			m->i = m->last_3;
+			break;
+		case 0xB:	// jump to v0 + last 3 digits of instruction - or to vx + them, the way SUPER-CHIP reads it
+			m->pc = m->v[quirks & QUIRK_JUMP_VX ? m->second : 0] + m->last_3;
+			break;
+		case 0xC:	// vx and random byte
+			m->v[m->second] = random_byte(m) & m->last_2;
+			break;
+		case 0xD:	// draw instruction
+			draw_sprite(m, m->v[m->second], m->v[m->third], m->fourth, quirks & QUIRK_WRAP);
+			break;
+		case 0xE:	// key press instructions
+		// if v[second] is in [0x0, 0xF] and handle_input()'s return matches the key corresponding to v[second]'s value
+		// do to pc what must be done
+			switch (m->last_2) {
+				case 0x9E:	// skip next if key pressed
+					m->pc += m->keypad[m->v[m->second] & 0xF] ? skip_length(m) : 0;
+					break;
+				case 0xA1:	// skip next if key isn't pressed
+					m->pc += m->keypad[m->v[m->second] & 0xF] ? 0 : skip_length(m);
+					break;
+				default:
+					raise_fault(m, FAULT_UNDEFINED, "undefined - e");
+			}
+			break;
+		case 0xF:
+			// XO-CHIP only
+			if (m->mode == MODE_XOCHIP) {
+				if (m->instr == 0xF000) {	// load a 16-bit index from the next word, then skip it
+					m->i = m->mem[m->pc] << 8 | m->mem[(uint16_t) (m->pc + 1)];
+					m->pc += 2;
+					break;
+				}
+				if (m->last_2 == 0x01) {	// select the planes in second
+					m->planes = m->second & 0x3;
+					break;
+				}
+				if (m->instr == 0xF002) {	// load 16 bytes of audio pattern from i
+					for (int a = 0; a < 16; a++) {
+						m->pattern[a] = m->mem[(uint16_t) (m->i + a)];
+					}
+					break;
+				}
+				if (m->last_2 == 0x3A) {	// set the pitch of the pattern
+					m->pitch = m->v[m->second];
+					break;
+				}
+			}
+			switch (m->last_2) {
+				case 0x07:	// load delay register
+					m->v[m->second] = m->delay;
+					break;
+				case 0x0A:	// wait until key press, then store key in v[second]
+					wait_for_key(m, m->second);
+					break;
+				case 0x15:	// set delay timer to v[second]
+					m->delay = m->v[m->second];
+					break;					
+				case 0x18:	// set sound timer to v[second], and stop so run() knows when
+					m->sound = m->v[m->second];
+					m->halted = HALT_SOUND;
+					break;
+				case 0x1E:	// add v[second] to memory index - only CHIP-8 flags going past 4 kb
+					m->i += m->v[m->second];
+					if (m->mode == MODE_CHIP8) {
+						m->v[0xF] = m->i > 0xFFF ? 1 : 0;
+					}
+					break;
+				case 0x29:	// set index to point to character in fonts corresponding to bottom nibble of v[second]
+					//	(bottom nibble)		(number of bytes per character in fontset)
+					m->i = (m->v[m->second] & 0x0F) * 5;
+					break;
+				case 0x30:	// same for the big font
+				case 0x75:	// store registers to the flags
+				case 0x85:	// load registers from the flags
+					if (m->mode == MODE_CHIP8) {
+						raise_fault(m, FAULT_UNDEFINED, "undefined - f");
+					} else if (m->last_2 == 0x30) {
+						m->i = BIG_FONT + (m->v[m->second] & 0x0F) * 10;
+					} else if (m->last_2 == 0x75) {
+						memcpy(m->flags, m->v, m->second + 1);
+					} else {
+						memcpy(m->v, m->flags, m->second + 1);
+					}
+					break;
+				case 0x33:	// convert v[second] to decimal, then store each digit in successive memory indices
+					m->mem[m->i] 	   = m->v[m->second] / 100 % 10;
+					m->mem[(uint16_t) (m->i + 1)] = m->v[m->second] / 10  % 10;
+					m->mem[(uint16_t) (m->i + 2)] = m->v[m->second] /*/1*/% 10;
+					invalidate(m, m->i, 3);
+					break;
+				case 0x55:	// store registers to memory, then increment mem index accordingly
+					for (int a = 0; a <= m->second; a++) {
+						m->mem[(uint16_t) (m->i + a)] = m->v[a];
+					}
+					invalidate(m, m->i, m->second + 1);
+					if (quirks & QUIRK_INCREMENT_I) {
+						m->i += m->second + 1;
+					}
+					break;
+				case 0x65:	// pull memory to registers, then increment mem index accordingly
+					for (int a = 0; a <= m->second; a++) {
+						m->v[a] = m->mem[(uint16_t) (m->i + a)];
+					}
+					if (quirks & QUIRK_INCREMENT_I) {
+						m->i += m->second + 1;
+					}
+					break;
+				default:
+					raise_fault(m, FAULT_UNDEFINED, "undefined - f");
+			}
+			break;
+		default:
+			raise_fault(m, FAULT_UNDEFINED, "undefined");
+	}
+}
+
+// FETCH STAGE
+// fetches the instruction at pc and splits it into its digits
+static ALWAYS_INLINE void fetch(struct chip8_machine* m) {
+	//fetch
+	m->instr = m->mem[m->pc] << 8 | m->mem[(uint16_t) (m->pc + 1)];
+
+	// increment pc since we already have current instruction
+	m->pc += 2;
+	
+	// mask the digits we need in the opcode
+	m->first  = (m->instr & 0xF000) >> 12;
+	m->second = (m->instr & 0x0F00) >> 8;
+	m->third  = (m->instr & 0X00F0) >> 4;
+	m->fourth = (m->instr & 0X000F);
+	m->last_2 = (m->instr & 0x00FF);
+	m->last_3 = (m->instr & 0x0FFF);
+}
+
+// SPECIALIZED INTERPRETERS
+// INTERPRETER() makes a copy of the interpreter for a profile with its quirks built in - both the
+// single instruction and the whole loop, so run() picks the loop once and nothing is looked up
+// between instructions
+#define INTERPRETER(profile, quirks) \
+	static void execute_##profile(struct chip8_machine* m) { \
+		execute_quirked(m, quirks); \
+	} \
+	static uint32_t interpret_##profile(struct chip8_machine* m, uint32_t n) { \
+		for (; n > 0 && !m->halted; n--) { \
+			fetch(m); \
+			execute_quirked(m, quirks); \
+		} \
+		return n; \
+	}
+
+INTERPRETER(chip8, CHIP8_QUIRKS)
+INTERPRETER(schip, SCHIP_QUIRKS)
+INTERPRETER(xochip, XOCHIP_QUIRKS)
+
+#undef INTERPRETER
+
+static void (*const execute_profile[QUIRKS_COUNT])(struct chip8_machine* m) = {
+	execute_chip8, execute_schip, execute_xochip
+};
+
+static uint32_t (*const interpret_profile[QUIRKS_COUNT])(struct chip8_machine* m, uint32_t n) = {
+	interpret_chip8, interpret_schip, interpret_xochip
+};
+
+// executes the instruction step() fetched, with the machine's quirks
+void execute_instruction(struct chip8_machine* m) {
+	execute_profile[m->quirks](m);
+}
+
+// fetches the instruction at pc, splits it into its digits, then executes it
+void step(struct chip8_machine* m) {
+	fetch(m);
+	
+	// execute!
+	execute_instruction(m);
+}
+
+// 64-bit FNV-1a hash of the display - cheap way to compare the screens of two runs
+// only the words the current resolution and mode can draw on go in, so a CHIP-8 screen hashes the
+// same as it did when the display was 64x32
+uint64_t screen_hash(const struct chip8_machine* m) {
+	uint64_t hash = 0xCBF29CE484222325ULL;
+	int planes = m->mode == MODE_XOCHIP ? PLANES : 1;
+	
+	for (int p = 0; p < planes; p++) {
+		for (int r = 0; r < screen_height(m); r++) {
+			for (int w = 0; w <= m->hires; w++) {
+				for (int b = 0; b < 64; b += 8) {
+					hash ^= (m->screen[p][r][w] >> b) & 0xFF;
+					hash *= 0x100000001B3ULL;
+				}
+			}
+		}
+	}
+	
+	return hash;
+}
+
+// PREDECODED EXECUTION
+// every even address gets a decoded[] entry holding the handler for its instruction and the
+// operands already pulled out, so a step is one table lookup and one call
+static void op_cls(struct chip8_machine* m, const struct decoded* d) {
+	(void) d;
+	clear_screen(m);
+}
+
+static void op_ret(struct chip8_machine* m, const struct decoded* d) {
+	(void) d;
+	if (m->stack_addr > -1) {
+		m->pc = m->stack[m->stack_addr];
+		m->stack[m->stack_addr] = 0;
+		m->stack_addr--;
+	} else {
+		raise_fault(m, FAULT_STACK_UNDERFLOW, "stack underflow error");
+	}
+}
+
+static void op_scd(struct chip8_machine* m, const struct decoded* d) {
+	scroll_down(m, d->n);
+}
+
+static void op_scu(struct chip8_machine* m, const struct decoded* d) {
+	scroll_up(m, d->n);
+}
+
+static void op_scr(struct chip8_machine* m, const struct decoded* d) {
+	(void) d;
+	scroll_right(m);
+}
+
+static void op_scl(struct chip8_machine* m, const struct decoded* d) {
+	(void) d;
+	scroll_left(m);
+}
+
+static void op_exit(struct chip8_machine* m, const struct decoded* d) {
+	(void) d;
+	exit_machine(m);
+}
+
+static void op_low(struct chip8_machine* m, const struct decoded* d) {
+	(void) d;
+	set_hires(m, false);
+}
+
+static void op_high(struct chip8_machine* m, const struct decoded* d) {
+	(void) d;
+	set_hires(m, true);
+}
+
+static void op_jp(struct chip8_machine* m, const struct decoded* d) {
+	m->pc = d->nnn;
+}
+
+// a jump that might close an idle loop - decode() picks this one for jumps to themselves or 4 bytes back
+static void op_jp_idle(struct chip8_machine* m, const struct decoded* d) {
+	m->pc = d->nnn;
+	check_idle(m, (uint16_t) ((d - m->decoded) * 2), d->nnn);
+}
+
+static void op_call(struct chip8_machine* m, const struct decoded* d) {
+	if (m->stack_addr < 11) {
+		m->stack_addr++;
+		m->stack[m->stack_addr] = m->pc;
+		m->pc = d->nnn;
+	} else {
+		raise_fault(m, FAULT_STACK_OVERFLOW, "stack overflow error");
+	}
+}
+
+static void op_se_imm(struct chip8_machine* m, const struct decoded* d) {
+	m->pc += (m->v[d->x] == d->nn) ? d->skip : 0;
+}
+
+static void op_sne_imm(struct chip8_machine* m, const struct decoded* d) {
+	m->pc += (m->v[d->x] != d->nn) ? d->skip : 0;
+}
+
+static void op_se_reg(struct chip8_machine* m, const struct decoded* d) {
+	m->pc += (m->v[d->x] == m->v[d->y]) ? d->skip : 0;
+}
+
+static void op_save(struct chip8_machine* m, const struct decoded* d) {
+	save_range(m, d->x, d->y);
+}
+
+static void op_load_range(struct chip8_machine* m, const struct decoded* d) {
+	load_range(m, d->x, d->y);
+}
+
+static void op_ld_imm(struct chip8_machine* m, const struct decoded* d) {
+	m->v[d->x] = d->nn;
+}
+
+static void op_add_imm(struct chip8_machine* m, const struct decoded* d) {
+	m->v[d->x] += d->nn;
+}
+
+static void op_ld_reg(struct chip8_machine* m, const struct decoded* d) {
+	m->v[d->x] = m->v[d->y];
+}
+
+static void op_add_reg(struct chip8_machine* m, const struct decoded* d) {
+	uint16_t sum = m->v[d->x] + m->v[d->y];
+	m->v[d->x] = (uint8_t) sum;
+	m->v[0xF] = sum > 0xFF;
+}
+
+static void op_sub(struct chip8_machine* m, const struct decoded* d) {
+	bool borrow = m->v[d->x] < m->v[d->y];
+	m->v[d->x] -= m->v[d->y];
+	m->v[0xF] = !borrow;
+}
+
+static void op_subn(struct chip8_machine* m, const struct decoded* d) {
+	bool borrow = m->v[d->y] < m->v[d->x];
+	m->v[d->x] = m->v[d->y] - m->v[d->x];
+	m->v[0xF] = !borrow;
+}
+
+static void op_sne_reg(struct chip8_machine* m, const struct decoded* d) {
+	m->pc += (m->v[d->x] != m->v[d->y]) ? d->skip : 0;
+}
+
+static void op_ld_i(struct chip8_machine* m, const struct decoded* d) {
+	m->i = d->nnn;
+}
+
+static void op_rnd(struct chip8_machine* m, const struct decoded* d) {
+	m->v[d->x] = random_byte(m) & d->nn;
+}
+
+static void op_skp(struct chip8_machine* m, const struct decoded* d) {
+	m->pc += m->keypad[m->v[d->x] & 0xF] ? d->skip : 0;
+}
+
+static void op_sknp(struct chip8_machine* m, const struct decoded* d) {
+	m->pc += m->keypad[m->v[d->x] & 0xF] ? 0 : d->skip;
+}
+
+static void op_ld_dt(struct chip8_machine* m, const struct decoded* d) {
+	m->v[d->x] = m->delay;
+}
+
+static void op_ld_key(struct chip8_machine* m, const struct decoded* d) {
+	wait_for_key(m, d->x);
+}
+
+static void op_set_dt(struct chip8_machine* m, const struct decoded* d) {
+	m->delay = m->v[d->x];
+}
+
+static void op_set_st(struct chip8_machine* m, const struct decoded* d) {
+	m->sound = m->v[d->x];
+	m->halted = HALT_SOUND;
+}
+
+static void op_add_i(struct chip8_machine* m, const struct decoded* d) {
+	m->i += m->v[d->x];
+	m->v[0xF] = m->i > 0xFFF;
+}
+
+// Fx1E outside CHIP-8 leaves vF alone
+static void op_add_i_plain(struct chip8_machine* m, const struct decoded* d) {
+	m->i += m->v[d->x];
+}
+
+static void op_ld_long(struct chip8_machine* m, const struct decoded* d) {
+	m->i = d->next;
+	m->pc += 2;
+}
+
+static void op_plane(struct chip8_machine* m, const struct decoded* d) {
+	m->planes = d->x & 0x3;
+}
+
+static void op_audio(struct chip8_machine* m, const struct decoded* d) {
+	(void) d;
+	for (int a = 0; a < 16; a++) {
+		m->pattern[a] = m->mem[(uint16_t) (m->i + a)];
+	}
+}
+
+static void op_pitch(struct chip8_machine* m, const struct decoded* d) {
+	m->pitch = m->v[d->x];
+}
+
+static void op_ld_font(struct chip8_machine* m, const struct decoded* d) {
+	m->i = (m->v[d->x] & 0x0F) * 5;
+}
+
+static void op_ld_big_font(struct chip8_machine* m, const struct decoded* d) {
+	m->i = BIG_FONT + (m->v[d->x] & 0x0F) * 10;
+}
+
+static void op_bcd(struct chip8_machine* m, const struct decoded* d) {
+	m->mem[m->i] 	   = m->v[d->x] / 100 % 10;
+	m->mem[(uint16_t) (m->i + 1)] = m->v[d->x] / 10  % 10;
+	m->mem[(uint16_t) (m->i + 2)] = m->v[d->x] /*/1*/% 10;
+	invalidate(m, m->i, 3);
+}
+
+static void op_store_flags(struct chip8_machine* m, const struct decoded* d) {
+	memcpy(m->flags, m->v, d->x + 1);
+}
+
+static void op_load_flags(struct chip8_machine* m, const struct decoded* d) {
+	memcpy(m->v, m->flags, d->x + 1);
+}
+
+static void op_undefined(struct chip8_machine* m, const struct decoded* d) {
+	(void) d;
+	raise_fault(m, FAULT_UNDEFINED, "undefined");
+}
+
+// QUIRKED HANDLERS
+// the handlers a quirk changes are written once with the quirks as an argument, and QUIRKED()
+// makes a copy of all of them for a profile with its quirks as a constant - the compiler drops
+// whatever the profile doesn't do, and decode() picks the copy for the machine's profile
+static ALWAYS_INLINE void quirked_or(struct chip8_machine* m, const struct decoded* d, const uint8_t quirks) {
+	m->v[d->x] |= m->v[d->y];
+	if (quirks & QUIRK_VF_RESET) {
+		m->v[0xF] = 0;
+	}
+}
+
+static ALWAYS_INLINE void quirked_and(struct chip8_machine* m, const struct decoded* d, const uint8_t quirks) {
+	m->v[d->x] &= m->v[d->y];
+	if (quirks & QUIRK_VF_RESET) {
+		m->v[0xF] = 0;
+	}
+}
+
+static ALWAYS_INLINE void quirked_xor(struct chip8_machine* m, const struct decoded* d, const uint8_t quirks) {
+	m->v[d->x] ^= m->v[d->y];
+	if (quirks & QUIRK_VF_RESET) {
+		m->v[0xF] = 0;
+	}
+}
+
+static ALWAYS_INLINE void quirked_shr(struct chip8_machine* m, const struct decoded* d, const uint8_t quirks) {
+	uint8_t from = m->v[quirks & QUIRK_SHIFT_VY ? d->y : d->x];
+	m->v[d->x] = from >> 1;
+	m->v[0xF] = from & 0x01;
+}
+
+static ALWAYS_INLINE void quirked_shl(struct chip8_machine* m, const struct decoded* d, const uint8_t quirks) {
+	uint8_t from = m->v[quirks & QUIRK_SHIFT_VY ? d->y : d->x];
+	m->v[d->x] = from << 1;
+	m->v[0xF] = from >> 7;
+}
+
+static ALWAYS_INLINE void quirked_jp_v0(struct chip8_machine* m, const struct decoded* d, const uint8_t quirks) {
+	m->pc = m->v[quirks & QUIRK_JUMP_VX ? d->x : 0] + d->nnn;
+}
+
+static ALWAYS_INLINE void quirked_drw(struct chip8_machine* m, const struct decoded* d, const uint8_t quirks) {
+	draw_sprite(m, m->v[d->x], m->v[d->y], d->n, quirks & QUIRK_WRAP);
+}
+
+static ALWAYS_INLINE void quirked_store(struct chip8_machine* m, const struct decoded* d, const uint8_t quirks) {
+	for (int a = 0; a <= d->x; a++) {
+		m->mem[(uint16_t) (m->i + a)] = m->v[a];
+	}
+	invalidate(m, m->i, d->x + 1);
+	if (quirks & QUIRK_INCREMENT_I) {
+		m->i += d->x + 1;
+	}
+}
+
+static ALWAYS_INLINE void quirked_load(struct chip8_machine* m, const struct decoded* d, const uint8_t quirks) {
+	for (int a = 0; a <= d->x; a++) {
+		m->v[a] = m->mem[(uint16_t) (m->i + a)];
+	}
+	if (quirks & QUIRK_INCREMENT_I) {
+		m->i += d->x + 1;
+	}
+}
+
+// every quirked handler of one profile
+	struct quirked_ops {
+		op_handler or, and, xor, shr, shl, jp_v0, drw, store, load;
+	};
+
+#define QUIRKED_OP(profile, name, quirks) \
+	static void op_##name##_##profile(struct chip8_machine* m, const struct decoded* d) { quirked_##name(m, d, quirks); }
+
+#define QUIRKED(profile, quirks) \
+	QUIRKED_OP(profile, or, quirks)    QUIRKED_OP(profile, and, quirks)   QUIRKED_OP(profile, xor, quirks) \
+	QUIRKED_OP(profile, shr, quirks)   QUIRKED_OP(profile, shl, quirks)   QUIRKED_OP(profile, jp_v0, quirks) \
+	QUIRKED_OP(profile, drw, quirks)   QUIRKED_OP(profile, store, quirks) QUIRKED_OP(profile, load, quirks) \
+	static const struct quirked_ops profile##_ops = { \
+		op_or_##profile,  op_and_##profile, op_xor_##profile,   op_shr_##profile,  op_shl_##profile, \
+		op_jp_v0_##profile, op_drw_##profile, op_store_##profile, op_load_##profile \
+	};
+
+QUIRKED(chip8, CHIP8_QUIRKS)
+QUIRKED(schip, SCHIP_QUIRKS)
+QUIRKED(xochip, XOCHIP_QUIRKS)
+
+static const struct quirked_ops* const quirked_ops[QUIRKS_COUNT] = {&chip8_ops, &schip_ops, &xochip_ops};
+
+#undef QUIRKED
+#undef QUIRKED_OP
+
+// handlers for the groups that are picked by their first digit alone - NULL where it takes more,
+// or where the profile picks
+static const op_handler first_table[16] = {
+	NULL,       op_jp,      op_call,    op_se_imm,
+	op_sne_imm, NULL,       op_ld_imm,  op_add_imm,
+	NULL,       op_sne_reg, op_ld_i,    NULL,
+	op_rnd,     NULL,       NULL,       NULL
+};
+
+// 0x8 group, picked by the last digit - NULL where the profile picks
+static const op_handler alu_table[16] = {
+	op_ld_reg,    NULL,         NULL,         NULL,
+	op_add_reg,   op_sub,       NULL,         op_subn,
+	op_undefined, op_undefined, op_undefined, op_undefined,
+	op_undefined, op_undefined, NULL,         op_undefined
+};
+
+// the profile's copy of a quirked handler, NULL if the instruction doesn't have any quirks
+static op_handler find_quirked(uint16_t op, enum quirks quirks) {
+	const struct quirked_ops* q = quirked_ops[quirks];
+	
+	switch (op & 0xF00F) {
+		case 0x8001: return q->or;
+		case 0x8002: return q->and;
+		case 0x8003: return q->xor;
+		case 0x8006: return q->shr;
+		case 0x800E: return q->shl;
+	}
+	
+	switch (op & 0xF0FF) {
+		case 0xF055: return q->store;
+		case 0xF065: return q->load;
+	}
+	
+	switch (op >> 12) {
+		case 0xB: return q->jp_v0;
+		case 0xD: return q->drw;
+	}
+	
+	return NULL;
+}
+
+// handlers for what SUPER-CHIP and XO-CHIP add, NULL for anything they leave as it was
+static op_handler find_extended(uint16_t op, enum mode mode) {
+	bool xo = mode == MODE_XOCHIP;
+	
+	switch (op) {
+		case 0x00FB: return op_scr;
+		case 0x00FC: return op_scl;
+		case 0x00FD: return op_exit;
+		case 0x00FE: return op_low;
+		case 0x00FF: return op_high;
+		case 0xF000: return xo ? op_ld_long : NULL;
+		case 0xF002: return xo ? op_audio : NULL;
+	}
+	
+	switch (op & 0xF0FF) {
+		case 0xF01E: return op_add_i_plain;
+		case 0xF030: return op_ld_big_font;
+		case 0xF075: return op_store_flags;
+		case 0xF085: return op_load_flags;
+		case 0xF001: return xo ? op_plane : NULL;
+		case 0xF03A: return xo ? op_pitch : NULL;
+	}
+	
+	switch (op & 0xFFF0) {
+		case 0x00C0: return op_scd;
+		case 0x00D0: return xo ? op_scu : NULL;
+	}
+	
+	switch (op & 0xF00F) {
+		case 0x5002: return xo ? op_save : NULL;
+		case 0x5003: return xo ? op_load_range : NULL;
+	}
+	
+	return NULL;
+}
+
+// picks the handler for a whole instruction - the same tree as execute_instruction(), walked once
+static op_handler find_handler(uint16_t op, enum mode mode, enum quirks quirks) {
+	uint8_t top = op >> 12;
+	op_handler extended = mode != MODE_CHIP8 ? find_extended(op, mode) : NULL;
+	op_handler quirked  = find_quirked(op, quirks);
+	
+	if (extended) {
+		return extended;
+	}
+	
+	if (quirked) {
+		return quirked;
+	}
+	
+	if (first_table[top]) {
+		return first_table[top];
+	}
+	
+	switch (top) {
+		case 0x0:
+			return op == 0x00E0 ? op_cls : op == 0x00EE ? op_ret : op_undefined;
+		case 0x5:
+			return (op & 0x000F) == 0 ? op_se_reg : op_undefined;
+		case 0x8:
+			return alu_table[op & 0x000F];
+		case 0xE:
+			return (op & 0x00FF) == 0x9E ? op_skp : (op & 0x00FF) == 0xA1 ? op_sknp : op_undefined;
+		default:	// 0xF
+			switch (op & 0x00FF) {
+				case 0x07: return op_ld_dt;
+				case 0x0A: return op_ld_key;
+				case 0x15: return op_set_dt;
+				case 0x18: return op_set_st;
+				case 0x1E: return op_add_i;
+				case 0x29: return op_ld_font;
+				case 0x33: return op_bcd;
+				default:   return op_undefined;
+			}
+	}
+}
+
+// decodes the instruction at an even address into its decoded[] entry
+static void decode(struct chip8_machine* m, uint16_t addr) {
+	struct decoded* d = &m->decoded[addr >> 1];
+	uint16_t op = m->mem[addr] << 8 | m->mem[addr + 1];
+	
+	d->instr   = op;
+	d->next    = m->mem[addr + 2] << 8 | m->mem[addr + 3];
+	d->skip    = m->mode == MODE_XOCHIP && d->next == 0xF000 ? 4 : 2;
+	d->x       = (op & 0x0F00) >> 8;
+	d->y       = (op & 0x00F0) >> 4;
+	d->n       = (op & 0x000F);
+	d->nn      = (op & 0x00FF);
+	d->nnn     = (op & 0x0FFF);
+	d->handler = find_handler(op, m->mode, m->quirks);
+	
+	if (op >> 12 == 0x1 && (d->nnn == addr || d->nnn + 4 == addr)) {
+		d->handler = op_jp_idle;
+	}
+	
+	// anything that can move pc somewhere other than the next instruction ends a basic block,
+	// and so does Fx18, so engines stop right after it and the buzzer starts on the right instruction
+	uint8_t top = op >> 12;
+	d->branch  = top == 0x1 || top == 0x2 || top == 0xB || op == 0x00EE
+	          || top == 0x3 || top == 0x4 || top == 0x5 || top == 0x9 || top == 0xE
+	          || (top == 0xF && (d->nn == 0x0A || d->nn == 0x18))
+	          || d->handler == op_exit || d->handler == op_ld_long;
+}
+
+// re-decodes every entry that overlaps the len bytes starting at addr
+// must be called whenever memory that might hold code is written
+void invalidate(struct chip8_machine* m, uint32_t addr, uint32_t len) {
+	uint32_t end = addr + len;
+	
+	// only the first 4 kb holds code
+	if (end > CODE_SIZE) {
+		end = CODE_SIZE;
+	}
+	
+	// XO-CHIP instructions also look at the word after them - F000 NNNN, and skips over it
+	if (m->mode == MODE_XOCHIP && addr >= 2) {
+		addr -= 2;
+	}
+	
+	if (addr >= end) {
+		return;
+	}
+	
+	for (uint32_t a = addr & ~1u; a < end; a += 2) {
+		decode(m, a);
+	}
+	
+	// translated and compiled blocks hold on to these entries too
+	invalidate_blocks(m, addr, end);
+	invalidate_jit(m, addr, end);
+	invalidate_aot(m, addr, end);
+}
+
+// executes the instruction at pc through its predecoded entry
+void step_decoded(struct chip8_machine* m) {
+	// odd or out of range addresses have no entry - take the slow path
+	if (m->pc & 0xF001) {
+		step(m);
+		return;
+	}
+	
+	const struct decoded* d = &m->decoded[m->pc >> 1];
+	
+	m->pc += 2;
+	d->handler(m, d);
+}
+
+// ENGINE SELECTION
+static const char* engine_names[] = {"interpreter", "decoded", "blocks", "jit", "aot"};
+
+// turns an engine name into an engine, returns false if there is no engine by that name
+bool parse_engine(const char* name, enum engine* out) {
+	for (int e = 0; e < ENGINE_COUNT; e++) {
+		if (strcmp(name, engine_names[e]) == 0) {
+			*out = e;
+			return true;
+		}
+	}
+	
+	return false;
+}
+
+const char* engine_name(enum engine e) {
+	return engine_names[e];
+}
+
+static const char* mode_names[] = {"chip-8", "schip", "xo-chip"};
+
+// turns a mode name into a mode, returns false if there is no mode by that name
+bool parse_mode(const char* name, enum mode* out) {
+	for (int k = 0; k < MODE_COUNT; k++) {
+		if (strcmp(name, mode_names[k]) == 0) {
+			*out = k;
+			return true;
+		}
+	}
+	
+	return false;
+}
+
+const char* mode_name(enum mode mode) {
+	return mode_names[mode];
+}
+
+// profiles are named after the modes they go with
+static const uint8_t quirk_sets[] = {CHIP8_QUIRKS, SCHIP_QUIRKS, XOCHIP_QUIRKS};
+
+// turns a profile name into a profile, returns false if there is no profile by that name
+bool parse_quirks(const char* name, enum quirks* out) {
+	for (int k = 0; k < QUIRKS_COUNT; k++) {
+		if (strcmp(name, mode_names[k]) == 0) {
+			*out = k;
+			return true;
+		}
+	}
+	
+	return false;
+}
+
+const char* quirks_name(enum quirks quirks) {
+	return mode_names[quirks];
+}
+
+// the QUIRK_ bits a profile has
+uint8_t quirk_set(enum quirks quirks) {
+	return quirk_sets[quirks];
+}
+
+static const char* fault_names[] = {"none", "stack overflow", "stack underflow", "undefined opcode", "sprite out of bounds"};
+
+const char* fault_name(enum fault f) {
+	return fault_names[f];
+}
+
+// runs up to n instructions on the machine's engine, stopping early if it halts
+// returns how many of the n are left
+static uint32_t run_engine(struct chip8_machine* m, uint32_t n) {
+	if (m->trace) {
+		return run_traced(m, n);
+	}
+	
+	if (m->profile) {
+		return run_profiled(m, n);
+	}
+	
+	if (m->coverage) {
+		return run_covered(m, n);
+	}
+	
+	switch (m->engine) {
+		case ENGINE_INTERPRETER:
+			return interpret_profile[m->quirks](m, n);
+		case ENGINE_DECODED:
+			for (; n > 0 && !m->halted; n--) {
+				step_decoded(m);
+			}
+			return n;
+		case ENGINE_JIT:
+			return run_jit(m, n);
+		case ENGINE_AOT:
+			return run_aot(m, n);
+		default:
+			return run_blocks(m, n);
+	}
+}
+
+// keeps a sound timer write for the buzzer, if there's room
+static void note_sound(struct chip8_machine* m, uint64_t at) {
+	if (m->sound_write_count < SOUND_WRITES) {
+		m->sound_writes[m->sound_write_count++] = (struct sound_write) {at, m->sound};
+	}
+}
+
+// runs n instructions - halts skip ahead without changing the outcome:
+// waiting on Fx0A repeats the same instruction, so the rest are dropped, and an idle loop
+// comes back to the same state every lap, so only the part of a lap that's left over runs
+void run(struct chip8_machine* m, uint32_t n) {
+	// dropped and skipped instructions still take their time
+	uint64_t end = m->executed + n;
+	
+	while (n > 0) {
+		if (is_halted(m)) {
+			if (m->halted == HALT_KEY || m->halted == HALT_EXIT) {
+				m->skipped += n;
+				break;
+			}
+			
+			if (n >= m->idle_cycle) {
+				m->idle_skips++;
+				m->skipped += n - n % m->idle_cycle;
+				n %= m->idle_cycle;
+			}
+		}
+		
+		m->halted = HALT_NONE;
+		n = run_engine(m, n);
+		
+		// the engine stopped right after an Fx18 - n is what's left after it
+		if (m->halted == HALT_SOUND) {
+			note_sound(m, end - n);
+			m->halted = HALT_NONE;
+		}
+	}
+	
+	m->executed = end;
+}
+
+// runs one 60 hz frame - the instructions that fit in it, then one timer tick
+void run_frame(struct chip8_machine* m, uint32_t instructions) {
+	run(m, instructions);
+	decrement_timers(m);
+}
+
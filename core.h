@@ -0,0 +1,292 @@
+// CHIP-8 CORE
+// machine state and the fetch/decode/execute functions, with no dependency on SDL
+#ifndef CORE_H
+#define CORE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// the core doesn't know about SDL, so it logs straight to stderr
+#define LOG(...) (fprintf(stderr, __VA_ARGS__), fputc('\n', stderr))
+
+// number of instructions between timer decrements when running flat out (benchmarks, batches)
+#define INSTRUCTIONS_PER_TICK 0x3333
+
+// instructions per 60 hz frame in the window unless the args give another - 720 a second
+#define INSTRUCTIONS_PER_FRAME 12
+
+// DISPLAY AND MEMORY
+// the biggest display any mode has - CHIP-8, and SUPER-CHIP in lores, only use the top-left 64x32
+#define SCREEN_WIDTH  128
+#define SCREEN_HEIGHT 64
+
+// XO-CHIP draws on two bitplanes, the other modes only ever on the first
+#define PLANES 2
+
+// XO-CHIP can address 64 kb - the other modes only load roms into the first 4
+#define MEMORY_SIZE 0x10000
+
+// code can only be jumped to in the first 4 kb, so that's all that gets predecoded and cached
+#define CODE_SIZE 0x1000
+
+// where the 8x10 SUPER-CHIP digits go, right after the small font
+#define BIG_FONT 0x50
+
+// MODES
+// which instruction set a machine runs - each one is everything the one before has and more
+	enum mode {
+		MODE_CHIP8,		// the original - 64x32, 4 kb
+		MODE_SCHIP,		// SUPER-CHIP 1.1 - 128x64 hires, scrolling, 16x16 sprites, the big font
+		MODE_XOCHIP,	// XO-CHIP - 64 kb, two bitplanes, scrolling up, register ranges
+		MODE_COUNT
+	};
+
+// QUIRKS
+// the ways the platforms disagree about the instructions they all have
+#define QUIRK_VF_RESET    0x01	// 8xy1 / 8xy2 / 8xy3 zero vF
+#define QUIRK_SHIFT_VY    0x02	// 8xy6 / 8xyE shift vy into vx - otherwise vx shifts in place
+#define QUIRK_INCREMENT_I 0x04	// Fx55 / Fx65 leave i just past the last register
+#define QUIRK_WRAP        0x08	// sprites wrap around the edges of the screen - otherwise they're clipped
+#define QUIRK_JUMP_VX     0x10	// Bxnn jumps to vx + xnn - otherwise Bnnn jumps to v0 + nnn
+
+// which of them each platform has
+#define CHIP8_QUIRKS  (QUIRK_VF_RESET | QUIRK_SHIFT_VY | QUIRK_INCREMENT_I)
+#define SCHIP_QUIRKS  (QUIRK_JUMP_VX)
+#define XOCHIP_QUIRKS (QUIRK_SHIFT_VY | QUIRK_INCREMENT_I | QUIRK_WRAP)
+
+// a profile is one platform's quirks - each has its own copy of the interpreter and of every
+// handler a quirk changes, so picking one costs nothing while running. a rom gets its mode's
+// profile unless it asks for another
+	enum quirks {
+		QUIRKS_CHIP8,	// the COSMAC VIP
+		QUIRKS_SCHIP,	// SUPER-CHIP 1.1 on the HP 48
+		QUIRKS_XOCHIP,	// Octo
+		QUIRKS_COUNT
+	};
+
+// ENGINE SELECTION
+// every engine gives the same results, they only differ in speed
+	enum engine {
+		ENGINE_INTERPRETER,	// step() - fetch and decode every time
+		ENGINE_DECODED,		// step_decoded() - one predecoded instruction at a time
+		ENGINE_BLOCKS,		// run_blocks() - cached, chained basic blocks
+		ENGINE_JIT,			// run_jit() - blocks compiled to x86-64, falls back to blocks elsewhere
+		ENGINE_AOT,			// run_aot() - blocks compiled to C by chip-8-aot, falls back to blocks for other roms
+		ENGINE_COUNT
+	};
+
+// things that went wrong while running - the first one is kept
+	enum fault {
+		FAULT_NONE,
+		FAULT_STACK_OVERFLOW,	// 2NNN with a full stack
+		FAULT_STACK_UNDERFLOW,	// 00EE with an empty stack
+		FAULT_UNDEFINED,		// an opcode that doesn't exist
+		FAULT_SPRITE_BOUNDS,	// Dxyn reading past the end of memory
+		FAULT_COUNT
+	};
+
+// why a machine stopped partway through run() - see is_halted()
+	enum halt {
+		HALT_NONE,
+		HALT_KEY,	// Fx0A with no key yet - lasts until the keypad changes
+		HALT_IDLE,	// spinning in a loop only a timer tick can end - lasts until the next one
+		HALT_SOUND,	// Fx18 just set the sound timer - run() notes when, then carries on
+		HALT_EXIT	// 00FD - the rom is done, for good
+	};
+
+// sound timer writes kept for the buzzer between frames - any past this only count through
+// the timer's value at the end of the frame
+#define SOUND_WRITES 8
+
+// one Fx18 - the value it set, and the instruction count it happened at
+	struct sound_write {
+		uint64_t at;
+		uint8_t  value;
+	};
+
+// a predecoded instruction - the handler to run and every operand it could need
+	struct chip8_machine;
+	struct decoded;
+	typedef void (*op_handler)(struct chip8_machine* m, const struct decoded* d);
+
+	struct decoded {
+		op_handler handler;
+		uint16_t   instr;	// the raw opcode
+		uint16_t   nnn;		// last 3 digits
+		uint8_t    nn;		// last 2 digits
+		uint8_t    x;		// second digit
+		uint8_t    y;		// third digit
+		uint8_t    n;		// fourth digit
+		uint8_t    skip;	// bytes a taken skip jumps - 4 over an XO-CHIP F000 NNNN, else 2
+		uint16_t   next;	// the word after this one - the address F000 NNNN loads
+		bool       branch;	// can move pc somewhere other than the next instruction - ends a basic block
+	};
+
+// everything one chip-8 needs - any number of these can run side by side
+	struct chip8_machine {
+	// array for display - one screen per bitplane, two words per row, the most significant bit of
+	// the first word is the leftmost pixel
+		uint64_t screen[PLANES][SCREEN_HEIGHT][2];
+		uint64_t dirty_rows;	// bit r is set when row r has changed since the frontend last drew it
+	
+	// instruction set and quirks, and the display state the extra instructions change
+		enum mode   mode;
+		bool        hires;		// 128x64 - otherwise 64x32, in the top-left corner of screen[]
+		uint8_t     planes;		// bitplanes drawing, clearing and scrolling work on - bit p for plane p
+		enum quirks quirks;		// which platform's take on the instructions they share
+	
+	// SUPER-CHIP flag registers for Fx75 / Fx85, and the XO-CHIP audio pattern and pitch
+		uint8_t flags[16];
+		uint8_t pattern[16];
+		uint8_t pitch;
+
+	// array for keypad inputs
+		bool keypad[16];		// whether this key is pressed now
+
+	// memory - 64kb, though only XO-CHIP roms can reach past the first 4
+		uint8_t mem[MEMORY_SIZE];
+
+	// size of the rom
+		long size;
+
+	// current instruction - only kept up to date by step()
+		uint16_t instr;
+		uint8_t  first;
+		uint8_t  second;
+		uint8_t  third;
+		uint8_t  fourth;
+		uint8_t  last_2;
+		uint16_t last_3;
+
+	// 16 bit registers - program index, memory index
+		uint16_t pc;
+		uint16_t i;
+
+	// general purpose 8-bit registers
+		uint8_t v[16];
+
+	// stack - holds 12 addresses
+		uint16_t stack[12];
+		short    stack_addr;
+
+	// 8 bit timers - delay, sound
+		uint8_t delay;
+		uint8_t sound;
+
+	// key held down during Fx0A - the instruction finishes once this key is released
+		uint8_t held_key;
+	
+	// set when running would only repeat itself until something outside the machine changes
+		enum halt halted;
+		uint16_t  halted_keys;	// keypad when Fx0A came up empty
+		uint8_t   idle_cycle;	// instructions in one lap of the idle loop
+		uint64_t  idle_skips;	// how many times laps of an idle loop were skipped
+		bool      never_skip;	// never halt on Fx0A or an idle loop, so every instruction really runs - for timing
+	
+	// instructions run() has been asked for, including ones spent waiting or skipped in idle loops -
+	// the machine's own clock, which the buzzer places sound timer writes on
+		uint64_t           executed;
+		struct sound_write sound_writes[SOUND_WRITES];
+		uint8_t            sound_write_count;	// since the buzzer last took them - see audio.h
+		uint64_t           skipped;				// the part of executed that halts dropped or skipped
+
+	// random number state for Cxkk - each machine has its own so runs are reproducible
+		uint32_t rng;
+
+	// first thing that went wrong, and whether to keep quiet about it
+		enum fault fault;
+		bool       quiet;
+
+	// which execution path run() uses
+		enum engine engine;
+
+	// one predecoded instruction per even address code can run from
+		struct decoded decoded[CODE_SIZE / 2];
+
+	// caches owned by block.c, jit.c and aot.c, made the first time they're needed
+		struct block_cache* blocks;
+		struct jit_cache*   jit;
+		struct aot*         aot;
+	
+	// when set, every instruction is recorded or counted instead of running on the engine - see
+	// trace.h, profile.h and fuzz.h. whoever sets them frees them
+		struct trace*    trace;
+		struct profile*  profile;
+		struct coverage* coverage;
+	};
+
+// whether the pixel at (x, y) is on in plane p
+static inline bool get_pixel(const struct chip8_machine* m, int p, int x, int y) {
+	return (m->screen[p][y][x >> 6] >> (63 - (x & 63))) & 1;
+}
+
+// size of the display in the current resolution
+static inline int screen_width(const struct chip8_machine* m) {
+	return 64 << m->hires;
+}
+
+static inline int screen_height(const struct chip8_machine* m) {
+	return 32 << m->hires;
+}
+
+// memory the current mode can address - 4 kb, or all of it for XO-CHIP
+static inline uint32_t memory_size(const struct chip8_machine* m) {
+	return m->mode == MODE_XOCHIP ? MEMORY_SIZE : 0x1000;
+}
+
+// MACHINES
+struct chip8_machine* machine_create(uint32_t seed);
+void machine_destroy(struct chip8_machine* m);
+
+// HOUSEKEEPING FUNCTIONS
+void copy_fonts(struct chip8_machine* m);
+void set_mode(struct chip8_machine* m, enum mode mode);
+enum mode mode_for_file(const char* name);
+enum quirks quirks_for_mode(enum mode mode);
+void set_quirks(struct chip8_machine* m, enum quirks quirks);
+bool open_file(struct chip8_machine* m, char* name);
+bool load_rom(struct chip8_machine* m, const char* name, const uint8_t* rom, long size);
+void decrement_timers(struct chip8_machine* m);
+
+// DECODE STAGE
+void format_instruction(uint16_t instr, char* out, size_t size);
+void print_instruction(struct chip8_machine* m);
+
+// HELPER FUNCTIONS FOR EXECUTION
+void clear_screen(struct chip8_machine* m);
+void draw_instr(struct chip8_machine* m, uint8_t x_coord, uint8_t y_coord, uint8_t num_rows);
+void draw_instr_wrap(struct chip8_machine* m, uint8_t x_coord, uint8_t y_coord, uint8_t num_rows);
+void scroll_down(struct chip8_machine* m, uint8_t rows);
+void scroll_up(struct chip8_machine* m, uint8_t rows);
+void scroll_right(struct chip8_machine* m);
+void scroll_left(struct chip8_machine* m);
+void set_hires(struct chip8_machine* m, bool hires);
+void wait_for_key(struct chip8_machine* m, uint8_t reg);
+bool is_halted(const struct chip8_machine* m);
+void raise_fault(struct chip8_machine* m, enum fault f, const char* message);
+
+// EXECUTE STAGE
+void execute_instruction(struct chip8_machine* m);
+void step(struct chip8_machine* m);
+
+// PREDECODED EXECUTION
+void invalidate(struct chip8_machine* m, uint32_t addr, uint32_t len);
+void step_decoded(struct chip8_machine* m);
+
+// ENGINE SELECTION
+bool parse_engine(const char* name, enum engine* out);
+const char* engine_name(enum engine e);
+bool parse_mode(const char* name, enum mode* out);
+const char* mode_name(enum mode mode);
+bool parse_quirks(const char* name, enum quirks* out);
+const char* quirks_name(enum quirks quirks);
+uint8_t quirk_set(enum quirks quirks);
+const char* fault_name(enum fault f);
+void run(struct chip8_machine* m, uint32_t n);
+void run_frame(struct chip8_machine* m, uint32_t instructions);
+
+// hash of the display, used to compare runs
+uint64_t screen_hash(const struct chip8_machine* m);
+
+#endif
@@ -0,0 +1,620 @@
+// FUZZER
+// the rom is loaded into a boot machine once, and every run starts by copying it back into the
+// machine that runs: the screen, registers and the rest of the small state whole, and of memory
+// only what a store could have reached since the last run, with the instructions decoded from
+// it. nothing is loaded or decoded again, so a run costs about what its instructions do.
+// edges are counted the way afl counts them - each pc is hashed, and an edge is where it came
+// from xored with where it went. counts go into buckets (1, 2, 3, 4-7, ... 128+), and a run is
+// kept when it takes an edge, or takes one a number of times, that no run has before. only the
+// edges a run took are looked at and cleared afterwards, so a short run doesn't pay for the map
+
+// C LIBRARIES
+#include <time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+
+#include "core.h"
+#include "fuzz.h"
+
+// an input is a seed for Cxkk, then 2 bytes of keypad per frame - bit k is key k
+#define SEED_BYTES 4
+#define MAX_FRAMES 128
+#define MAX_INPUT  (SEED_BYTES + 2 * MAX_FRAMES)
+
+// frames in the input the fuzzer starts from, with no keys pressed
+#define FIRST_FRAMES 32
+
+// inputs the corpus can hold - once it's full, finds still count but aren't kept
+#define MAX_CORPUS 4096
+
+// faults saved, each kind at each address once
+#define MAX_CRASHES 256
+
+// most changes made to an input at once
+#define MAX_MUTATIONS 8
+
+#define DEFAULT_SECONDS 10
+
+// Fx33, Fx55 and 5xy2 store at most this many bytes from i
+#define MAX_STORE 16
+
+// reset() copies the machine around its memory and decoded instructions in two pieces
+_Static_assert(offsetof(struct chip8_machine, mem) < offsetof(struct chip8_machine, size)
+            && offsetof(struct chip8_machine, size) < offsetof(struct chip8_machine, decoded),
+               "reset() expects the machine's fields in this order");
+
+	struct input {
+		uint8_t  data[MAX_INPUT];
+		uint16_t size;
+	};
+	
+	struct fuzzer {
+		struct chip8_machine* machine;
+		struct chip8_machine* boot;			// right after loading - never runs
+		struct coverage       coverage;
+		uint32_t              per_frame;
+	
+	// every bucket any run has reached for each edge, one bit per bucket
+		uint8_t  seen[COVERAGE_EDGES];
+		uint32_t edge_count;
+		
+		struct input* corpus;
+		uint32_t      corpus_count;
+		
+		uint32_t crashes[MAX_CRASHES];		// fault << 16 | pc
+		uint32_t crash_count;
+	
+	// instructions a static walk from 0x200 reaches - bit a for address a
+		uint64_t reachable[MEMORY_SIZE / 64];
+		uint32_t reachable_count;
+		
+		uint64_t rng;	// for mutations - separate from the machine's
+	};
+
+// the bucket each count goes in
+	static uint8_t buckets[256];
+
+// current time in seconds
+static double now() {
+	struct timespec ts;
+	timespec_get(&ts, TIME_UTC);
+	
+	return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
+
+// COVERAGE
+// hash of a pc, COVERAGE_BITS wide - neighbouring addresses land far apart
+static inline uint16_t location(uint16_t pc) {
+	return (uint16_t) ((pc * 2654435761u) >> (32 - COVERAGE_BITS));
+}
+
+// a store is about to go to i - reset() has to put back what it can reach
+static void note_store(struct coverage* c, uint16_t i) {
+	uint32_t end = i + MAX_STORE;
+	
+	// stores wrap around to address 0 past the end of memory
+	if (end > MEMORY_SIZE) {
+		c->written_low  = 0;
+		c->written_high = MEMORY_SIZE;
+		return;
+	}
+	
+	c->written_low  = i < c->written_low ? i : c->written_low;
+	c->written_high = end > c->written_high ? end : c->written_high;
+}
+
+// while a machine has coverage, run() goes through here one instruction at a time
+uint32_t run_covered(struct chip8_machine* m, uint32_t n) {
+	struct coverage* c = m->coverage;
+	
+	for (; n > 0 && !m->halted; n--) {
+		uint16_t pc  = m->pc;
+		uint16_t op  = m->mem[pc] << 8 | m->mem[(uint16_t) (pc + 1)];
+		uint16_t loc = location(pc);
+		uint16_t e   = loc ^ c->previous;
+		
+		// counts stop at 255 instead of wrapping back into a low bucket
+		uint8_t count = c->edges[e];
+		
+		if (count == 0) {
+			c->taken[c->taken_count++] = e;
+		}
+		
+		c->edges[e]      = count + (count != 0xFF);
+		c->previous      = loc >> 1;
+		c->pcs[pc >> 6] |= 1ULL << (pc & 63);
+		
+		if ((op & 0xF0FF) == 0xF033 || (op & 0xF0FF) == 0xF055 || (op & 0xF00F) == 0x5002) {
+			note_store(c, m->i);
+		}
+		
+		enum fault before = m->fault;
+		step_decoded(m);
+		
+		if (m->fault != before) {
+			c->fault_pc = pc;
+		}
+	}
+	
+	return n;
+}
+
+// puts the machine back the way it was after loading
+static void reset(struct fuzzer* f) {
+	struct chip8_machine*       m    = f->machine;
+	const struct chip8_machine* boot = f->boot;
+	struct coverage*            c    = &f->coverage;
+	
+	if (c->written_low < c->written_high) {
+		uint32_t low  = c->written_low;
+		uint32_t high = c->written_high;
+		
+		memcpy(&m->mem[low], &boot->mem[low], high - low);
+		
+		// each entry is decoded from its own word and the one after it
+		uint32_t first = (low >= 2 ? low - 2 : 0) >> 1;
+		uint32_t last  = (high + 1) >> 1;
+		last = last < CODE_SIZE / 2 ? last : CODE_SIZE / 2;
+		
+		if (first < last) {
+			memcpy(&m->decoded[first], &boot->decoded[first], (last - first) * sizeof(struct decoded));
+		}
+	}
+	
+	// everything else but the caches and hooks at the end goes back whole
+	memcpy(m, boot, offsetof(struct chip8_machine, mem));
+	memcpy(&m->size, &boot->size, offsetof(struct chip8_machine, decoded) - offsetof(struct chip8_machine, size));
+	
+	for (uint32_t t = 0; t < c->taken_count; t++) {
+		c->edges[c->taken[t]] = 0;
+	}
+	
+	c->taken_count  = 0;
+	c->previous     = 0;
+	c->written_low  = MEMORY_SIZE;
+	c->written_high = 0;
+}
+
+// runs an input from the boot state, until its frames run out, it faults or the rom exits
+static enum fault run_input(struct fuzzer* f, const struct input* in) {
+	struct chip8_machine* m = f->machine;
+	reset(f);
+	
+	uint32_t seed = in->data[0] | in->data[1] << 8 | in->data[2] << 16 | (uint32_t) in->data[3] << 24;
+	m->rng = seed ? seed : 1;
+	
+	int frames = (in->size - SEED_BYTES) / 2;
+	
+	for (int fr = 0; fr < frames && m->fault == FAULT_NONE && m->halted != HALT_EXIT; fr++) {
+		uint16_t keys = in->data[SEED_BYTES + 2 * fr] | in->data[SEED_BYTES + 2 * fr + 1] << 8;
+		
+		for (int k = 0; k < 16; k++) {
+			m->keypad[k] = keys >> k & 1;
+		}
+		
+		run_frame(m, f->per_frame);
+	}
+	
+	return m->fault;
+}
+
+// folds the last run's edges into what's been seen - true if any of them reached a new bucket
+static bool new_coverage(struct fuzzer* f) {
+	const struct coverage* c = &f->coverage;
+	bool found = false;
+	
+	for (uint32_t t = 0; t < c->taken_count; t++) {
+		uint16_t e      = c->taken[t];
+		uint8_t  bucket = buckets[c->edges[e]];
+		
+		if (bucket & ~f->seen[e]) {
+			f->edge_count += f->seen[e] == 0;
+			f->seen[e]    |= bucket;
+			found = true;
+		}
+	}
+	
+	return found;
+}
+
+// instructions that have run so far that a static walk reaches too
+static uint32_t covered_count(const struct fuzzer* f) {
+	uint32_t count = 0;
+	
+	for (int w = 0; w < MEMORY_SIZE / 64; w++) {
+		count += __builtin_popcountll(f->coverage.pcs[w] & f->reachable[w]);
+	}
+	
+	return count;
+}
+
+// REACHABLE CODE
+// every instruction a walk from 0x200 gets to through the decoded instructions, following jumps,
+// calls and both ways out of skips - Bnnn targets and returns are only known while running
+	static uint16_t pending[CODE_SIZE / 2];
+	static int      pending_count;
+
+static void reach(struct fuzzer* f, uint32_t addr) {
+	uint32_t end = 0x200 + f->boot->size;
+	
+	if (addr & 1 || addr < 0x200 || addr + 2 > end || addr >= CODE_SIZE || f->reachable[addr >> 6] >> (addr & 63) & 1) {
+		return;
+	}
+	
+	f->reachable[addr >> 6] |= 1ULL << (addr & 63);
+	f->reachable_count++;
+	pending[pending_count++] = addr;
+}
+
+static void find_reachable(struct fuzzer* f) {
+	pending_count = 0;
+	reach(f, 0x200);
+	
+	while (pending_count > 0) {
+		uint16_t addr = pending[--pending_count];
+		const struct decoded* d = &f->boot->decoded[addr >> 1];
+		
+		if (!d->branch) {
+			reach(f, addr + 2);
+			continue;
+		}
+		
+		switch (d->instr >> 12) {
+			case 0x0:	// 00EE and 00FD
+			case 0xB:
+				break;
+			case 0x1:
+				reach(f, d->nnn);
+				break;
+			case 0x2:
+				reach(f, d->nnn);
+				reach(f, addr + 2);
+				break;
+			case 0xF:	// Fx0A, Fx18 - and F000, which goes on after its address
+				reach(f, d->instr == 0xF000 ? addr + 4 : addr + 2);
+				break;
+			default:	// skips
+				reach(f, addr + 2);
+				reach(f, addr + 2 + d->skip);
+		}
+	}
+}
+
+// MUTATIONS
+// xorshift64 - a number below n
+static uint32_t random_below(struct fuzzer* f, uint32_t n) {
+	f->rng ^= f->rng << 13;
+	f->rng ^= f->rng >> 7;
+	f->rng ^= f->rng << 17;
+	
+	return (uint32_t) ((f->rng >> 32) % n);
+}
+
+// makes a few changes to an input, each to the seed or to the frame at a random point
+static void mutate(struct fuzzer* f, struct input* in) {
+	uint32_t count = 1 + random_below(f, MAX_MUTATIONS);
+	
+	for (uint32_t c = 0; c < count; c++) {
+		uint32_t frames = (in->size - SEED_BYTES) / 2;
+		uint32_t at     = random_below(f, frames);
+		uint8_t* keys   = &in->data[SEED_BYTES + 2 * at];
+		uint8_t* end    = &in->data[in->size];
+		
+		switch (random_below(f, 7)) {
+			case 0: {	// one key, or none - most roms only ever look at one
+				uint32_t key = random_below(f, 17);
+				uint16_t bits = key < 16 ? 1 << key : 0;
+				keys[0] = bits & 0xFF;
+				keys[1] = bits >> 8;
+				break;
+			}
+			case 1: {	// the same keys held for a few more frames
+				uint32_t hold = 1 + random_below(f, 8);
+				
+				for (uint32_t k = 1; k <= hold && at + k < frames; k++) {
+					memcpy(&keys[2 * k], keys, 2);
+				}
+				break;
+			}
+			case 2: {	// a key pressed or let go
+				uint32_t key = random_below(f, 16);
+				keys[key >> 3] ^= 1 << (key & 7);
+				break;
+			}
+			case 3:		// a frame more
+				if (in->size + 2 <= MAX_INPUT) {
+					memmove(keys + 2, keys, end - keys);
+					in->size += 2;
+				}
+				break;
+			case 4:		// a frame less
+				if (frames > 1) {
+					memmove(keys, keys + 2, end - keys - 2);
+					in->size -= 2;
+				}
+				break;
+			case 5:		// other random numbers
+				in->data[random_below(f, SEED_BYTES)] = (uint8_t) random_below(f, 256);
+				break;
+			default: {	// the frames from here on out of another input
+				const struct input* other = &f->corpus[random_below(f, f->corpus_count)];
+				
+				if (other->size > SEED_BYTES + 2 * at) {
+					memcpy(keys, &other->data[SEED_BYTES + 2 * at], other->size - SEED_BYTES - 2 * at);
+					in->size = other->size;
+				}
+			}
+		}
+	}
+}
+
+// CRASHES
+// saves an input that faulted to [prefix][fault]-[pc].keys, unless that fault was found already
+static void save_crash(struct fuzzer* f, const struct input* in, const char* prefix) {
+	enum fault fault = f->machine->fault;
+	uint16_t   pc    = f->coverage.fault_pc;
+	uint32_t   key   = (uint32_t) fault << 16 | pc;
+	
+	for (uint32_t c = 0; c < f->crash_count; c++) {
+		if (f->crashes[c] == key) {
+			return;
+		}
+	}
+	
+	if (f->crash_count == MAX_CRASHES) {
+		return;
+	}
+	f->crashes[f->crash_count++] = key;
+	
+	// "stack overflow" -> "stack-overflow"
+	char kind[32];
+	snprintf(kind, sizeof(kind), "%s", fault_name(fault));
+	
+	for (char* c = kind; *c; c++) {
+		*c = *c == ' ' ? '-' : *c;
+	}
+	
+	char name[512];
+	snprintf(name, sizeof(name), "%s%s-%03x.keys", prefix, kind, pc);
+	
+	FILE* out = fopen(name, "wb");
+	
+	if (!out) {
+		LOG("couldn't save crash %s", name);
+		return;
+	}
+	
+	fwrite(in->data, 1, in->size, out);
+	fclose(out);
+	
+	printf("%s at 0x%03x - saved to %s\n", fault_name(fault), pc, name);
+}
+
+// RUNNING
+// frees a fuzzer, or whatever part of one got allocated
+static void fuzzer_destroy(struct fuzzer* f) {
+	if (!f) {
+		return;
+	}
+	
+	machine_destroy(f->boot);
+	machine_destroy(f->machine);
+	free(f->corpus);
+	free(f);
+}
+
+// a fuzzer for a rom, ready to run inputs - NULL if the rom wouldn't load
+static struct fuzzer* fuzzer_create(char* name, uint32_t per_frame) {
+	struct fuzzer* f = calloc(1, sizeof(struct fuzzer));
+	
+	if (!f) {
+		LOG("failed to allocate fuzzer");
+		return NULL;
+	}
+	
+	f->boot    = machine_create(1);
+	f->machine = calloc(1, sizeof(struct chip8_machine));	// zeroed, so it owns no caches until it's a copy
+	f->corpus  = calloc(MAX_CORPUS, sizeof(struct input));
+	
+	if (!f->boot || !f->machine || !f->corpus) {
+		LOG("failed to allocate fuzzer");
+		fuzzer_destroy(f);
+		return NULL;
+	}
+	
+	f->boot->quiet  = true;
+	f->boot->engine = ENGINE_DECODED;
+	
+	if (!open_file(f->boot, name)) {
+		fuzzer_destroy(f);
+		return NULL;
+	}
+	
+	clear_screen(f->boot);
+	
+	// the boot machine never runs, so it has no caches for the copy to share
+	memcpy(f->machine, f->boot, sizeof(struct chip8_machine));
+	f->machine->coverage = &f->coverage;
+	
+	f->per_frame = per_frame;
+	f->rng       = 0x9E3779B97F4A7C15ULL;
+	
+	for (int c = 1; c < 256; c++) {
+		buckets[c] = c == 1 ? 1 : c == 2 ? 2 : c == 3 ? 4 : c < 8 ? 8 : c < 16 ? 16 : c < 32 ? 32 : c < 128 ? 64 : 128;
+	}
+	
+	find_reachable(f);
+	
+	return f;
+}
+
+// reads an input saved by save_crash() - false if it isn't one
+static bool read_input(const char* name, struct input* in) {
+	FILE* file = fopen(name, "rb");
+	
+	if (!file) {
+		LOG("couldn't open input %s", name);
+		return false;
+	}
+	
+	size_t size = fread(in->data, 1, MAX_INPUT, file);
+	fclose(file);
+	
+	// a seed and at least one frame, and no half frames
+	if (size < SEED_BYTES + 2) {
+		LOG("%s is too short to be an input", name);
+		return false;
+	}
+	
+	in->size = (uint16_t) (size - (size - SEED_BYTES) % 2);
+	
+	return true;
+}
+
+// runs one saved input and says how it went
+static int replay(struct fuzzer* f, const char* name) {
+	struct input in;
+	
+	if (!read_input(name, &in)) {
+		return -1;
+	}
+	
+	enum fault fault = run_input(f, &in);
+	
+	printf("frames:        %d\n", (in.size - SEED_BYTES) / 2);
+	printf("instructions:  %llu\n", (unsigned long long) f->machine->executed);
+	printf("fault:         %s", fault_name(fault));
+	
+	if (fault != FAULT_NONE) {
+		printf(" at 0x%03x", f->coverage.fault_pc);
+	}
+	
+	printf("\nscreen hash:   %016llx\n", (unsigned long long) screen_hash(f->machine));
+	printf("code covered:  %u of %u reachable instructions\n", covered_count(f), f->reachable_count);
+	
+	return fault != FAULT_NONE;
+}
+
+static void report(const struct fuzzer* f, double elapsed, uint64_t execs) {
+	printf("%5.0fs  %10llu execs  %8.0f execs/sec  corpus %4u  edges %5u  code %4u of %4u  crashes %u\n",
+	       elapsed, (unsigned long long) execs, execs / (elapsed > 0 ? elapsed : 1e-9), f->corpus_count,
+	       f->edge_count, covered_count(f), f->reachable_count, f->crash_count);
+}
+
+int run_fuzz(int argc, char** argv) {
+	// argv -> ['chip-8.exe', '--fuzz', rom name, seconds, instructions per frame, crash file prefix]
+	//      or ['chip-8.exe', '--fuzz', rom name, 'replay', input file, instructions per frame]
+	if (argc < 3) {
+		LOG("usage: ./chip-8.exe --fuzz [rom] [seconds] [instructions per frame] [crash file prefix]");
+		LOG("       ./chip-8.exe --fuzz [rom] replay [input file] [instructions per frame]");
+		return -1;
+	}
+	
+	bool replaying = argc > 4 && strcmp(argv[3], "replay") == 0;
+	
+	int      per_frame_arg = replaying ? 5 : 4;
+	uint32_t per_frame     = argc > per_frame_arg ? (uint32_t) strtoul(argv[per_frame_arg], NULL, 10) : INSTRUCTIONS_PER_FRAME;
+	double   seconds       = argc > 3 && !replaying ? strtod(argv[3], NULL) : DEFAULT_SECONDS;
+	const char* prefix     = argc > 5 && !replaying ? argv[5] : "crash-";
+	
+	struct fuzzer* f = fuzzer_create(argv[2], per_frame ? per_frame : INSTRUCTIONS_PER_FRAME);
+	
+	if (!f) {
+		return -1;
+	}
+	
+	if (replaying) {
+		int result = replay(f, argv[4]);
+		fuzzer_destroy(f);
+		
+		return result;
+	}
+	
+	// start from a run that presses nothing, with the seed the other runners use
+	struct input first = {{1}, SEED_BYTES + 2 * FIRST_FRAMES};
+	
+	if (run_input(f, &first) != FAULT_NONE) {
+		save_crash(f, &first, prefix);
+	}
+	new_coverage(f);
+	f->corpus[f->corpus_count++] = first;
+	
+	double   start       = now();
+	double   next_report = start + 1;
+	uint64_t execs       = 1;
+	
+	while (true) {
+		// the clock is only looked at every so often - a run can take less time than reading it
+		if (execs % 1024 == 0) {
+			double t = now();
+			
+			if (t - start >= seconds) {
+				break;
+			}
+			if (t >= next_report) {
+				report(f, t - start, execs);
+				next_report += 1;
+			}
+		}
+		
+		struct input in = f->corpus[random_below(f, f->corpus_count)];
+		mutate(f, &in);
+		
+		enum fault fault = run_input(f, &in);
+		execs++;
+		
+		if (fault != FAULT_NONE) {
+			save_crash(f, &in, prefix);
+		} else if (new_coverage(f) && f->corpus_count < MAX_CORPUS) {
+			f->corpus[f->corpus_count++] = in;
+		}
+	}
+	
+	report(f, now() - start, execs);
+	
+	int result = f->crash_count > 0;
+	fuzzer_destroy(f);
+	
+	return result;
+}
+
+#ifdef LIBFUZZER
+// LIBFUZZER
+// clang -fsanitize=fuzzer,address -DLIBFUZZER with the core (make chip-8-libfuzzer) builds a
+// harness libFuzzer - or afl++, which takes the same entry point - drives instead. then the
+// coverage is of the emulator's own code, and the sanitizers catch its bugs. a rom's faults aren't
+// the emulator's, so they don't count as crashes here. the rom comes from CHIP8_FUZZ_ROM
+	static struct fuzzer* shared;
+
+int LLVMFuzzerInitialize(int* argc, char*** argv) {
+	(void) argc;
+	(void) argv;
+	
+	char* name = getenv("CHIP8_FUZZ_ROM");
+	shared = fuzzer_create(name ? name : "roms/ibm_logo.ch8", INSTRUCTIONS_PER_FRAME);
+	
+	if (!shared) {
+		exit(1);
+	}
+	
+	return 0;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+	struct input in;
+	
+	if (size < SEED_BYTES + 2) {
+		return 0;
+	}
+	
+	size = size < MAX_INPUT ? size : MAX_INPUT;
+	in.size = (uint16_t) (size - (size - SEED_BYTES) % 2);
+	memcpy(in.data, data, in.size);
+	
+	run_input(shared, &in);
+	
+	return 0;
+}
+#endif
@@ -0,0 +1,37 @@
+// FUZZER
+// coverage-guided fuzzing of the key presses and random numbers a rom sees. an input is a seed
+// for Cxkk, then the keypad for each frame - the fuzzer changes inputs that found new edges
+// between instructions, and keeps the ones that find more. runs that fault are saved to replay
+#ifndef FUZZ_H
+#define FUZZ_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "core.h"
+
+// counters edges are hashed into - a rom has at most 2048 instructions, so collisions are rare
+#define COVERAGE_BITS  14
+#define COVERAGE_EDGES (1 << COVERAGE_BITS)
+
+// while a machine has one, run() goes through run_covered() one instruction at a time
+	struct coverage {
+		uint8_t  edges[COVERAGE_EDGES];		// times each edge was taken since the last reset
+		uint16_t taken[COVERAGE_EDGES];		// the edges that aren't 0, in the order they were first taken
+		uint32_t taken_count;
+		uint16_t previous;					// hashed pc of the instruction before, shifted right by 1
+		uint64_t pcs[MEMORY_SIZE / 64];		// bit a is set once an instruction at a has run - never reset
+		uint16_t fault_pc;					// where the machine's fault was raised
+	
+	// memory stores could have changed since the last reset, empty if written_low >= written_high
+		uint32_t written_low;
+		uint32_t written_high;
+	};
+
+uint32_t run_covered(struct chip8_machine* m, uint32_t n);
+
+// argv -> ['chip-8.exe', '--fuzz', rom name, seconds, instructions per frame, crash file prefix]
+//      or ['chip-8.exe', '--fuzz', rom name, 'replay', input file, instructions per frame]
+int run_fuzz(int argc, char** argv);
+
+#endif
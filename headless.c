@@ -0,0 +1,160 @@
+// HEADLESS RUNNER
+// runs a rom with no window, no input and no delays, then prints throughput numbers and a
+// hash of the final screen so that interpreter speed can be tracked between releases
+
+// C LIBRARIES
+#include <time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "core.h"
+#include "headless.h"
+#include "trace.h"
+#include "audio.h"
+#include "capture.h"
+
+// default length of a run, in frames
+#define DEFAULT_FRAMES 600
+
+// current time in seconds - timespec_get is the only portable high resolution clock in C11
+static double now() {
+	struct timespec ts;
+	timespec_get(&ts, TIME_UTC);
+	
+	return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
+
+int run_headless(int argc, char** argv) {
+	// argv -> ['chip-8.exe', '--bench', rom name, 'frames' or 'instructions', count, engine, (optional) quirks, trace, .wav and/or .y4m or .gif file]
+	char* name       = argc > 2 ? argv[2] : NULL;
+	bool  by_frames  = argc > 3 ? strcmp("instructions", argv[3]) != 0 : true;
+	uint64_t count   = argc > 4 ? strtoull(argv[4], NULL, 10) : DEFAULT_FRAMES;
+	
+	enum engine engine = ENGINE_BLOCKS;
+	
+	if (argc > 5 && !parse_engine(argv[5], &engine)) {
+		LOG("unknown engine: %s (try interpreter, decoded, blocks, jit or aot)", argv[5]);
+		return -1;
+	}
+	
+	// fixed seed so that the final screen hash is the same on every run
+	struct chip8_machine* m = machine_create(1);
+	
+	if (!m) {
+		return -1;
+	}
+	
+	m->engine = engine;
+	
+	if (!open_file(m, name)) {
+		machine_destroy(m);
+		return -1;
+	}
+	
+	// what goes last is in any order - a profile's name runs the rom with its quirks, a .wav gets
+	// the sound, a .y4m or .gif every frame, anything else a trace of every instruction (the
+	// engine is bypassed while tracing, so that measures the tracer)
+	static struct buzzer buzzer;
+	struct wav* wav = NULL;
+	struct capture* capture = NULL;
+	
+	// white on black with the shades between for the second plane, like the window's default colors
+	static const uint32_t palette[4] = {0xFF000000, 0xFFFFFFFF, 0xFF555555, 0xFFAAAAAA};
+	
+	for (int a = 6; a < argc && a < 10; a++) {
+		size_t length = strlen(argv[a]);
+		bool   opened;
+		enum quirks quirks;
+		
+		// one file of each kind - a second would take the place of the first without closing it
+		if (parse_quirks(argv[a], &quirks)) {
+			set_quirks(m, quirks);
+			opened = true;
+		} else if (length > 4 && strcmp(".wav", argv[a] + length - 4) == 0) {
+			opened = !wav && (wav = wav_open(argv[a])) != NULL;
+		} else if (is_capture_file(argv[a])) {
+			// nothing is waiting on the screen, so the emulator waits for the encoder instead of dropping frames
+			opened = !capture && (capture = capture_open(argv[a], m, palette, false)) != NULL;
+		} else {
+			opened = !m->trace && (m->trace = trace_open(argv[a])) != NULL;
+		}
+		
+		if (!opened) {
+			LOG("couldn't use %s - it can't be opened, or there's already a file like it", argv[a]);
+			trace_close(m->trace);
+			wav_close(wav);
+			capture_close(capture);
+			machine_destroy(m);
+			return -1;
+		}
+	}
+	
+	if (wav) {
+		buzzer_init(&buzzer, m);
+	}
+	
+	clear_screen(m);
+	
+	// instructions to run in total
+	uint64_t total = by_frames ? count * INSTRUCTIONS_PER_TICK : count;
+	uint64_t frames = 0;
+	
+	double start = now();
+	
+	// run a frame's worth of instructions at a time, the timers tick at the end of each frame
+	for (uint64_t left = total; left > 0;) {
+		uint32_t batch = left < INSTRUCTIONS_PER_TICK ? left : INSTRUCTIONS_PER_TICK;
+		
+		run(m, batch);
+		left -= batch;
+		
+		if (batch == INSTRUCTIONS_PER_TICK) {
+			frames++;
+			decrement_timers(m);
+			
+			// each frame is 1/60 of a second of sound, however fast it ran
+			if (wav) {
+				wav_write(wav, buzzer_frame(&buzzer, m), AUDIO_FRAME);
+			}
+			
+			if (capture) {
+				capture_frame(capture, m);
+			}
+		}
+	}
+	
+	// the last records are only on disk once the trace is closed
+	trace_close(m->trace);
+	m->trace = NULL;
+	wav_close(wav);
+	capture_close(capture);
+	
+	double elapsed = now() - start;
+	
+	// guard against dividing by zero on very short runs
+	if (elapsed <= 0) {
+		elapsed = 1e-9;
+	}
+	
+	// one value per line, so scripts can grep for what they need
+	printf("rom:              %s\n",    name ? name : "roms/ibm_logo.ch8");
+	printf("mode:             %s\n",    mode_name(m->mode));
+	printf("quirks:           %s\n",    quirks_name(m->quirks));
+	printf("engine:           %s\n",    engine_name(m->engine));
+	// halts and idle loops use up instructions without running them, so they don't count towards the speed
+	uint64_t ran = m->executed - m->skipped;
+	
+	printf("instructions:     %llu\n",  (unsigned long long) ran);
+	printf("skipped:          %llu\n",  (unsigned long long) m->skipped);
+	printf("frames:           %llu\n",  (unsigned long long) frames);
+	printf("seconds:          %.6f\n",  elapsed);
+	printf("instructions/sec: %.0f\n",  ran / elapsed);
+	printf("frames/sec:       %.1f\n",  frames / elapsed);
+	printf("screen hash:      %016llx\n", (unsigned long long) screen_hash(m));
+	printf("idle skips:       %llu\n",  (unsigned long long) m->idle_skips);
+	
+	machine_destroy(m);
+	
+	return 0;
+}
@@ -0,0 +1,9 @@
+// HEADLESS RUNNER
+// runs a rom without SDL as fast as possible and reports how fast the core went
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+// argv -> ['chip-8.exe', '--bench', rom name, 'frames' or 'instructions', count, engine]
+int run_headless(int argc, char** argv);
+
+#endif
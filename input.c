@@ -0,0 +1,82 @@
+// INPUT QUEUE
+// the frontend polls its events once per frame and pushes the keypad changes here. the core
+// replays them one frame later, each at the instruction that lines up with when it happened
+// in its frame - so a key pressed a quarter of the way into a frame always reaches the rom a
+// quarter of the way through the next one, however long the host took to get around to it
+
+#include "core.h"
+#include "input.h"
+
+// PRODUCER
+// false if the queue is full - the event is dropped
+bool input_push(struct input_queue* q, struct key_event e) {
+	uint32_t head = atomic_load_explicit(&q->head, memory_order_relaxed);
+	uint32_t tail = atomic_load_explicit(&q->tail, memory_order_acquire);
+	
+	if (head - tail == INPUT_QUEUE_SIZE) {
+		return false;
+	}
+	
+	q->events[head & (INPUT_QUEUE_SIZE - 1)] = e;
+	
+	// publish the event only once it's written
+	atomic_store_explicit(&q->head, head + 1, memory_order_release);
+	
+	return true;
+}
+
+// CONSUMER
+// copies the oldest event into e without taking it, false if there are none
+bool input_peek(struct input_queue* q, struct key_event* e) {
+	uint32_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+	uint32_t head = atomic_load_explicit(&q->head, memory_order_acquire);
+	
+	if (head == tail) {
+		return false;
+	}
+	
+	*e = q->events[tail & (INPUT_QUEUE_SIZE - 1)];
+	
+	return true;
+}
+
+// takes the oldest event - only after input_peek() found one
+void input_pop(struct input_queue* q) {
+	uint32_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+	
+	// hand the slot back to the producer once it's been read
+	atomic_store_explicit(&q->tail, tail + 1, memory_order_release);
+}
+
+// applies every waiting event right now, whenever it happened
+void input_apply_all(struct input_queue* q, struct chip8_machine* m) {
+	struct key_event e;
+	
+	while (input_peek(q, &e)) {
+		m->keypad[e.key & 0xF] = e.down;
+		input_pop(q);
+	}
+}
+
+// runs one frame, applying each event from [frame_start, frame_start + frame_length) at the
+// instruction boundary that matches its time - older events go in before the first instruction,
+// newer ones stay queued for the next frame
+void run_frame_with_input(struct chip8_machine* m, struct input_queue* q, uint32_t instructions, uint64_t frame_start, uint64_t frame_length) {
+	uint32_t done = 0;
+	struct key_event e;
+	
+	while (input_peek(q, &e) && e.time < frame_start + frame_length) {
+		uint32_t at = e.time <= frame_start ? 0 : (uint32_t) ((e.time - frame_start) * instructions / frame_length);
+		
+		if (at > done) {
+			run(m, at - done);
+			done = at;
+		}
+		
+		m->keypad[e.key & 0xF] = e.down;
+		input_pop(q);
+	}
+	
+	run(m, instructions - done);
+	decrement_timers(m);
+}
@@ -0,0 +1,39 @@
+// INPUT QUEUE
+// keypad changes travel from the frontend to the core through a single-producer single-consumer
+// ring, each stamped with when it happened so the core can apply it at the matching instruction
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+// must be a power of two
+#define INPUT_QUEUE_SIZE 256
+
+struct chip8_machine;
+
+// one key going up or down
+	struct key_event {
+		uint64_t time;	// host time in ns
+		uint8_t  key;	// 0x0 - 0xF
+		bool     down;
+	};
+
+// the producer only writes head, the consumer only writes tail, so neither ever waits on a lock
+	struct input_queue {
+		_Atomic uint32_t head;	// next slot to fill
+		_Atomic uint32_t tail;	// next slot to read
+		struct key_event events[INPUT_QUEUE_SIZE];
+	};
+
+// PRODUCER
+bool input_push(struct input_queue* q, struct key_event e);
+
+// CONSUMER
+bool input_peek(struct input_queue* q, struct key_event* e);
+void input_pop(struct input_queue* q);
+void input_apply_all(struct input_queue* q, struct chip8_machine* m);
+void run_frame_with_input(struct chip8_machine* m, struct input_queue* q, uint32_t instructions, uint64_t frame_start, uint64_t frame_length);
+
+#endif
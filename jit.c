@@ -0,0 +1,468 @@
+// JIT
+// each basic block (see block.c) becomes one native function. while a block runs:
+//		rbx -> v[0]		r12 -> i		r13 -> pc
+// register and timer ops are emitted inline, everything else (draw, call, return, keys,
+// memory) calls the same handler the decoded engine would, with a pointer to its decoded[] entry
+
+#include "core.h"
+#include "block.h"
+#include "jit.h"
+
+#if JIT_SUPPORTED
+
+// C LIBRARIES
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+	typedef void (*jit_fn)(void);
+
+	struct jit_block {
+		jit_fn   code;		// NULL if this block needs compiling
+		uint16_t start;		// address of the first instruction
+		uint16_t end;		// address right after the last instruction
+		uint8_t  length;	// number of instructions
+	};
+
+	struct jit_cache {
+	// compiled blocks, looked up by their start address
+		struct jit_block blocks[CODE_SIZE / 2];
+	
+	// whether each decoded[] entry is inside some compiled block
+		bool covered[CODE_SIZE / 2];
+	
+	// the code, filled front to back - writable while compiling, executable the rest of the time
+		uint8_t* buffer;
+		uint32_t buffer_used;
+	
+	// block that is running right now, and whether it was invalidated while it ran
+		struct jit_block* running_block;
+		uint8_t           bailout;
+	};
+
+// most bytes a single instruction can compile to - plenty of headroom
+#define MAX_INSTRUCTION_BYTES 64
+
+// EMITTERS
+// where the next byte goes - one per thread, so machines on different threads can compile at once
+	static _Thread_local uint8_t* out;
+
+static void emit8(uint8_t b) {
+	*out++ = b;
+}
+
+static void emit16(uint16_t w) {
+	memcpy(out, &w, 2);
+	out += 2;
+}
+
+static void emit64(uint64_t q) {
+	memcpy(out, &q, 8);
+	out += 8;
+}
+
+// emits count bytes
+static void emit(int count, ...) {
+	va_list bytes;
+	va_start(bytes, count);
+	
+	for (int a = 0; a < count; a++) {
+		emit8((uint8_t) va_arg(bytes, int));
+	}
+	
+	va_end(bytes);
+}
+
+// mov al, [rbx + reg]
+static void load_al(uint8_t reg) {
+	emit(3, 0x8A, 0x43, reg);
+}
+
+// mov [rbx + reg], al
+static void store_al(uint8_t reg) {
+	emit(3, 0x88, 0x43, reg);
+}
+
+// setcc byte [rbx + 0xF] - cc is the second opcode byte (0x92 = setc, 0x93 = setnc, 0x97 = seta)
+static void set_flag(uint8_t cc) {
+	emit(4, 0x0F, cc, 0x43, 0x0F);
+}
+
+// add word [r13], d->skip - the skip half of a skip instruction
+static void skip(const struct decoded* d) {
+	emit(6, 0x66, 0x41, 0x83, 0x45, 0x00, d->skip);
+}
+
+// mov rax, address - for globals the registers don't point at
+static void load_address(void* address) {
+	emit(2, 0x48, 0xB8);
+	emit64((uint64_t) (uintptr_t) address);
+}
+
+// epilogue: pop r13, pop r12, pop rbx, ret
+static void epilogue() {
+	emit(6, 0x41, 0x5D, 0x41, 0x5C, 0x5B, 0xC3);
+}
+
+// handler(m, d) through the decoded engine
+static void call_handler(struct chip8_machine* m, const struct decoded* d) {
+	emit(2, 0x48, 0xBF);	// mov rdi, m
+	emit64((uint64_t) (uintptr_t) m);
+	emit(2, 0x48, 0xBE);	// mov rsi, d
+	emit64((uint64_t) (uintptr_t) d);
+	load_address((void*) d->handler);
+	emit(2, 0xFF, 0xD0);	// call rax
+}
+
+// after a handler that writes memory - if it rewrote this block, stop here with pc on the next instruction
+static void check_bailout(struct chip8_machine* m, uint16_t next) {
+	load_address(&m->jit->bailout);
+	emit(3, 0x80, 0x38, 0x00);	// cmp byte [rax], 0
+	emit(2, 0x74, 13);			// je past the bailout
+	emit(5, 0x66, 0x41, 0xC7, 0x45, 0x00);	// mov word [r13], next
+	emit16(next);
+	epilogue();
+}
+
+// COMPILER
+// emits one instruction - next is the address right after it
+static void compile_instruction(struct chip8_machine* m, const struct decoded* d, uint16_t next) {
+	uint8_t x = d->x;
+	uint8_t y = d->y;
+	uint8_t quirks = quirk_set(m->quirks);
+	
+	switch (d->instr >> 12) {
+		case 0x1:	// jump - mov word [r13], nnn
+			// jumps that might close an idle loop go through their handler, which checks
+			if (d->nnn == next - 2 || d->nnn + 6 == next) {
+				break;
+			}
+			emit(5, 0x66, 0x41, 0xC7, 0x45, 0x00);
+			emit16(d->nnn);
+			return;
+		case 0x3:	// skip-equals immediate - cmp byte [rbx + x], nn / jne over the skip
+			emit(4, 0x80, 0x7B, x, d->nn);
+			emit(2, 0x75, 6);
+			skip(d);
+			return;
+		case 0x4:	// skip-not-equals immediate
+			emit(4, 0x80, 0x7B, x, d->nn);
+			emit(2, 0x74, 6);
+			skip(d);
+			return;
+		case 0x5:	// skip-equals register - cmp al, [rbx + y]
+			// XO-CHIP's 5xy2 writes memory, which might be this block
+			if (d->n == 0x2 && m->mode == MODE_XOCHIP) {
+				call_handler(m, d);
+				check_bailout(m, next);
+				return;
+			}
+			if (d->n != 0) {
+				break;
+			}
+			load_al(x);
+			emit(3, 0x3A, 0x43, y);
+			emit(2, 0x75, 6);
+			skip(d);
+			return;
+		case 0x6:	// load immediate - mov byte [rbx + x], nn
+			emit(4, 0xC6, 0x43, x, d->nn);
+			return;
+		case 0x7:	// add - add byte [rbx + x], nn
+			emit(4, 0x80, 0x43, x, d->nn);
+			return;
+		case 0x8:
+			switch (d->n) {
+				case 0x0:	// load register
+					load_al(y);
+					store_al(x);
+					return;
+				case 0x1:	// or, and, xor - op [rbx + x], al then zero vF, if the profile does
+				case 0x2:
+				case 0x3:
+					load_al(y);
+					emit(3, d->n == 0x1 ? 0x08 : d->n == 0x2 ? 0x20 : 0x30, 0x43, x);
+					if (quirks & QUIRK_VF_RESET) {
+						emit(4, 0xC6, 0x43, 0x0F, 0x00);
+					}
+					return;
+				case 0x4:	// add with carry - add al, [rbx + y] / setc vF
+					load_al(x);
+					emit(3, 0x02, 0x43, y);
+					store_al(x);
+					set_flag(0x92);
+					return;
+				case 0x5:	// subtract with !(borrow) - sub al, [rbx + y] / setnc vF
+					load_al(x);
+					emit(3, 0x2A, 0x43, y);
+					store_al(x);
+					set_flag(0x93);
+					return;
+				case 0x6:	// shift right - shr al, 1 / setc vF. vy or vx, whichever the profile shifts
+					load_al(quirks & QUIRK_SHIFT_VY ? y : x);
+					emit(2, 0xD0, 0xE8);
+					store_al(x);
+					set_flag(0x92);
+					return;
+				case 0x7:	// negated subtraction
+					load_al(y);
+					emit(3, 0x2A, 0x43, x);
+					store_al(x);
+					set_flag(0x93);
+					return;
+				case 0xE:	// shift left - shl al, 1 / setc vF
+					load_al(quirks & QUIRK_SHIFT_VY ? y : x);
+					emit(2, 0xD0, 0xE0);
+					store_al(x);
+					set_flag(0x92);
+					return;
+			}
+			break;
+		case 0x9:	// skip-not-equals register
+			load_al(x);
+			emit(3, 0x3A, 0x43, y);
+			emit(2, 0x74, 6);
+			skip(d);
+			return;
+		case 0xA:	// load to index - mov word [r12], nnn
+			emit(5, 0x66, 0x41, 0xC7, 0x04, 0x24);
+			emit16(d->nnn);
+			return;
+		case 0xF:
+			switch (d->nn) {
+				case 0x07:	// load delay register
+					load_address(&m->delay);
+					emit(2, 0x8A, 0x00);	// mov al, [rax]
+					store_al(x);
+					return;
+				case 0x15:	// set delay timer - mov rcx, address / mov [rcx], al
+					load_al(x);
+					emit(2, 0x48, 0xB9);
+					emit64((uint64_t) (uintptr_t) &m->delay);
+					emit(2, 0x88, 0x01);
+					return;
+				case 0x1E:	// add to index - i += v[x], then vF = i > 0xFFF
+					// the other modes leave vF alone
+					if (m->mode != MODE_CHIP8) {
+						break;
+					}
+					emit(4, 0x0F, 0xB6, 0x43, x);				// movzx eax, byte [rbx + x]
+					emit(5, 0x66, 0x41, 0x03, 0x04, 0x24);		// add ax, [r12]
+					emit(5, 0x66, 0x41, 0x89, 0x04, 0x24);		// mov [r12], ax
+					emit(4, 0x66, 0x3D, 0xFF, 0x0F);			// cmp ax, 0xFFF
+					set_flag(0x97);
+					return;
+				case 0x33:	// these write memory, which might be this block
+				case 0x55:
+					call_handler(m, d);
+					check_bailout(m, next);
+					return;
+			}
+			break;
+	}
+	
+	// everything else goes through its handler
+	call_handler(m, d);
+}
+
+// the buffer is never writable and executable at once - false if it can't be switched
+static bool set_writable(struct jit_cache* cache, bool writable) {
+	return mprotect(cache->buffer, JIT_BUFFER_SIZE, writable ? PROT_READ | PROT_WRITE : PROT_READ | PROT_EXEC) == 0;
+}
+
+// compiles the block starting at start - NULL if the buffer can't be written and run
+static struct jit_block* compile(struct chip8_machine* m, uint16_t start) {
+	struct jit_cache* cache = m->jit;
+	
+	if (!set_writable(cache, true)) {
+		return NULL;
+	}
+	
+	// out of room - throw everything away and start over
+	if (cache->buffer_used + MAX_BLOCK_LENGTH * MAX_INSTRUCTION_BYTES + MAX_INSTRUCTION_BYTES > JIT_BUFFER_SIZE) {
+		memset(cache->blocks, 0, sizeof(cache->blocks));
+		memset(cache->covered, 0, sizeof(cache->covered));
+		cache->buffer_used = 0;
+	}
+	
+	struct jit_block* b = &cache->blocks[start >> 1];
+	out = cache->buffer + cache->buffer_used;
+	b->code = (jit_fn) (void*) out;
+	
+	// prologue: push rbx, push r12, push r13, then point them at v, i and pc
+	emit(5, 0x53, 0x41, 0x54, 0x41, 0x55);
+	emit(2, 0x48, 0xBB);
+	emit64((uint64_t) (uintptr_t) m->v);
+	emit(2, 0x49, 0xBC);
+	emit64((uint64_t) (uintptr_t) &m->i);
+	emit(2, 0x49, 0xBD);
+	emit64((uint64_t) (uintptr_t) &m->pc);
+	
+	// find the end of the block first, so pc can be set to it up front like in block.c
+	uint32_t end = start;
+	uint8_t length = 0;
+	
+	while (length < MAX_BLOCK_LENGTH && end < CODE_SIZE) {
+		length++;
+		end += 2;
+		
+		if (m->decoded[(end - 2) >> 1].branch) {
+			break;
+		}
+	}
+	
+	// mov word [r13], end
+	emit(5, 0x66, 0x41, 0xC7, 0x45, 0x00);
+	emit16(end);
+	
+	for (uint32_t addr = start; addr < end; addr += 2) {
+		cache->covered[addr >> 1] = true;
+		compile_instruction(m, &m->decoded[addr >> 1], addr + 2);
+	}
+	
+	epilogue();
+	
+	b->start  = start;
+	b->end    = end;
+	b->length = length;
+	cache->buffer_used = out - cache->buffer;
+	
+	if (!set_writable(cache, false)) {
+		b->code = NULL;
+		return NULL;
+	}
+	
+	return b;
+}
+
+// drops every compiled block that holds an instruction in [start, end)
+void invalidate_jit(struct chip8_machine* m, uint32_t start, uint32_t end) {
+	struct jit_cache* cache = m->jit;
+	
+	// nothing compiled yet
+	if (!cache) {
+		return;
+	}
+	
+	for (uint32_t a = start & ~1u; a < end; a += 2) {
+		if (!cache->covered[a >> 1]) {
+			continue;
+		}
+		
+		uint32_t first = a > 2 * (MAX_BLOCK_LENGTH - 1) ? a - 2 * (MAX_BLOCK_LENGTH - 1) : 0;
+		
+		for (uint32_t s = first; s <= a; s += 2) {
+			struct jit_block* b = &cache->blocks[s >> 1];
+			
+			if (b->code && b->end > a) {
+				b->code = NULL;
+				cache->bailout |= b == cache->running_block;
+			}
+		}
+		
+		cache->covered[a >> 1] = false;
+	}
+}
+
+// first run on this machine - make its cache and map its buffer
+// returns false if either fails, and the machine drops back to blocks for good
+static bool create_cache(struct chip8_machine* m) {
+	m->jit = calloc(1, sizeof(struct jit_cache));
+	
+	if (m->jit) {
+		void* mapped = mmap(NULL, JIT_BUFFER_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		
+		if (mapped != MAP_FAILED) {
+			m->jit->buffer = mapped;
+			return true;
+		}
+	}
+	
+	LOG("failed to set up the jit, running on blocks instead");
+	free(m->jit);
+	m->jit = NULL;
+	m->engine = ENGINE_BLOCKS;
+	
+	return false;
+}
+
+// runs exactly n instructions through compiled blocks
+uint32_t run_jit(struct chip8_machine* m, uint32_t n) {
+	if (!m->jit && !create_cache(m)) {
+		return run_blocks(m, n);
+	}
+	
+	struct jit_cache* cache = m->jit;
+	
+	// stop as soon as the machine halts - run() decides what to do with the rest
+	while (n > 0 && !m->halted) {
+		// odd or out of range addresses can't start a block
+		if (m->pc & 0xF001) {
+			step_decoded(m);
+			n--;
+			continue;
+		}
+		
+		struct jit_block* b = &cache->blocks[m->pc >> 1];
+		
+		if (!b->code || b->start != m->pc) {
+			b = compile(m, m->pc);
+		}
+		
+		// the system won't let the buffer run - the rest goes on blocks, with the same results
+		if (!b) {
+			LOG("jit code can't be made executable, running on blocks instead");
+			free_jit(m);
+			m->engine = ENGINE_BLOCKS;
+			return run_blocks(m, n);
+		}
+		
+		// not enough instructions left for the whole block - finish one at a time
+		if (b->length > n) {
+			step_decoded(m);
+			n--;
+			continue;
+		}
+		
+		cache->running_block = b;
+		cache->bailout = 0;
+		
+		uint16_t start = b->start;
+		b->code();
+		
+		cache->running_block = NULL;
+		
+		// a bailout leaves pc on the instruction after the one that rewrote the block
+		n -= cache->bailout ? (m->pc - start) / 2 : b->length;
+	}
+	
+	return n;
+}
+
+void free_jit(struct chip8_machine* m) {
+	if (m->jit) {
+		munmap(m->jit->buffer, JIT_BUFFER_SIZE);
+		free(m->jit);
+		m->jit = NULL;
+	}
+}
+
+#else
+
+void invalidate_jit(struct chip8_machine* m, uint32_t start, uint32_t end) {
+	(void) m;
+	(void) start;
+	(void) end;
+}
+
+// no jit on this platform - blocks give the same results
+uint32_t run_jit(struct chip8_machine* m, uint32_t n) {
+	return run_blocks(m, n);
+}
+
+void free_jit(struct chip8_machine* m) {
+	(void) m;
+}
+
+#endif
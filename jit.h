@@ -0,0 +1,25 @@
+// JIT
+// compiles basic blocks to x86-64 machine code. only built on x86-64 linux - everywhere else
+// the jit engine quietly runs on blocks instead
+#ifndef JIT_H
+#define JIT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#if defined(__x86_64__) && defined(__linux__)
+	#define JIT_SUPPORTED 1
+#else
+	#define JIT_SUPPORTED 0
+#endif
+
+// size of the executable buffer compiled blocks go into
+#define JIT_BUFFER_SIZE (1 << 20)
+
+struct chip8_machine;
+
+void invalidate_jit(struct chip8_machine* m, uint32_t start, uint32_t end);
+uint32_t run_jit(struct chip8_machine* m, uint32_t n);
+void free_jit(struct chip8_machine* m);
+
+#endif
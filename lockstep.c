@@ -0,0 +1,586 @@
+// LOCKSTEP
+// every step, each lane runs exactly one instruction, same as a machine running on its own.
+// lanes are grouped by pc (and opcode, in case a lane rewrote its code). a group running a
+// 6xkk, 7xkk or 8xy_ does it for every lane at once with SSE2, masking off lanes outside the
+// group; everything else, and any lane that's on its own, runs one lane at a time
+
+// C LIBRARIES
+#include <time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE2__
+	#include <emmintrin.h>
+#endif
+
+#include "core.h"
+#include "lockstep.h"
+
+// MACHINES
+// copies a booted machine (rom loaded, fonts in place) into every lane, each with its own seed
+struct lockstep* lockstep_create(const struct chip8_machine* boot, const uint32_t* seeds) {
+	// lanes are 64x32 with 4 kb each, and have the CHIP-8 quirks built in
+	if (boot->mode != MODE_CHIP8 || boot->quirks != QUIRKS_CHIP8) {
+		LOG("lockstep only runs CHIP-8 roms with CHIP-8 quirks");
+		return NULL;
+	}
+	
+	struct lockstep* ls = calloc(1, sizeof(struct lockstep));
+	
+	if (!ls) {
+		LOG("failed to allocate lockstep machines");
+		return NULL;
+	}
+	
+	for (int l = 0; l < LANES; l++) {
+		memcpy(ls->mem[l], boot->mem, sizeof(ls->mem[l]));
+		
+		for (int r = 0; r < 32; r++) {
+			ls->screen[l][r] = boot->screen[0][r][0];
+		}
+		
+		for (int r = 0; r < 16; r++) {
+			ls->v[r][l] = boot->v[r];
+		}
+		for (int s = 0; s < 12; s++) {
+			ls->stack[s][l] = boot->stack[s];
+		}
+		
+		ls->pc[l]         = boot->pc;
+		ls->i[l]          = boot->i;
+		ls->stack_addr[l] = boot->stack_addr;
+		ls->delay[l]      = boot->delay;
+		ls->sound[l]      = boot->sound;
+		ls->held_key[l]   = boot->held_key;
+		ls->dirty_rows[l] = (uint32_t) boot->dirty_rows;
+		ls->rng[l]        = seeds[l] ? seeds[l] : 1;
+	}
+	
+	return ls;
+}
+
+void lockstep_destroy(struct lockstep* ls) {
+	free(ls);
+}
+
+// copies one lane into a machine - handy for hashing, or checking a lane against a machine
+void lockstep_export(const struct lockstep* ls, int lane, struct chip8_machine* out) {
+	memcpy(out->mem, ls->mem[lane], sizeof(ls->mem[lane]));
+	memset(out->screen, 0, sizeof(out->screen));
+	
+	for (int r = 0; r < 32; r++) {
+		out->screen[0][r][0] = ls->screen[lane][r];
+	}
+	memcpy(out->keypad, ls->keypad[lane], sizeof(out->keypad));
+	
+	for (int r = 0; r < 16; r++) {
+		out->v[r] = ls->v[r][lane];
+	}
+	for (int s = 0; s < 12; s++) {
+		out->stack[s] = ls->stack[s][lane];
+	}
+	
+	out->pc         = ls->pc[lane];
+	out->i          = ls->i[lane];
+	out->stack_addr = ls->stack_addr[lane];
+	out->delay      = ls->delay[lane];
+	out->sound      = ls->sound[lane];
+	out->held_key   = ls->held_key[lane];
+	out->rng        = ls->rng[lane];
+	out->fault      = ls->fault[lane];
+	out->dirty_rows = ls->dirty_rows[lane];
+	out->halted     = false;
+}
+
+void lockstep_decrement_timers(struct lockstep* ls) {
+	for (int l = 0; l < LANES; l++) {
+		ls->delay[l] -= ls->delay[l] > 0 ? 1 : 0;
+		ls->sound[l] -= ls->sound[l] > 0 ? 1 : 0;
+	}
+}
+
+// SCALAR PATH
+// same xorshift32 as a machine, so a lane and a machine with the same seed roll the same numbers
+static uint8_t random_byte(struct lockstep* ls, int l) {
+	ls->rng[l] ^= ls->rng[l] << 13;
+	ls->rng[l] ^= ls->rng[l] >> 17;
+	ls->rng[l] ^= ls->rng[l] << 5;
+	
+	return ls->rng[l] >> 24;
+}
+
+static void raise_lane_fault(struct lockstep* ls, int l, enum fault f) {
+	if (ls->fault[l] == FAULT_NONE) {
+		ls->fault[l] = f;
+	}
+}
+
+// draw_instr() for one lane
+static void draw_lane(struct lockstep* ls, int l, uint8_t x_coord, uint8_t y_coord, uint8_t num_rows) {
+	int last_row = y_coord + num_rows < 32 ? y_coord + num_rows : 32;
+	uint64_t erased = 0;
+	
+	if (ls->i[l] + last_row - y_coord > 0x1000) {
+		raise_lane_fault(ls, l, FAULT_SPRITE_BOUNDS);
+	}
+	
+	for (int r = y_coord; r < last_row; r++) {
+		uint64_t sprite_row = ((uint64_t) ls->mem[l][(uint16_t) (ls->i[l] + r - y_coord)] << 56) >> x_coord;
+		
+		erased            |= ls->screen[l][r] & sprite_row;
+		ls->screen[l][r]  ^= sprite_row;
+		ls->dirty_rows[l] |= (uint32_t) (sprite_row != 0) << r;
+	}
+	
+	ls->v[0xF][l] = erased != 0;
+}
+
+// execute_instruction() for one lane - pc has already been moved past op
+static void execute_lane(struct lockstep* ls, int l, uint16_t op) {
+	uint8_t  x   = (op & 0x0F00) >> 8;
+	uint8_t  y   = (op & 0x00F0) >> 4;
+	uint8_t  n   = (op & 0x000F);
+	uint8_t  nn  = (op & 0x00FF);
+	uint16_t nnn = (op & 0x0FFF);
+	// register r of this lane
+	#define V(r) ls->v[(r)][l]
+	
+	switch (op >> 12) {
+		case 0x0:
+			if (op == 0x00E0) {
+				memset(ls->screen[l], 0, sizeof(ls->screen[l]));
+				ls->dirty_rows[l] = 0xFFFFFFFF;
+			} else if (op == 0x00EE) {
+				if (ls->stack_addr[l] > -1) {
+					ls->pc[l] = ls->stack[ls->stack_addr[l]][l];
+					ls->stack[ls->stack_addr[l]][l] = 0;
+					ls->stack_addr[l]--;
+				} else {
+					raise_lane_fault(ls, l, FAULT_STACK_UNDERFLOW);
+				}
+			} else {
+				raise_lane_fault(ls, l, FAULT_UNDEFINED);
+			}
+			break;
+		case 0x1:	// jump
+			ls->pc[l] = nnn;
+			break;
+		case 0x2:	// call
+			if (ls->stack_addr[l] < 11) {
+				ls->stack_addr[l]++;
+				ls->stack[ls->stack_addr[l]][l] = ls->pc[l];
+				ls->pc[l] = nnn;
+			} else {
+				raise_lane_fault(ls, l, FAULT_STACK_OVERFLOW);
+			}
+			break;
+		case 0x3:	// skip-equals immediate
+			ls->pc[l] += V(x) == nn ? 2 : 0;
+			break;
+		case 0x4:	// skip-not-equals immediate
+			ls->pc[l] += V(x) != nn ? 2 : 0;
+			break;
+		case 0x5:	// skip-equals register
+			if (n == 0) {
+				ls->pc[l] += V(x) == V(y) ? 2 : 0;
+			} else {
+				raise_lane_fault(ls, l, FAULT_UNDEFINED);
+			}
+			break;
+		case 0x6:	// load immediate
+			V(x) = nn;
+			break;
+		case 0x7:	// add
+			V(x) += nn;
+			break;
+		case 0x8: {	// register-register ops
+			uint8_t a = V(x);
+			uint8_t b = V(y);
+			
+			switch (n) {
+				case 0x0: V(x) = b; break;
+				case 0x1: V(x) = a | b; V(0xF) = 0; break;
+				case 0x2: V(x) = a & b; V(0xF) = 0; break;
+				case 0x3: V(x) = a ^ b; V(0xF) = 0; break;
+				case 0x4: V(x) = a + b; V(0xF) = a + b > 0xFF; break;
+				case 0x5: V(x) = a - b; V(0xF) = a >= b; break;
+				case 0x6: V(x) = b >> 1; V(0xF) = b & 0x01; break;
+				case 0x7: V(x) = b - a; V(0xF) = b >= a; break;
+				case 0xE: V(x) = b << 1; V(0xF) = b >> 7; break;
+				default:  raise_lane_fault(ls, l, FAULT_UNDEFINED);
+			}
+			break;
+		}
+		case 0x9:	// skip-not-equals register
+			ls->pc[l] += V(x) != V(y) ? 2 : 0;
+			break;
+		case 0xA:	// load to index
+			ls->i[l] = nnn;
+			break;
+		case 0xB:	// jump to v0 + last 3 digits of instruction
+			ls->pc[l] = V(0) + nnn;
+			break;
+		case 0xC:	// vx and random byte
+			V(x) = random_byte(ls, l) & nn;
+			break;
+		case 0xD:	// draw instruction
+			draw_lane(ls, l, V(x) % 64, V(y) % 32, n);
+			break;
+		case 0xE:	// key press instructions
+			if (nn == 0x9E) {
+				ls->pc[l] += ls->keypad[l][V(x) & 0xF] ? 2 : 0;
+			} else if (nn == 0xA1) {
+				ls->pc[l] += ls->keypad[l][V(x) & 0xF] ? 0 : 2;
+			} else {
+				raise_lane_fault(ls, l, FAULT_UNDEFINED);
+			}
+			break;
+		case 0xF:
+			switch (nn) {
+				case 0x07: V(x) = ls->delay[l]; break;
+				case 0x0A:	// same as wait_for_key()
+					if (ls->held_key[l] == 0xFF) {
+						for (int a = 0; a < 0x10; a++) {
+							if (ls->keypad[l][a]) {
+								ls->held_key[l] = a;
+								break;
+							}
+						}
+					}
+					if (ls->held_key[l] == 0xFF || ls->keypad[l][ls->held_key[l]]) {
+						ls->pc[l] -= 2;
+					} else {
+						V(x) = ls->held_key[l];
+						ls->held_key[l] = 0xFF;
+					}
+					break;
+				case 0x15: ls->delay[l] = V(x); break;
+				case 0x18: ls->sound[l] = V(x); break;
+				case 0x1E:
+					ls->i[l] += V(x);
+					V(0xF) = ls->i[l] > 0xFFF;
+					break;
+				case 0x29: ls->i[l] = (V(x) & 0x0F) * 5; break;
+				case 0x33:
+					ls->mem[l][ls->i[l]]                  = V(x) / 100 % 10;
+					ls->mem[l][(uint16_t) (ls->i[l] + 1)] = V(x) / 10  % 10;
+					ls->mem[l][(uint16_t) (ls->i[l] + 2)] = V(x) % 10;
+					ls->wrote |= 1 << l;
+					break;
+				case 0x55:
+					for (int a = 0; a <= x; a++) {
+						ls->mem[l][(uint16_t) (ls->i[l] + a)] = V(a);
+					}
+					ls->i[l] += x + 1;
+					ls->wrote |= 1 << l;
+					break;
+				case 0x65:
+					for (int a = 0; a <= x; a++) {
+						V(a) = ls->mem[l][(uint16_t) (ls->i[l] + a)];
+					}
+					ls->i[l] += x + 1;
+					break;
+				default:
+					raise_lane_fault(ls, l, FAULT_UNDEFINED);
+			}
+			break;
+	}
+	
+	#undef V
+}
+
+// VECTOR PATH
+#ifdef __SSE2__
+
+// unsigned a > b for every byte - SSE2 only compares signed, so flip the top bits first
+static inline __m128i greater_u8(__m128i a, __m128i b) {
+	const __m128i bias = _mm_set1_epi8((char) 0x80);
+	return _mm_cmpgt_epi8(_mm_xor_si128(a, bias), _mm_xor_si128(b, bias));
+}
+
+// new where mask is set, old everywhere else
+static inline __m128i blend(__m128i mask, __m128i new_value, __m128i old) {
+	return _mm_or_si128(_mm_and_si128(mask, new_value), _mm_andnot_si128(mask, old));
+}
+
+// whether op has a vector kernel
+static bool vectorizable(uint16_t op) {
+	uint8_t top = op >> 12;
+	uint8_t n   = op & 0x000F;
+	
+	return top == 0x1 || top == 0x3 || top == 0x4 || top == 0x6 || top == 0x7 || top == 0xA
+	    || ((top == 0x5 || top == 0x9) && n == 0)
+	    || (top == 0x8 && (n <= 0x7 || n == 0xE));
+}
+
+// 0xFF in every byte whose lane is in the group
+static inline __m128i byte_mask(uint16_t group) {
+	// spread each bit over its byte, then test it
+	const __m128i bits = _mm_set_epi8((char) 0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01,
+	                                  (char) 0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01);
+	
+	// bytes 0-7 hold the low half of group, 8-15 the high half
+	__m128i halves = _mm_unpacklo_epi64(_mm_set1_epi8((char) (group & 0xFF)), _mm_set1_epi8((char) (group >> 8)));
+	
+	return _mm_cmpeq_epi8(_mm_and_si128(halves, bits), bits);
+}
+
+// adds 2 to pc in every lane whose byte is set in skip - also how a group moves past its instruction
+static inline void skip_lanes(struct lockstep* ls, __m128i skip) {
+	const __m128i two = _mm_set1_epi16(2);
+	__m128i* pc = (__m128i*) ls->pc;
+	
+	__m128i low  = _mm_and_si128(_mm_unpacklo_epi8(skip, skip), two);
+	__m128i high = _mm_and_si128(_mm_unpackhi_epi8(skip, skip), two);
+	
+	_mm_storeu_si128(&pc[0], _mm_add_epi16(_mm_loadu_si128(&pc[0]), low));
+	_mm_storeu_si128(&pc[1], _mm_add_epi16(_mm_loadu_si128(&pc[1]), high));
+}
+
+// sets a 16 bit register to value in every lane whose byte is set in mask
+static inline void set_lanes16(uint16_t* reg, __m128i mask, uint16_t value) {
+	__m128i* r = (__m128i*) reg;
+	const __m128i set = _mm_set1_epi16((short) value);
+	
+	_mm_storeu_si128(&r[0], blend(_mm_unpacklo_epi8(mask, mask), set, _mm_loadu_si128(&r[0])));
+	_mm_storeu_si128(&r[1], blend(_mm_unpackhi_epi8(mask, mask), set, _mm_loadu_si128(&r[1])));
+}
+
+// runs a vectorizable op for every lane in the group at once - pc has already been moved past it
+static void execute_vector(struct lockstep* ls, uint16_t group, uint16_t op) {
+	uint8_t  x   = (op & 0x0F00) >> 8;
+	uint8_t  y   = (op & 0x00F0) >> 4;
+	uint8_t  n   = (op & 0x000F);
+	uint8_t  nn  = (op & 0x00FF);
+	uint16_t nnn = (op & 0x0FFF);
+	
+	const __m128i mask = byte_mask(group);
+	const __m128i one  = _mm_set1_epi8(1);
+	__m128i a  = _mm_load_si128((const __m128i*) ls->v[x]);
+	__m128i b  = _mm_load_si128((const __m128i*) ls->v[y]);
+	__m128i result;
+	__m128i flag = _mm_setzero_si128();
+	bool    sets_flag = true;
+	
+	switch (op >> 12) {
+		case 0x1:	// jump
+			set_lanes16(ls->pc, mask, nnn);
+			return;
+		case 0xA:	// load to index
+			set_lanes16(ls->i, mask, nnn);
+			return;
+		case 0x3:	// skips - work out which lanes skip, then move just their pcs
+			skip_lanes(ls, _mm_and_si128(mask, _mm_cmpeq_epi8(a, _mm_set1_epi8((char) nn))));
+			return;
+		case 0x4:
+			skip_lanes(ls, _mm_andnot_si128(_mm_cmpeq_epi8(a, _mm_set1_epi8((char) nn)), mask));
+			return;
+		case 0x5:
+			skip_lanes(ls, _mm_and_si128(mask, _mm_cmpeq_epi8(a, b)));
+			return;
+		case 0x9:
+			skip_lanes(ls, _mm_andnot_si128(_mm_cmpeq_epi8(a, b), mask));
+			return;
+	}
+	
+	if (op >> 12 == 0x6) {
+		result    = _mm_set1_epi8((char) nn);
+		sets_flag = false;
+	} else if (op >> 12 == 0x7) {
+		result    = _mm_add_epi8(a, _mm_set1_epi8((char) nn));
+		sets_flag = false;
+	} else {
+		switch (n) {
+			case 0x0:	// load register
+				result    = b;
+				sets_flag = false;
+				break;
+			case 0x1:	// or, and, xor - vF is zeroed
+				result = _mm_or_si128(a, b);
+				flag   = _mm_setzero_si128();
+				break;
+			case 0x2:
+				result = _mm_and_si128(a, b);
+				flag   = _mm_setzero_si128();
+				break;
+			case 0x3:
+				result = _mm_xor_si128(a, b);
+				flag   = _mm_setzero_si128();
+				break;
+			case 0x4:	// add - it carried if the sum came out smaller than a
+				result = _mm_add_epi8(a, b);
+				flag   = _mm_and_si128(greater_u8(a, result), one);
+				break;
+			case 0x5:	// subtract - vF is 1 unless b > a
+				result = _mm_sub_epi8(a, b);
+				flag   = _mm_andnot_si128(greater_u8(b, a), one);
+				break;
+			case 0x6:	// shift right - SSE2 has no byte shift, so shift words and mask off the bit that crossed over
+				result = _mm_and_si128(_mm_srli_epi16(b, 1), _mm_set1_epi8(0x7F));
+				flag   = _mm_and_si128(b, one);
+				break;
+			case 0x7:	// negated subtraction
+				result = _mm_sub_epi8(b, a);
+				flag   = _mm_andnot_si128(greater_u8(a, b), one);
+				break;
+			default:	// 0xE, shift left
+				result = _mm_add_epi8(b, b);
+				flag   = _mm_and_si128(_mm_srli_epi16(b, 7), one);
+				break;
+		}
+	}
+	
+	// write vx, then vF - the same order as the scalar path, so x = F ends up with the flag
+	_mm_store_si128((__m128i*) ls->v[x], blend(mask, result, a));
+	
+	if (sets_flag) {
+		__m128i vf = _mm_load_si128((const __m128i*) ls->v[0xF]);
+		_mm_store_si128((__m128i*) ls->v[0xF], blend(mask, flag, vf));
+	}
+}
+
+#endif
+
+// lanes whose pc is pc
+static uint16_t lanes_at(const struct lockstep* ls, uint16_t pc) {
+#ifdef __SSE2__
+	const __m128i target = _mm_set1_epi16((short) pc);
+	const __m128i* pcs = (const __m128i*) ls->pc;
+	
+	__m128i low  = _mm_cmpeq_epi16(_mm_loadu_si128(&pcs[0]), target);
+	__m128i high = _mm_cmpeq_epi16(_mm_loadu_si128(&pcs[1]), target);
+	
+	return (uint16_t) _mm_movemask_epi8(_mm_packs_epi16(low, high));
+#else
+	uint16_t lanes = 0;
+	for (int l = 0; l < LANES; l++) {
+		lanes |= (uint16_t) (ls->pc[l] == pc) << l;
+	}
+	return lanes;
+#endif
+}
+
+// the opcode at pc in lane l
+static inline uint16_t fetch(const struct lockstep* ls, int l, uint16_t pc) {
+	return ls->mem[l][pc] << 8 | ls->mem[l][(uint16_t) (pc + 1)];
+}
+
+// runs exactly n instructions on every lane
+void lockstep_run(struct lockstep* ls, uint32_t n) {
+	for (uint32_t s = 0; s < n; s++) {
+		uint16_t left = 0xFFFF;	// lanes that haven't run this step yet
+		
+		while (left) {
+			int lead = __builtin_ctz(left);
+			uint16_t pc = ls->pc[lead];
+			uint16_t op = fetch(ls, lead, pc);
+			
+			// every lane still waiting at the same pc joins the group...
+			uint16_t group = lanes_at(ls, pc) & left;
+			
+			// ...unless it has rewritten its memory into a different opcode there
+			// lanes that never wrote memory still have the rom as loaded, so they can't differ
+			if (ls->wrote & group) {
+				for (int l = lead + 1; l < LANES; l++) {
+					if ((group >> l) & 1 && fetch(ls, l, pc) != op) {
+						group &= ~(1 << l);
+					}
+				}
+			}
+			
+			left &= ~group;
+			
+			int members = __builtin_popcount(group);
+			
+			if (members > 1) {
+				ls->grouped += members;
+			} else {
+				ls->alone++;
+			}
+			
+		#ifdef __SSE2__
+			if (members > 1 && vectorizable(op)) {
+				skip_lanes(ls, byte_mask(group));
+				execute_vector(ls, group, op);
+				continue;
+			}
+		#endif
+			
+			for (uint16_t g = group; g; g &= g - 1) {
+				int l = __builtin_ctz(g);
+				ls->pc[l] += 2;
+				execute_lane(ls, l, op);
+			}
+		}
+	}
+}
+
+// HEADLESS RUNNER
+// current time in seconds
+static double now() {
+	struct timespec ts;
+	timespec_get(&ts, TIME_UTC);
+	
+	return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
+
+int run_lockstep(int argc, char** argv) {
+	// argv -> ['chip-8.exe', '--lockstep', rom name, frames]
+	char*    name   = argc > 2 ? argv[2] : NULL;
+	uint64_t frames = argc > 3 ? strtoull(argv[3], NULL, 10) : 600;
+	
+	struct chip8_machine* boot = machine_create(1);
+	
+	if (!boot || !open_file(boot, name)) {
+		machine_destroy(boot);
+		return -1;
+	}
+	
+	clear_screen(boot);
+	
+	// seeds 1 to LANES - the same seeds --batch would use
+	uint32_t seeds[LANES];
+	for (int l = 0; l < LANES; l++) {
+		seeds[l] = l + 1;
+	}
+	
+	struct lockstep* ls = lockstep_create(boot, seeds);
+	
+	if (!ls) {
+		machine_destroy(boot);
+		return -1;
+	}
+	
+	double start = now();
+	
+	for (uint64_t f = 0; f < frames; f++) {
+		lockstep_run(ls, INSTRUCTIONS_PER_TICK);
+		lockstep_decrement_timers(ls);
+	}
+	
+	double elapsed = now() - start;
+	
+	if (elapsed <= 0) {
+		elapsed = 1e-9;
+	}
+	
+	uint64_t total = frames * INSTRUCTIONS_PER_TICK * LANES;
+	
+	printf("rom:                   %s\n",   name ? name : "roms/ibm_logo.ch8");
+	printf("lanes:                 %d\n",   LANES);
+	printf("lane-instructions:     %llu\n", (unsigned long long) total);
+	printf("lane-instructions/sec: %.0f\n", total / elapsed);
+	printf("grouped:               %.1f%%\n", 100.0 * ls->grouped / (ls->grouped + ls->alone));
+	
+	// reuse the boot machine to hash each lane's screen the same way --bench does
+	for (int l = 0; l < LANES; l++) {
+		lockstep_export(ls, l, boot);
+		printf("seed %2u screen hash:   %016llx\n", seeds[l], (unsigned long long) screen_hash(boot));
+	}
+	
+	lockstep_destroy(ls);
+	machine_destroy(boot);
+	
+	return 0;
+}
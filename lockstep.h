@@ -0,0 +1,66 @@
+// LOCKSTEP
+// runs LANES copies of one rom side by side in structure-of-arrays form. lanes that sit on the
+// same instruction run it together, with SSE2 for the register ops
+#ifndef LOCKSTEP_H
+#define LOCKSTEP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "core.h"
+
+// number of machines run together - one SSE2 register holds a byte from each
+#define LANES 16
+
+	struct lockstep {
+	// general purpose 8-bit registers - v[reg][lane], so one register of every lane is one vector
+		_Alignas(16) uint8_t v[16][LANES];
+
+	// 16 bit registers - program index, memory index
+		uint16_t pc[LANES];
+		uint16_t i[LANES];
+
+	// stack - holds 12 addresses
+		uint16_t stack[12][LANES];
+		short    stack_addr[LANES];
+
+	// 8 bit timers - delay, sound
+		uint8_t delay[LANES];
+		uint8_t sound[LANES];
+
+	// key held down during Fx0A
+		uint8_t held_key[LANES];
+
+	// random number state for Cxkk
+		uint32_t rng[LANES];
+
+	// first thing that went wrong in each lane
+		enum fault fault[LANES];
+
+	// keypad inputs - set these to give each lane different input
+		bool keypad[LANES][16];
+
+	// display - same layout as a machine's, one per lane
+		uint64_t screen[LANES][32];
+		uint32_t dirty_rows[LANES];
+
+	// memory - every lane gets its own, since Fx33/Fx55 can write different things. it's as big as
+	// a machine's, so an index that Fx1E pushed past 4 kb reaches the same bytes it would there
+		uint8_t  mem[LANES][MEMORY_SIZE];
+		uint16_t wrote;		// bit l is set once lane l has written to its memory
+
+	// lane-instructions run as part of a group of 2 or more, and run alone
+		uint64_t grouped;
+		uint64_t alone;
+	};
+
+struct lockstep* lockstep_create(const struct chip8_machine* boot, const uint32_t* seeds);
+void lockstep_destroy(struct lockstep* ls);
+void lockstep_run(struct lockstep* ls, uint32_t n);
+void lockstep_decrement_timers(struct lockstep* ls);
+void lockstep_export(const struct lockstep* ls, int lane, struct chip8_machine* out);
+
+// argv -> ['chip-8.exe', '--lockstep', rom name, frames]
+int run_lockstep(int argc, char** argv);
+
+#endif
@@ -0,0 +1,90 @@
+// FRAME PACING
+// frame k begins at start + k / rate seconds, worked out from the start each time so rounding
+// never builds up. the frontend runs every frame that's due, presents once, and then either
+// sleeps until the next one is due or lets vsync hold the present until the display is ready -
+// on a 144 hz display most presents find no new frame (duplicated), on a 48 hz one some frames
+// never get a present of their own (dropped)
+
+// C LIBRARIES
+#include <string.h>
+
+#include "pacer.h"
+
+#define NS_PER_SECOND 1000000000ULL
+
+void pacer_init(struct pacer* p, uint64_t now, uint32_t rate) {
+	memset(p, 0, sizeof(*p));
+	
+	p->rate  = rate;
+	p->start = now;
+}
+
+// when the next frame to run begins
+uint64_t pacer_frame_start(const struct pacer* p) {
+	return p->start + p->frames * NS_PER_SECOND / p->rate;
+}
+
+// whether the next frame should run now - if the host has fallen too far behind, the frames it
+// missed are let go and the clock starts again from now
+bool pacer_due(struct pacer* p, uint64_t now) {
+	uint64_t next = pacer_frame_start(p);
+	
+	if (now < next) {
+		return false;
+	}
+	
+	if (now - next > PACER_MAX_BEHIND * NS_PER_SECOND / p->rate) {
+		p->start  = now;
+		p->frames = 0;
+		p->resyncs++;
+	}
+	
+	return true;
+}
+
+void pacer_frame_done(struct pacer* p) {
+	p->frames++;
+	p->run++;
+}
+
+// call it right after the screen was presented
+void pacer_presented(struct pacer* p, uint64_t now) {
+	if (p->run == p->shown) {
+		p->duplicated++;
+	} else {
+		p->dropped += p->run - p->shown - 1;
+	}
+	p->shown = p->run;
+	
+	if (p->last_present) {
+		uint64_t length = now - p->last_present;
+		uint64_t bin    = length / PACER_BIN_NS;
+		
+		p->bins[bin < PACER_BINS ? bin : PACER_BINS - 1]++;
+		p->longest = length > p->longest ? length : p->longest;
+	}
+	
+	p->last_present = now;
+	p->presents++;
+}
+
+// the frame time (gap between presents) that this fraction of frames came in under, in ns -
+// the top of its bin, so it never reads as better than it was
+uint64_t pacer_percentile(const struct pacer* p, double fraction) {
+	uint64_t total = p->presents > 0 ? p->presents - 1 : 0;
+	uint64_t count = 0;
+	
+	if (total == 0) {
+		return 0;
+	}
+	
+	for (int b = 0; b < PACER_BINS - 1; b++) {
+		count += p->bins[b];
+		
+		if (count >= fraction * total) {
+			return (uint64_t) (b + 1) * PACER_BIN_NS;
+		}
+	}
+	
+	return p->longest;
+}
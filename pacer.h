@@ -0,0 +1,45 @@
+// FRAME PACING
+// works out from the host clock when each emulated 60 hz frame is due, and keeps statistics on
+// the frames that reach the screen - how far apart they land, and which ones never made it or
+// went up twice. nothing here needs SDL, times are host nanoseconds passed in
+#ifndef PACER_H
+#define PACER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// if the host falls further behind than this many frames, stop trying to catch up
+#define PACER_MAX_BEHIND 4
+
+// frame times are counted in bins this wide, up to PACER_BINS of them - the last bin takes
+// anything longer, so percentiles cost nothing per frame and are exact to a tenth of a ms
+#define PACER_BIN_NS 100000
+#define PACER_BINS   1000
+
+	struct pacer {
+		uint32_t rate;			// emulated frames a second
+		uint64_t start;			// host time frame 0 began - moves on whenever the pacer gives up catching up
+		uint64_t frames;		// frames run since start
+	
+	// frames run in all, and how many of them had been run at the last present
+		uint64_t run;
+		uint64_t shown;
+		uint64_t last_present;	// host time, 0 before the first
+	
+		uint64_t presents;
+		uint64_t dropped;		// frames run that were never on screen
+		uint64_t duplicated;	// presents that showed the same frame as the one before
+		uint64_t resyncs;		// times the host fell too far behind and the frames in between were let go
+	
+		uint32_t bins[PACER_BINS];
+		uint64_t longest;
+	};
+
+void pacer_init(struct pacer* p, uint64_t now, uint32_t rate);
+uint64_t pacer_frame_start(const struct pacer* p);
+bool pacer_due(struct pacer* p, uint64_t now);
+void pacer_frame_done(struct pacer* p);
+void pacer_presented(struct pacer* p, uint64_t now);
+uint64_t pacer_percentile(const struct pacer* p, double fraction);
+
+#endif
@@ -0,0 +1,357 @@
+// ROM PACKS
+// the index is checked once when the pack is opened, so after that every entry can be trusted
+// to point inside the mapping. numbers are stored in the host's byte order, like traces are
+
+// C LIBRARIES
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+	#include <windows.h>
+#else
+	#include <fcntl.h>
+	#include <unistd.h>
+	#include <sys/mman.h>
+#endif
+
+#include "core.h"
+#include "pack.h"
+
+	struct pack {
+		const uint8_t*            data;
+		size_t                    size;
+		const struct pack_header* header;
+		const struct pack_entry*  entries;
+	#ifdef _WIN32
+		HANDLE file;
+		HANDLE mapping;
+	#endif
+	};
+
+// fnv-1a of a rom's bytes, the same hash screen_hash() uses
+uint64_t pack_hash(const uint8_t* data, uint32_t size) {
+	uint64_t hash = 0xCBF29CE484222325ULL;
+	
+	for (uint32_t b = 0; b < size; b++) {
+		hash ^= data[b];
+		hash *= 0x100000001B3ULL;
+	}
+	
+	return hash;
+}
+
+// MAPPING
+// maps the whole file read-only - false if it can't be
+static bool map_file(struct pack* p, const char* name) {
+#ifdef _WIN32
+	p->file = CreateFileA(name, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	
+	if (p->file == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+	
+	LARGE_INTEGER size;
+	
+	if (!GetFileSizeEx(p->file, &size) || size.QuadPart == 0) {
+		CloseHandle(p->file);
+		return false;
+	}
+	
+	p->size    = (size_t) size.QuadPart;
+	p->mapping = CreateFileMappingA(p->file, NULL, PAGE_READONLY, 0, 0, NULL);
+	p->data    = p->mapping ? MapViewOfFile(p->mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+	
+	if (!p->data) {
+		if (p->mapping) {
+			CloseHandle(p->mapping);
+		}
+		CloseHandle(p->file);
+		return false;
+	}
+	
+	return true;
+#else
+	int fd = open(name, O_RDONLY);
+	
+	if (fd < 0) {
+		return false;
+	}
+	
+	struct stat info;
+	
+	if (fstat(fd, &info) != 0 || info.st_size == 0) {
+		close(fd);
+		return false;
+	}
+	
+	p->size = (size_t) info.st_size;
+	
+	void* mapped = mmap(NULL, p->size, PROT_READ, MAP_PRIVATE, fd, 0);
+	
+	// the mapping keeps the file alive on its own
+	close(fd);
+	
+	if (mapped == MAP_FAILED) {
+		return false;
+	}
+	
+	p->data = mapped;
+	
+	return true;
+#endif
+}
+
+static void unmap_file(struct pack* p) {
+#ifdef _WIN32
+	UnmapViewOfFile(p->data);
+	CloseHandle(p->mapping);
+	CloseHandle(p->file);
+#else
+	munmap((void*) p->data, p->size);
+#endif
+}
+
+// OPENING
+// whether the header and every entry of the index fit in the file
+static bool is_valid(const struct pack* p) {
+	if (p->size < sizeof(struct pack_header)) {
+		return false;
+	}
+	
+	const struct pack_header* h = p->header;
+	
+	if (memcmp(h->magic, PACK_MAGIC, 4) != 0 || h->version != PACK_VERSION || h->entry_size != sizeof(struct pack_entry)) {
+		return false;
+	}
+	
+	if (h->count > (p->size - sizeof(struct pack_header)) / sizeof(struct pack_entry)) {
+		return false;
+	}
+	
+	for (uint32_t e = 0; e < h->count; e++) {
+		const struct pack_entry* entry = &p->entries[e];
+		
+		if (memchr(entry->name, '\0', PACK_NAME) == NULL || entry->offset > p->size || entry->size > p->size - entry->offset) {
+			return false;
+		}
+	}
+	
+	return true;
+}
+
+// NULL if the file isn't there or isn't a pack
+struct pack* pack_open(const char* name) {
+	struct pack* p = calloc(1, sizeof(struct pack));
+	
+	if (!p) {
+		return NULL;
+	}
+	
+	if (!map_file(p, name)) {
+		LOG("couldn't map pack %s", name);
+		free(p);
+		return NULL;
+	}
+	
+	p->header  = (const struct pack_header*) p->data;
+	p->entries = (const struct pack_entry*) (p->data + sizeof(struct pack_header));
+	
+	if (!is_valid(p)) {
+		LOG("%s isn't a version %d pack", name, PACK_VERSION);
+		unmap_file(p);
+		free(p);
+		return NULL;
+	}
+	
+	return p;
+}
+
+void pack_close(struct pack* p) {
+	if (!p) {
+		return;
+	}
+	
+	unmap_file(p);
+	free(p);
+}
+
+// LOOKING UP
+uint32_t pack_count(const struct pack* p) {
+	return p->header->count;
+}
+
+const struct pack_entry* pack_entry(const struct pack* p, uint32_t index) {
+	return index < p->header->count ? &p->entries[index] : NULL;
+}
+
+static int compare_names(const void* name, const void* entry) {
+	return strcmp(name, ((const struct pack_entry*) entry)->name);
+}
+
+// the rom with this name, NULL if there isn't one - the index is sorted, so it's a binary search
+const struct pack_entry* pack_find(const struct pack* p, const char* name) {
+	return bsearch(name, p->entries, p->header->count, sizeof(struct pack_entry), compare_names);
+}
+
+// a rom's bytes, straight out of the mapping
+const uint8_t* pack_data(const struct pack* p, const struct pack_entry* e) {
+	return p->data + e->offset;
+}
+
+// copies a rom from the mapping into the machine, in the mode its name asks for
+bool pack_load(struct chip8_machine* m, const struct pack* p, const struct pack_entry* e) {
+	if (!m->quiet) {
+		printf("opening %s from a pack\n", e->name);
+	}
+	
+	return load_rom(m, e->name, pack_data(p, e), e->size);
+}
+
+// BUILDING
+	struct rom_file {
+		char     name[PACK_NAME];
+		uint8_t* data;
+		uint32_t size;
+	};
+
+static int compare_files(const void* a, const void* b) {
+	return strcmp(((const struct rom_file*) a)->name, ((const struct rom_file*) b)->name);
+}
+
+// whether a file name has an extension roms are kept under
+static bool is_rom(const char* name) {
+	const char* dot = strrchr(name, '.');
+	
+	return dot && (strcmp(dot, ".ch8") == 0 || strcmp(dot, ".sc8") == 0 || strcmp(dot, ".xo8") == 0);
+}
+
+// reads a whole rom file - NULL if it can't be read or could never fit in memory
+static uint8_t* read_rom(const char* path, uint32_t* size) {
+	FILE* file = fopen(path, "rb");
+	
+	if (!file) {
+		return NULL;
+	}
+	
+	fseek(file, 0, SEEK_END);
+	long length = ftell(file);
+	rewind(file);
+	
+	uint8_t* data = length > 0 && length <= MEMORY_SIZE ? malloc(length) : NULL;
+	
+	if (data && fread(data, 1, length, file) != (size_t) length) {
+		free(data);
+		data = NULL;
+	}
+	
+	fclose(file);
+	*size = (uint32_t) length;
+	
+	return data;
+}
+
+// packs every .ch8, .sc8 and .xo8 file in a directory (not the ones below it) - false if
+// the pack couldn't be written
+bool pack_build(const char* name, const char* directory) {
+	DIR* dir = opendir(directory);
+	
+	if (!dir) {
+		LOG("couldn't open directory %s", directory);
+		return false;
+	}
+	
+	struct rom_file* files = NULL;
+	uint32_t count = 0;
+	uint32_t capacity = 0;
+	bool ok = true;
+	
+	for (struct dirent* d; ok && (d = readdir(dir)) != NULL; ) {
+		char path[1024];
+		struct stat info;
+		snprintf(path, sizeof(path), "%s/%s", directory, d->d_name);
+		
+		if (!is_rom(d->d_name) || stat(path, &info) != 0 || !S_ISREG(info.st_mode)) {
+			continue;
+		}
+		
+		if (strlen(d->d_name) >= PACK_NAME) {
+			LOG("skipping %s, the name is too long for a pack", d->d_name);
+			continue;
+		}
+		
+		if (count == capacity) {
+			capacity = capacity ? capacity * 2 : 64;
+			struct rom_file* grown = realloc(files, capacity * sizeof(struct rom_file));
+			
+			if (!grown) {
+				LOG("failed to allocate pack index");
+				ok = false;
+				break;
+			}
+			files = grown;
+		}
+		
+		struct rom_file* f = &files[count];
+		f->data = read_rom(path, &f->size);
+		
+		if (!f->data) {
+			LOG("skipping %s, it couldn't be read or is too big", path);
+			continue;
+		}
+		
+		snprintf(f->name, PACK_NAME, "%s", d->d_name);
+		count++;
+	}
+	
+	closedir(dir);
+	
+	// sorted, so pack_find() can search it
+	if (count > 0) {
+		qsort(files, count, sizeof(struct rom_file), compare_files);
+	}
+	
+	FILE* out = ok ? fopen(name, "wb") : NULL;
+	
+	if (ok && !out) {
+		LOG("couldn't open pack %s", name);
+		ok = false;
+	}
+	
+	if (ok) {
+		struct pack_header header = {.version = PACK_VERSION, .entry_size = sizeof(struct pack_entry), .count = count};
+		memcpy(header.magic, PACK_MAGIC, 4);
+		fwrite(&header, sizeof(header), 1, out);
+		
+		// the roms start right after the index
+		uint32_t offset = sizeof(struct pack_header) + count * sizeof(struct pack_entry);
+		
+		for (uint32_t f = 0; f < count; f++) {
+			struct pack_entry entry = {0};
+			
+			memcpy(entry.name, files[f].name, PACK_NAME);
+			entry.offset = offset;
+			entry.size   = files[f].size;
+			entry.hash   = pack_hash(files[f].data, files[f].size);
+			
+			fwrite(&entry, sizeof(entry), 1, out);
+			offset += files[f].size;
+		}
+		
+		for (uint32_t f = 0; f < count; f++) {
+			fwrite(files[f].data, 1, files[f].size, out);
+		}
+		
+		ok = !ferror(out);
+		ok = fclose(out) == 0 && ok;
+	}
+	
+	for (uint32_t f = 0; f < count; f++) {
+		free(files[f].data);
+	}
+	free(files);
+	
+	return ok;
+}
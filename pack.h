@@ -0,0 +1,53 @@
+// ROM PACKS
+// lots of roms in one file - a header, an index sorted by name, then every rom back to back.
+// a pack is mapped into memory instead of read, so loading a rom out of it is one memcpy and no
+// system calls, which adds up when a batch goes through thousands of them
+#ifndef PACK_H
+#define PACK_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// start of every pack file
+#define PACK_MAGIC   "C8PK"
+#define PACK_VERSION 1
+
+// longest rom name a pack holds, with its terminating zero - the extension picks the mode, so it's kept
+#define PACK_NAME 56
+
+// what batch runs take for a pack instead of a rom
+#define PACK_EXTENSION ".c8p"
+
+struct chip8_machine;
+
+	struct pack_header {
+		char     magic[4];
+		uint16_t version;
+		uint16_t entry_size;
+		uint32_t count;
+		uint32_t reserved;
+	};
+
+// one rom in the index - where it is from the start of the file, and a hash of its bytes
+	struct pack_entry {
+		char     name[PACK_NAME];
+		uint32_t offset;
+		uint32_t size;
+		uint64_t hash;
+	};
+	
+	struct pack;
+
+uint64_t pack_hash(const uint8_t* data, uint32_t size);
+
+struct pack* pack_open(const char* name);
+void pack_close(struct pack* p);
+uint32_t pack_count(const struct pack* p);
+const struct pack_entry* pack_entry(const struct pack* p, uint32_t index);
+const struct pack_entry* pack_find(const struct pack* p, const char* name);
+const uint8_t* pack_data(const struct pack* p, const struct pack_entry* e);
+bool pack_load(struct chip8_machine* m, const struct pack* p, const struct pack_entry* e);
+
+bool pack_build(const char* name, const char* directory);
+
+#endif
@@ -0,0 +1,347 @@
+// PROFILER
+// while a machine has a profile, run() goes through run_profiled() one instruction at a time.
+// machines without one never touch any of this, so profiling costs nothing when it's off.
+// the call stack is kept as a tree of the calls seen so far - each instruction adds one to the
+// node it ran in, which is exactly the count a folded-stack line needs
+
+// C LIBRARIES
+#include <time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "core.h"
+#include "profile.h"
+
+// one kind of instruction per case in execute_instruction(), then what SUPER-CHIP and XO-CHIP add
+	static const char* class_names[] = {
+		"00E0 CLS",  "00EE RET",  "0NNN undefined",
+		"1NNN JP",   "2NNN CALL", "3xkk SE",   "4xkk SNE",
+		"5xy0 SE",   "5xy? undefined",
+		"6xkk LD",   "7xkk ADD",
+		"8xy0 LD",   "8xy1 OR",   "8xy2 AND",  "8xy3 XOR",  "8xy4 ADD",
+		"8xy5 SUB",  "8xy6 SHR",  "8xy7 SUBN", "8xyE SHL",  "8xy? undefined",
+		"9xy0 SNE",  "Annn LD I", "Bnnn JP V0", "Cxkk RND", "Dxyn DRW",
+		"Ex9E SKP",  "ExA1 SKNP", "Ex?? undefined",
+		"Fx07 LD DT", "Fx0A LD K", "Fx15 LD DT", "Fx18 LD ST", "Fx1E ADD I",
+		"Fx29 LD F", "Fx33 LD B", "Fx55 LD [I]", "Fx65 LD [I]", "Fx?? undefined",
+		"00Cn SCD",  "00Dn SCU",  "00FB SCR",  "00FC SCL",  "00FD EXIT", "00FE LOW", "00FF HIGH",
+		"5xy2 SAVE", "5xy3 LOAD",
+		"F000 LD I long", "Fx01 PLANE", "F002 AUDIO", "Fx30 LD HF", "Fx3A PITCH",
+		"Fx75 LD R", "Fx85 LD R"
+	};
+
+#define CLASSES (sizeof(class_names) / sizeof(class_names[0]))
+
+	static const char* timer_names[PROFILE_TIMERS] = {
+		"draw_instr", "update_draw_buffer", "SDL_RenderPresent"
+	};
+
+// one call stack - the function it's in, and where it was called from
+	struct call_node {
+		uint16_t entry;			// address the function starts at
+		uint16_t parent;
+		uint16_t first_child;	// 0 for none - node 0 is the root, which is never anyone's child
+		uint16_t next_sibling;
+		uint64_t count;			// instructions run in this function with exactly this stack
+	};
+	
+	struct profile {
+		uint64_t pc_counts[4096];
+		uint64_t class_counts[CLASSES];
+		
+		uint64_t timer_ns[PROFILE_TIMERS];
+		uint64_t timer_calls[PROFILE_TIMERS];
+	
+	// the call tree, and where the machine is in it
+		struct call_node nodes[PROFILE_MAX_NODES];
+		uint16_t         node_count;
+		uint16_t         current;
+		uint32_t         lost_depth;	// calls deeper than the tree could hold
+	};
+
+// index into class_names for an opcode, among the ones SUPER-CHIP and XO-CHIP add - -1 if it isn't
+// one of those in this mode, the same way find_extended() decides
+static int extended_class(uint16_t op, enum mode mode) {
+	bool xo = mode == MODE_XOCHIP;
+	
+	if (mode == MODE_CHIP8) {
+		return -1;
+	}
+	
+	switch (op) {
+		case 0x00FB: return 41;
+		case 0x00FC: return 42;
+		case 0x00FD: return 43;
+		case 0x00FE: return 44;
+		case 0x00FF: return 45;
+		case 0xF000: return xo ? 48 : -1;
+		case 0xF002: return xo ? 50 : -1;
+	}
+	
+	switch (op & 0xF0FF) {
+		case 0xF030: return 51;
+		case 0xF075: return 53;
+		case 0xF085: return 54;
+		case 0xF001: return xo ? 49 : -1;
+		case 0xF03A: return xo ? 52 : -1;
+	}
+	
+	switch (op & 0xFFF0) {
+		case 0x00C0: return 39;
+		case 0x00D0: return xo ? 40 : -1;
+	}
+	
+	switch (op & 0xF00F) {
+		case 0x5002: return xo ? 46 : -1;
+		case 0x5003: return xo ? 47 : -1;
+	}
+	
+	return -1;
+}
+
+// index into class_names for an opcode
+static int opcode_class(uint16_t op, enum mode mode) {
+	uint8_t n  = op & 0x000F;
+	uint8_t nn = op & 0x00FF;
+	int extended = extended_class(op, mode);
+	
+	if (extended >= 0) {
+		return extended;
+	}
+	
+	switch (op >> 12) {
+		case 0x0:	return op == 0x00E0 ? 0 : op == 0x00EE ? 1 : 2;
+		case 0x1:	return 3;
+		case 0x2:	return 4;
+		case 0x3:	return 5;
+		case 0x4:	return 6;
+		case 0x5:	return n == 0 ? 7 : 8;
+		case 0x6:	return 9;
+		case 0x7:	return 10;
+		case 0x8:	return n <= 0x7 ? 11 + n : n == 0xE ? 19 : 20;
+		case 0x9:	return 21;
+		case 0xA:	return 22;
+		case 0xB:	return 23;
+		case 0xC:	return 24;
+		case 0xD:	return 25;
+		case 0xE:	return nn == 0x9E ? 26 : nn == 0xA1 ? 27 : 28;
+		default:
+			switch (nn) {
+				case 0x07:	return 29;
+				case 0x0A:	return 30;
+				case 0x15:	return 31;
+				case 0x18:	return 32;
+				case 0x1E:	return 33;
+				case 0x29:	return 34;
+				case 0x33:	return 35;
+				case 0x55:	return 36;
+				case 0x65:	return 37;
+				default:	return 38;
+			}
+	}
+}
+
+// nanoseconds from some fixed point
+static uint64_t now_ns() {
+	struct timespec ts;
+	timespec_get(&ts, TIME_UTC);
+	
+	return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+struct profile* profile_create(void) {
+	struct profile* p = calloc(1, sizeof(struct profile));
+	
+	if (!p) {
+		return NULL;
+	}
+	
+	// the root is the rom itself, starting at 0x200
+	p->nodes[0].entry = 0x200;
+	p->node_count = 1;
+	
+	return p;
+}
+
+void profile_destroy(struct profile* p) {
+	free(p);
+}
+
+// adds ns to one of the timers
+void profile_time(struct profile* p, enum profile_timer t, uint64_t ns) {
+	p->timer_ns[t] += ns;
+	p->timer_calls[t]++;
+}
+
+// CALL TREE
+// moves into the function at entry, called from the current one
+static void enter(struct profile* p, uint16_t entry) {
+	if (p->lost_depth > 0) {
+		p->lost_depth++;
+		return;
+	}
+	
+	struct call_node* parent = &p->nodes[p->current];
+	
+	for (uint16_t c = parent->first_child; c != 0; c = p->nodes[c].next_sibling) {
+		if (p->nodes[c].entry == entry) {
+			p->current = c;
+			return;
+		}
+	}
+	
+	// a stack not seen before
+	if (p->node_count == PROFILE_MAX_NODES) {
+		p->lost_depth = 1;
+		return;
+	}
+	
+	uint16_t c = p->node_count++;
+	p->nodes[c] = (struct call_node) {entry, p->current, 0, parent->first_child, 0};
+	parent->first_child = c;
+	p->current = c;
+}
+
+// back out to the caller
+static void leave(struct profile* p) {
+	if (p->lost_depth > 0) {
+		p->lost_depth--;
+	} else {
+		p->current = p->nodes[p->current].parent;
+	}
+}
+
+// runs up to n instructions one at a time, counting each - the machine ends up exactly where
+// any other engine would leave it
+// returns how many of the n are left if it halted
+uint32_t run_profiled(struct chip8_machine* m, uint32_t n) {
+	struct profile* p = m->profile;
+	
+	for (; n > 0 && !m->halted; n--) {
+		uint16_t pc = m->pc;
+		uint16_t op = pc < sizeof(m->mem) - 1 ? m->mem[pc] << 8 | m->mem[pc + 1] : 0;
+		short    depth = m->stack_addr;
+		
+		p->pc_counts[pc & 0xFFF]++;
+		p->class_counts[opcode_class(op, m->mode)]++;
+		p->nodes[p->current].count++;
+		
+		// draws are the one instruction worth timing
+		if (op >> 12 == 0xD) {
+			uint64_t start = now_ns();
+			step_decoded(m);
+			profile_time(p, PROFILE_DRAW, now_ns() - start);
+		} else {
+			step_decoded(m);
+		}
+		
+		// follow the stack by how it moved, so faulted calls and returns don't count
+		if (m->stack_addr > depth) {
+			enter(p, m->pc);
+		} else if (m->stack_addr < depth) {
+			leave(p);
+		}
+	}
+	
+	return n;
+}
+
+// REPORT
+	static const uint64_t* sort_counts;
+
+// busiest first
+static int by_count(const void* a, const void* b) {
+	uint64_t ca = sort_counts[*(const uint16_t*) a];
+	uint64_t cb = sort_counts[*(const uint16_t*) b];
+	
+	return ca < cb ? 1 : ca > cb ? -1 : 0;
+}
+
+// writes the frames from the root down to node, separated by ;
+static void write_stack(FILE* file, const struct profile* p, uint16_t node) {
+	if (node != 0) {
+		write_stack(file, p, p->nodes[node].parent);
+		fprintf(file, ";sub_%03x", p->nodes[node].entry);
+	} else {
+		fprintf(file, "rom");
+	}
+}
+
+// writes a sorted text report and a folded-stack file for flamegraph.pl, false if either can't be made
+bool profile_write(const struct profile* p, const struct chip8_machine* m, const char* report_name, const char* folded_name) {
+	FILE* report = fopen(report_name, "w");
+	
+	if (!report) {
+		LOG("couldn't open %s", report_name);
+		return false;
+	}
+	
+	uint64_t total = 0;
+	for (size_t c = 0; c < CLASSES; c++) {
+		total += p->class_counts[c];
+	}
+	double percent = total ? 100.0 / total : 0;
+	
+	fprintf(report, "instructions: %llu\n\n", (unsigned long long) total);
+	
+	// timers
+	fprintf(report, "%-20s %10s %12s %10s\n", "timer", "calls", "total ms", "avg ns");
+	for (int t = 0; t < PROFILE_TIMERS; t++) {
+		uint64_t calls = p->timer_calls[t];
+		fprintf(report, "%-20s %10llu %12.3f %10.0f\n", timer_names[t], (unsigned long long) calls,
+		        p->timer_ns[t] / 1e6, calls ? (double) p->timer_ns[t] / calls : 0.0);
+	}
+	
+	// opcode classes, busiest first
+	uint16_t order[4096];
+	
+	for (uint16_t c = 0; c < CLASSES; c++) {
+		order[c] = c;
+	}
+	sort_counts = p->class_counts;
+	qsort(order, CLASSES, sizeof(order[0]), by_count);
+	
+	fprintf(report, "\n%-16s %14s %8s\n", "opcode", "count", "percent");
+	for (size_t c = 0; c < CLASSES && p->class_counts[order[c]] > 0; c++) {
+		fprintf(report, "%-16s %14llu %7.2f%%\n", class_names[order[c]],
+		        (unsigned long long) p->class_counts[order[c]], p->class_counts[order[c]] * percent);
+	}
+	
+	// addresses, busiest first, with whatever is in memory there now
+	for (uint16_t a = 0; a < 4096; a++) {
+		order[a] = a;
+	}
+	sort_counts = p->pc_counts;
+	qsort(order, 4096, sizeof(order[0]), by_count);
+	
+	fprintf(report, "\n%-5s %14s %8s  %s\n", "pc", "count", "percent", "instruction");
+	for (int k = 0; k < PROFILE_REPORT_PCS && p->pc_counts[order[k]] > 0; k++) {
+		uint16_t a = order[k];
+		char text[32];
+		
+		format_instruction(a < 4095 ? m->mem[a] << 8 | m->mem[a + 1] : 0, text, sizeof(text));
+		fprintf(report, "%03x   %14llu %7.2f%%  %s\n", a, (unsigned long long) p->pc_counts[a], p->pc_counts[a] * percent, text);
+	}
+	
+	fclose(report);
+	
+	// one line per call stack: rom;sub_2a0;sub_31c count
+	FILE* folded = fopen(folded_name, "w");
+	
+	if (!folded) {
+		LOG("couldn't open %s", folded_name);
+		return false;
+	}
+	
+	for (uint16_t k = 0; k < p->node_count; k++) {
+		if (p->nodes[k].count > 0) {
+			write_stack(folded, p, k);
+			fprintf(folded, " %llu\n", (unsigned long long) p->nodes[k].count);
+		}
+	}
+	
+	fclose(folded);
+	
+	return true;
+}
@@ -0,0 +1,34 @@
+// PROFILER
+// counts how often each address and each kind of instruction runs, follows the 2NNN / 00EE call
+// stack for flamegraphs, and times the slow parts of drawing
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// call stacks that can be told apart - calls past this are counted in their caller
+#define PROFILE_MAX_NODES 4096
+
+// pc counts that go into the report, busiest first
+#define PROFILE_REPORT_PCS 64
+
+struct chip8_machine;
+
+// things that take time, rather than instructions
+	enum profile_timer {
+		PROFILE_DRAW,		// draw_instr() - timed by run_profiled()
+		PROFILE_UPLOAD,		// update_draw_buffer() - timed by the frontend
+		PROFILE_PRESENT,	// SDL_RenderPresent() - timed by the frontend
+		PROFILE_TIMERS
+	};
+
+	struct profile;
+
+struct profile* profile_create(void);
+void profile_destroy(struct profile* p);
+void profile_time(struct profile* p, enum profile_timer t, uint64_t ns);
+uint32_t run_profiled(struct chip8_machine* m, uint32_t n);
+bool profile_write(const struct profile* p, const struct chip8_machine* m, const char* report_name, const char* folded_name);
+
+#endif
@@ -0,0 +1,429 @@
+// SCALING FILTERS
+// the screen is already bitplanes, so the filters work on a whole row at once: a row of a plane
+// is one 128-bit vector, a pixel's left and right neighbours are the row shifted a column, and
+// every test a filter makes is a few ands and xors over 128 pixels (sse2 on x86-64). a scaled
+// image is kept as n x n phases of screen-sized rows, so scaling it again is the same shifts.
+// last, each row's palette indices are looked up as texels - 8 at a time with avx2
+
+// C LIBRARIES
+#include <string.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+	#include <immintrin.h>
+	#define SCALE_X86 1
+#else
+	#define SCALE_X86 0
+#endif
+
+#include "core.h"
+#include "scale.h"
+
+// the most bits an output pixel's index has - hq2x's blends need 6, the rest just the 2 planes
+#define INDEX_PLANES 6
+
+// a row of one plane - column c is bit 63 - c % 64 of word c / 64, the same as the screen
+typedef uint64_t row __attribute__((vector_size(16)));
+
+// a row of pixels, as their palette indices
+	struct shade {
+		row p[PLANES];
+	};
+
+// a row of hq2x's pixels, as the index of their blend in its table
+	struct blend {
+		row p[INDEX_PLANES];
+	};
+
+// pixel (y * n + j, c * n + k) of a scaled screen is column c of rows[j][k][y]
+	struct phased {
+		int          n;
+		struct shade rows[SCALE_MAX_FACTOR][SCALE_MAX_FACTOR][SCREEN_HEIGHT];
+	};
+
+// the size of the screen being scaled, and the columns at its edges
+	struct frame {
+		int width;
+		int height;
+		row first;
+		row last;
+	};
+
+static const char* filter_names[] = {"nearest", "scale2x", "scale3x", "scale4x", "hq2x"};
+static const int   filter_factors[] = {1, 2, 3, 4, 2};
+
+// turns a filter name into a filter, returns false if there is no filter by that name
+bool parse_filter(const char* name, enum filter* out) {
+	for (int f = 0; f < FILTER_COUNT; f++) {
+		if (strcmp(name, filter_names[f]) == 0) {
+			*out = f;
+			return true;
+		}
+	}
+	
+	return false;
+}
+
+const char* filter_name(enum filter filter) {
+	return filter_names[filter];
+}
+
+// how many times as wide and tall the filter makes the screen
+int filter_factor(enum filter filter) {
+	return filter_factors[filter];
+}
+
+// ROWS
+// column c + 1 moved to column c - the last column is left empty
+static row next_column(row v) {
+	row carry = {v[1] >> 63, 0};
+	return v << 1 | carry;
+}
+
+// column c - 1 moved to column c - the first column is left empty
+static row previous_column(row v) {
+	row carry = {0, v[0] << 63};
+	return v >> 1 | carry;
+}
+
+// a bit set in each column where two rows of pixels are the same color
+static row same(const struct shade* a, const struct shade* b) {
+	return ~((a->p[0] ^ b->p[0]) | (a->p[1] ^ b->p[1]));
+}
+
+// a where the mask is set, b everywhere else
+static struct shade pick(row mask, const struct shade* a, const struct shade* b) {
+	struct shade out;
+	
+	for (int p = 0; p < PLANES; p++) {
+		out.p[p] = (a->p[p] & mask) | (b->p[p] & ~mask);
+	}
+	
+	return out;
+}
+
+// NEIGHBOURS
+// the row above row y of phase j, as (y, j) - past the edges of the screen, a pixel's neighbour is itself
+static void above(const struct phased* image, int y, int j, int* uy, int* uj) {
+	*uy = j > 0 || y == 0 ? y : y - 1;
+	*uj = j > 0 ? j - 1 : (y > 0 ? image->n - 1 : j);
+}
+
+static void below(const struct phased* image, const struct frame* f, int y, int j, int* dy, int* dj) {
+	*dy = j < image->n - 1 || y == f->height - 1 ? y : y + 1;
+	*dj = j < image->n - 1 ? j + 1 : (y < f->height - 1 ? 0 : j);
+}
+
+// the pixels to the left of row y of phase (j, k) - in the phase before, or the last phase a
+// column over
+static struct shade left(const struct phased* image, const struct frame* f, int y, int j, int k) {
+	if (k > 0) {
+		return image->rows[j][k - 1][y];
+	}
+	
+	const struct shade* over = &image->rows[j][image->n - 1][y];
+	const struct shade* self = &image->rows[j][k][y];
+	struct shade out;
+	
+	for (int p = 0; p < PLANES; p++) {
+		out.p[p] = (previous_column(over->p[p]) & ~f->first) | (self->p[p] & f->first);
+	}
+	
+	return out;
+}
+
+static struct shade right(const struct phased* image, const struct frame* f, int y, int j, int k) {
+	if (k < image->n - 1) {
+		return image->rows[j][k + 1][y];
+	}
+	
+	const struct shade* over = &image->rows[j][0][y];
+	const struct shade* self = &image->rows[j][k][y];
+	struct shade out;
+	
+	for (int p = 0; p < PLANES; p++) {
+		out.p[p] = (next_column(over->p[p]) & ~f->last) | (self->p[p] & f->last);
+	}
+	
+	return out;
+}
+
+// the eight neighbours of a row of pixels - scale2x only looks at the four beside it
+	struct around {
+		struct shade a, b, c;	// above - left, middle, right
+		struct shade d, e, f;
+		struct shade g, h, i;	// below
+	};
+
+static void gather(const struct phased* image, const struct frame* fr, int y, int j, int k, bool diagonals, struct around* n) {
+	int uy, uj, dy, dj;
+	above(image, y, j, &uy, &uj);
+	below(image, fr, y, j, &dy, &dj);
+	
+	n->b = image->rows[uj][k][uy];
+	n->d = left(image, fr, y, j, k);
+	n->e = image->rows[j][k][y];
+	n->f = right(image, fr, y, j, k);
+	n->h = image->rows[dj][k][dy];
+	
+	if (diagonals) {
+		n->a = left(image, fr, uy, uj, k);
+		n->c = right(image, fr, uy, uj, k);
+		n->g = left(image, fr, dy, dj, k);
+		n->i = right(image, fr, dy, dj, k);
+	}
+}
+
+// FILTERS
+// each pixel becomes 2x2 - a corner takes the color of its two neighbours when they match, as
+// long as that isn't a straight edge through the pixel
+static void scale2x(const struct phased* in, struct phased* out, const struct frame* fr) {
+	out->n = in->n * 2;
+	
+	for (int j = 0; j < in->n; j++) {
+		for (int k = 0; k < in->n; k++) {
+			for (int y = 0; y < fr->height; y++) {
+				struct around n;
+				gather(in, fr, y, j, k, false, &n);
+				
+				row edge = ~same(&n.b, &n.h) & ~same(&n.d, &n.f);
+				
+				out->rows[2 * j][2 * k][y]         = pick(edge & same(&n.d, &n.b), &n.d, &n.e);
+				out->rows[2 * j][2 * k + 1][y]     = pick(edge & same(&n.b, &n.f), &n.f, &n.e);
+				out->rows[2 * j + 1][2 * k][y]     = pick(edge & same(&n.d, &n.h), &n.d, &n.e);
+				out->rows[2 * j + 1][2 * k + 1][y] = pick(edge & same(&n.h, &n.f), &n.f, &n.e);
+			}
+		}
+	}
+}
+
+// each pixel becomes 3x3 - corners as in scale2x, and the middle of a side takes a neighbour's
+// color where the corners on either side of it would
+static void scale3x(const struct phased* in, struct phased* out, const struct frame* fr) {
+	out->n = 3;
+	
+	for (int y = 0; y < fr->height; y++) {
+		struct around n;
+		gather(in, fr, y, 0, 0, true, &n);
+		
+		row edge = ~same(&n.b, &n.h) & ~same(&n.d, &n.f);
+		row db   = edge & same(&n.d, &n.b);
+		row bf   = edge & same(&n.b, &n.f);
+		row dh   = edge & same(&n.d, &n.h);
+		row hf   = edge & same(&n.h, &n.f);
+		
+		row not_a = ~same(&n.e, &n.a);
+		row not_c = ~same(&n.e, &n.c);
+		row not_g = ~same(&n.e, &n.g);
+		row not_i = ~same(&n.e, &n.i);
+		
+		out->rows[0][0][y] = pick(db, &n.d, &n.e);
+		out->rows[0][1][y] = pick((db & not_c) | (bf & not_a), &n.b, &n.e);
+		out->rows[0][2][y] = pick(bf, &n.f, &n.e);
+		out->rows[1][0][y] = pick((db & not_g) | (dh & not_a), &n.d, &n.e);
+		out->rows[1][1][y] = n.e;
+		out->rows[1][2][y] = pick((bf & not_i) | (hf & not_c), &n.f, &n.e);
+		out->rows[2][0][y] = pick(dh, &n.d, &n.e);
+		out->rows[2][1][y] = pick((dh & not_i) | (hf & not_g), &n.h, &n.e);
+		out->rows[2][2][y] = pick(hf, &n.f, &n.e);
+	}
+}
+
+// one corner of a pixel for hq2x, from the two neighbours that touch it (x and y) and the one
+// across it (d). when x and y match each other but not the pixel, there's an edge across the
+// corner and it's blended with them - by half if the pixel's shape ends at that corner, and by a
+// quarter if the pixel's color goes on across it, like along a diagonal line. the index is the
+// blend, then the pixel's color, then theirs
+static struct blend hq2x_corner(const struct shade* e, const struct shade* x, const struct shade* y, const struct shade* d) {
+	row edge = same(x, y) & ~same(x, e);
+	row line = edge & same(d, e);
+	
+	struct blend out;
+	
+	out.p[0] = x->p[0] & edge;
+	out.p[1] = x->p[1] & edge;
+	out.p[2] = e->p[0];
+	out.p[3] = e->p[1];
+	out.p[4] = edge & ~line;
+	out.p[5] = line;
+	
+	return out;
+}
+
+static void hq2x(const struct phased* in, struct blend out[2][2][SCREEN_HEIGHT], const struct frame* fr) {
+	for (int y = 0; y < fr->height; y++) {
+		struct around n;
+		gather(in, fr, y, 0, 0, true, &n);
+		
+		out[0][0][y] = hq2x_corner(&n.e, &n.b, &n.d, &n.a);
+		out[0][1][y] = hq2x_corner(&n.e, &n.b, &n.f, &n.c);
+		out[1][0][y] = hq2x_corner(&n.e, &n.h, &n.d, &n.g);
+		out[1][1][y] = hq2x_corner(&n.e, &n.h, &n.f, &n.i);
+	}
+}
+
+// a color share quarters of the way to another, every channel alpha included
+static uint32_t mix(uint32_t from, uint32_t to, int share) {
+	uint32_t out = 0;
+	
+	for (int shift = 0; shift < 32; shift += 8) {
+		uint32_t a = from >> shift & 0xFF;
+		uint32_t b = to   >> shift & 0xFF;
+		
+		out |= ((a * (4 - share) + b * share + 2) / 4) << shift;
+	}
+	
+	return out;
+}
+
+// TEXELS
+// every byte's 8 bits spread over 8 bytes, the top bit in the first - so 8 columns of a plane
+// become 8 indices in column order
+static uint64_t spread[256];
+
+static void make_spread() {
+	for (int bits = 0; bits < 256; bits++) {
+		for (int b = 0; b < 8; b++) {
+			spread[bits] |= (uint64_t) (bits >> (7 - b) & 1) << (b * 8);
+		}
+	}
+}
+
+static void expand_scalar(const uint8_t* indices, int count, const uint32_t* table, uint32_t* out) {
+	for (int t = 0; t < count; t++) {
+		out[t] = table[indices[t]];
+	}
+}
+
+#if SCALE_X86
+// 8 lookups at once - a little faster than one at a time, which already goes as fast as the stores can
+__attribute__((target("avx2")))
+static void expand_avx2(const uint8_t* indices, int count, const uint32_t* table, uint32_t* out) {
+	for (int t = 0; t < count; t += 8) {
+		__m256i index = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*) (indices + t)));
+		_mm256_storeu_si256((__m256i*) (out + t), _mm256_i32gather_epi32((const int*) table, index, 4));
+	}
+}
+#endif
+
+// a row of indices to texels - count is always a multiple of 8
+static void expand(const uint8_t* indices, int count, const uint32_t* table, uint32_t* out) {
+#if SCALE_X86
+	static int avx2 = -1;
+	
+	if (avx2 < 0) {
+		avx2 = __builtin_cpu_supports("avx2") != 0;
+	}
+	
+	if (avx2) {
+		expand_avx2(indices, count, table, out);
+		return;
+	}
+#endif
+	expand_scalar(indices, count, table, out);
+}
+
+// one row of the output from the same row of n phases, side by side a column of each in turn
+static void emit_row(const row* const phases[SCALE_MAX_FACTOR], int n, int planes, int width, const uint32_t* table, uint32_t* line) {
+	uint8_t indices[SCREEN_WIDTH * SCALE_MAX_FACTOR];
+	
+	for (int k = 0; k < n; k++) {
+		const row* s = phases[k];
+		
+		for (int c = 0; c < width; c += 8) {
+			uint64_t eight = 0;
+			
+			for (int p = 0; p < planes; p++) {
+				eight |= spread[s[p][c >> 6] >> (56 - (c & 63)) & 0xFF] << p;
+			}
+			
+			if (n == 1) {
+				memcpy(indices + c, &eight, sizeof(eight));
+				continue;
+			}
+			
+			for (int b = 0; b < 8; b++) {
+				indices[(c + b) * n + k] = (uint8_t) (eight >> (b * 8));
+			}
+		}
+	}
+	
+	expand(indices, width * n, table, line);
+}
+
+// SCALING
+// writes the screen through a filter into out, filter_factor() times as wide and tall as the
+// current resolution. pitch is in bytes, and palette is 0xAARRGGBB - background, first plane,
+// second plane, both
+void scale_screen(enum filter filter, const struct chip8_machine* m, const uint32_t palette[4], uint32_t* out, int pitch) {
+	static struct phased screen, scaled, twice;
+	
+	if (!spread[1]) {
+		make_spread();
+	}
+	
+	struct frame fr = {
+		.width  = screen_width(m),
+		.height = screen_height(m),
+		.first  = {1ULL << 63, 0},
+		.last   = {screen_width(m) == 64, screen_width(m) == 128}
+	};
+	
+	// a lores screen is the top-left corner of screen[] - the rest is left out
+	row width_mask = {~0ULL, fr.width == 128 ? ~0ULL : 0};
+	screen.n = 1;
+	
+	for (int y = 0; y < fr.height; y++) {
+		for (int p = 0; p < PLANES; p++) {
+			row bits = {m->screen[p][y][0], m->screen[p][y][1]};
+			screen.rows[0][0][y].p[p] = bits & width_mask;
+		}
+	}
+	
+	// how much of the other color each of hq2x's blends takes, in quarters
+	static const int shares[4] = {0, 2, 1, 0};
+	static struct blend corners[2][2][SCREEN_HEIGHT];
+	
+	const struct phased* image = &screen;
+	uint32_t table[1 << INDEX_PLANES];
+	memcpy(table, palette, 4 * sizeof(uint32_t));
+	
+	switch (filter) {
+		case FILTER_SCALE2X:
+			scale2x(&screen, &scaled, &fr);
+			image = &scaled;
+			break;
+		case FILTER_SCALE3X:
+			scale3x(&screen, &scaled, &fr);
+			image = &scaled;
+			break;
+		case FILTER_SCALE4X:
+			scale2x(&screen, &scaled, &fr);
+			scale2x(&scaled, &twice, &fr);
+			image = &twice;
+			break;
+		case FILTER_HQ2X:
+			hq2x(&screen, corners, &fr);
+			
+			for (int t = 0; t < 1 << INDEX_PLANES; t++) {
+				table[t] = mix(palette[t >> 2 & 3], palette[t & 3], shares[t >> 4]);
+			}
+			break;
+		default:
+			break;
+	}
+	
+	int n = filter_factor(filter);
+	
+	for (int y = 0; y < fr.height; y++) {
+		for (int j = 0; j < n; j++) {
+			const row* phases[SCALE_MAX_FACTOR];
+			uint32_t*  line = (uint32_t*) ((uint8_t*) out + (size_t) (y * n + j) * pitch);
+			
+			for (int k = 0; k < n; k++) {
+				phases[k] = filter == FILTER_HQ2X ? corners[j][k][y].p : image->rows[j][k][y].p;
+			}
+			
+			emit_row(phases, n, filter == FILTER_HQ2X ? INDEX_PLANES : PLANES, fr.width, table, line);
+		}
+	}
+}
@@ -0,0 +1,29 @@
+// SCALING FILTERS
+// pixel art upscalers that run on the cpu. a filter makes the screen 2, 3 or 4 times as big with
+// its edges smoothed, and the gpu stretches that the rest of the way to the window - so a filtered
+// frame costs the same in a small window as at 4k. nothing here needs SDL
+#ifndef SCALE_H
+#define SCALE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "core.h"
+
+#define SCALE_MAX_FACTOR 4
+
+	enum filter {
+		FILTER_NEAREST,		// each pixel a square, like no filter at all
+		FILTER_SCALE2X,		// scale2x - fills in the steps of diagonal edges, with the palette's colors only
+		FILTER_SCALE3X,
+		FILTER_SCALE4X,		// scale2x twice
+		FILTER_HQ2X,		// blends the corners of pixels on an edge, so it adds shades between the colors
+		FILTER_COUNT
+	};
+
+bool parse_filter(const char* name, enum filter* filter);
+const char* filter_name(enum filter filter);
+int filter_factor(enum filter filter);
+void scale_screen(enum filter filter, const struct chip8_machine* m, const uint32_t palette[4], uint32_t* out, int pitch);
+
+#endif
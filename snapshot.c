@@ -0,0 +1,355 @@
+// SNAPSHOTS AND REWIND
+// a snapshot is a flat copy of the machine, so saving is a handful of memcpys.
+// the rewind buffer stores each frame as the xor of it and the frame after it - most
+// of memory never changes, so the xor is nearly all zeros and squeezes down to a few
+// bytes once the zero runs are dropped. stepping back xors the newest delta into the
+// newest frame, which gives the frame before it without replaying anything
+
+// C LIBRARIES
+#include <stdlib.h>
+#include <string.h>
+
+#include "core.h"
+#include "snapshot.h"
+
+// equal bytes needed to end a literal run - shorter gaps cost more to encode than to keep
+#define MIN_ZERO_RUN 4
+
+// a delta can't be bigger than this - the worst case is every byte different, plus run headers
+#define MAX_DELTA (sizeof(struct snapshot) + 16)
+
+	struct rewind_entry {
+		size_t   offset;	// where the delta starts in data
+		uint32_t length;	// bytes of delta, 0 if nothing changed that frame
+	};
+	
+	struct rewind {
+	// the newest frame, whole - every other frame is reached by xoring deltas into it
+		struct snapshot newest;
+		struct snapshot current;	// scratch for the frame being pushed
+		bool            started;
+	
+	// deltas, packed one after the other and wrapping back to the start when they reach the end
+		uint8_t* data;
+		size_t   capacity;
+		size_t   head;		// where the next delta goes
+		size_t   stored;	// bytes of deltas being kept
+	
+	// one entry per delta, oldest at first
+		struct rewind_entry* entries;
+		uint32_t max_frames;
+		uint32_t first;
+		uint32_t count;
+	
+	// scratch for encoding
+		uint8_t delta[MAX_DELTA];
+	};
+
+// SNAPSHOTS
+// copies the machine's state into s
+void snapshot_save(const struct chip8_machine* m, struct snapshot* s) {
+	// clear the padding too, so equal states give equal bytes
+	memset(s, 0, sizeof(*s));
+	
+	memcpy(s->screen, m->screen, sizeof(s->screen));
+	memcpy(s->mem, m->mem, sizeof(s->mem));
+	memcpy(s->stack, m->stack, sizeof(s->stack));
+	memcpy(s->v, m->v, sizeof(s->v));
+	memcpy(s->keypad, m->keypad, sizeof(s->keypad));
+	memcpy(s->flags, m->flags, sizeof(s->flags));
+	memcpy(s->pattern, m->pattern, sizeof(s->pattern));
+	
+	s->rng        = m->rng;
+	s->pc         = m->pc;
+	s->i          = m->i;
+	s->stack_addr = m->stack_addr;
+	s->delay      = m->delay;
+	s->sound      = m->sound;
+	s->held_key   = m->held_key;
+	s->fault      = (uint8_t) m->fault;
+	s->mode       = (uint8_t) m->mode;
+	s->quirks     = (uint8_t) m->quirks;
+	s->hires      = m->hires;
+	s->planes     = m->planes;
+	s->pitch      = m->pitch;
+}
+
+// puts the machine back to the state in s
+void snapshot_load(struct chip8_machine* m, const struct snapshot* s) {
+	// only memory that differs is copied, so decoded instructions and blocks elsewhere stay valid
+	uint32_t a = 0;
+	
+	while (a < sizeof(m->mem)) {
+		if (m->mem[a] == s->mem[a]) {
+			a++;
+			continue;
+		}
+		
+		uint32_t start = a;
+		while (a < sizeof(m->mem) && m->mem[a] != s->mem[a]) {
+			a++;
+		}
+		
+		memcpy(&m->mem[start], &s->mem[start], a - start);
+		invalidate(m, start, a - start);
+	}
+	
+	memcpy(m->screen, s->screen, sizeof(m->screen));
+	memcpy(m->stack, s->stack, sizeof(m->stack));
+	memcpy(m->v, s->v, sizeof(m->v));
+	memcpy(m->keypad, s->keypad, sizeof(m->keypad));
+	memcpy(m->flags, s->flags, sizeof(m->flags));
+	memcpy(m->pattern, s->pattern, sizeof(m->pattern));
+	
+	m->rng        = s->rng;
+	m->pc         = s->pc;
+	m->i          = s->i;
+	m->stack_addr = s->stack_addr;
+	m->delay      = s->delay;
+	m->sound      = s->sound;
+	m->held_key   = s->held_key;
+	m->fault      = (enum fault) s->fault;
+	m->hires      = s->hires;
+	m->planes     = s->planes;
+	m->pitch      = s->pitch;
+	
+	// memory is already the snapshot's, fonts and all, so only the instructions need decoding again
+	if (m->mode != (enum mode) s->mode || m->quirks != (enum quirks) s->quirks) {
+		m->mode = (enum mode) s->mode;
+		set_quirks(m, (enum quirks) s->quirks);
+	}
+	
+	// a halt belongs to the state that was left, the restored one finds out for itself
+	m->halted = HALT_NONE;
+	m->sound_write_count = 0;
+	
+	// the whole display has to be drawn again
+	m->dirty_rows = ~0ULL;
+}
+
+// DELTAS
+// varints keep run lengths to one byte most of the time
+static size_t put_length(uint8_t* out, size_t value) {
+	size_t n = 0;
+	
+	while (value >= 0x80) {
+		out[n++] = (uint8_t) (value | 0x80);
+		value >>= 7;
+	}
+	out[n++] = (uint8_t) value;
+	
+	return n;
+}
+
+static size_t get_length(const uint8_t* in, size_t* value) {
+	size_t n = 0;
+	int shift = 0;
+	
+	*value = 0;
+	do {
+		*value |= (size_t) (in[n] & 0x7F) << shift;
+		shift += 7;
+	} while (in[n++] & 0x80);
+	
+	return n;
+}
+
+// writes the xor of a and b as (zero run, literal run, literal bytes) triples, returns its length
+// trailing zeros aren't written at all
+static size_t encode_delta(const uint8_t* a, const uint8_t* b, size_t size, uint8_t* out) {
+	size_t o = 0;
+	size_t p = 0;
+	
+	while (p < size) {
+		// skip equal bytes, a word at a time where possible
+		size_t z = p;
+		while (z + 8 <= size) {
+			uint64_t wa, wb;
+			memcpy(&wa, a + z, 8);
+			memcpy(&wb, b + z, 8);
+			
+			if (wa != wb) {
+				break;
+			}
+			z += 8;
+		}
+		while (z < size && a[z] == b[z]) {
+			z++;
+		}
+		
+		if (z == size) {
+			break;
+		}
+		
+		// take different bytes until enough equal ones in a row turn up
+		size_t end = z;
+		while (end < size) {
+			if (a[end] != b[end]) {
+				end++;
+				continue;
+			}
+			
+			size_t same = end;
+			while (same < size && a[same] == b[same] && same - end < MIN_ZERO_RUN) {
+				same++;
+			}
+			
+			if (same == size || same - end >= MIN_ZERO_RUN) {
+				break;
+			}
+			end = same;
+		}
+		
+		o += put_length(out + o, z - p);
+		o += put_length(out + o, end - z);
+		for (size_t k = z; k < end; k++) {
+			out[o++] = a[k] ^ b[k];
+		}
+		
+		p = end;
+	}
+	
+	return o;
+}
+
+// xors a delta into target
+static void apply_delta(uint8_t* target, const uint8_t* delta, size_t length) {
+	size_t in = 0;
+	size_t p = 0;
+	
+	while (in < length) {
+		size_t zeros, literal;
+		in += get_length(delta + in, &zeros);
+		in += get_length(delta + in, &literal);
+		
+		p += zeros;
+		for (size_t k = 0; k < literal; k++) {
+			target[p++] ^= delta[in++];
+		}
+	}
+}
+
+// REWIND
+// capacity is the bytes kept for deltas, max_frames the most frames that can be stepped back
+struct rewind* rewind_create(size_t capacity, uint32_t max_frames) {
+	struct rewind* r = calloc(1, sizeof(struct rewind));
+	
+	if (!r) {
+		return NULL;
+	}
+	
+	r->data    = malloc(capacity);
+	r->entries = malloc(sizeof(struct rewind_entry) * max_frames);
+	
+	if (!r->data || !r->entries || max_frames == 0) {
+		rewind_destroy(r);
+		return NULL;
+	}
+	
+	r->capacity   = capacity;
+	r->max_frames = max_frames;
+	
+	return r;
+}
+
+void rewind_destroy(struct rewind* r) {
+	if (!r) {
+		return;
+	}
+	
+	free(r->data);
+	free(r->entries);
+	free(r);
+}
+
+// forgets the oldest frame
+static void drop_oldest(struct rewind* r) {
+	r->stored -= r->entries[r->first].length;
+	r->first = (r->first + 1) % r->max_frames;
+	r->count--;
+}
+
+// records the machine as the newest frame
+void rewind_push(struct rewind* r, const struct chip8_machine* m) {
+	if (!r->started) {
+		snapshot_save(m, &r->newest);
+		r->started = true;
+		return;
+	}
+	
+	snapshot_save(m, &r->current);
+	
+	size_t length = encode_delta((const uint8_t*) &r->current, (const uint8_t*) &r->newest, sizeof(struct snapshot), r->delta);
+	r->newest = r->current;
+	
+	// a delta that can never fit means the history before it is lost
+	if (length > r->capacity) {
+		while (r->count > 0) {
+			drop_oldest(r);
+		}
+		return;
+	}
+	
+	// make room by dropping the oldest frames - the deltas are back to back, so they free up the bytes right after head
+	while (r->count == r->max_frames || r->stored + length > r->capacity) {
+		drop_oldest(r);
+	}
+	
+	struct rewind_entry* e = &r->entries[(r->first + r->count) % r->max_frames];
+	e->offset = r->head;
+	e->length = (uint32_t) length;
+	
+	// a delta that runs past the end carries on at the start
+	size_t before_end = r->capacity - r->head;
+	
+	if (length <= before_end) {
+		memcpy(r->data + r->head, r->delta, length);
+	} else {
+		memcpy(r->data + r->head, r->delta, before_end);
+		memcpy(r->data, r->delta + before_end, length - before_end);
+	}
+	
+	r->head    = (r->head + length) % r->capacity;
+	r->stored += length;
+	r->count++;
+}
+
+// puts the machine back one frame, false if there is nothing older left
+bool rewind_step_back(struct rewind* r, struct chip8_machine* m) {
+	if (r->count == 0) {
+		return false;
+	}
+	
+	const struct rewind_entry* e = &r->entries[(r->first + r->count - 1) % r->max_frames];
+	
+	// gather the delta in one piece, in case it wrapped
+	size_t before_end = r->capacity - e->offset;
+	
+	if (e->length <= before_end) {
+		memcpy(r->delta, r->data + e->offset, e->length);
+	} else {
+		memcpy(r->delta, r->data + e->offset, before_end);
+		memcpy(r->delta + before_end, r->data, e->length - before_end);
+	}
+	
+	apply_delta((uint8_t*) &r->newest, r->delta, e->length);
+	
+	// the newest delta's bytes are free again
+	r->head    = e->offset;
+	r->stored -= e->length;
+	r->count--;
+	
+	snapshot_load(m, &r->newest);
+	
+	return true;
+}
+
+// frames that can still be stepped back through
+uint32_t rewind_frames(const struct rewind* r) {
+	return r->count;
+}
+
+// memory holding the history - the newest frame plus every delta
+size_t rewind_bytes(const struct rewind* r) {
+	return sizeof(struct snapshot) + r->stored;
+}
@@ -0,0 +1,52 @@
+// SNAPSHOTS AND REWIND
+// saves and restores the whole state of a machine, and keeps a history of frames to step back through
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "core.h"
+
+// everything that changes while a rom runs - plain data, so two snapshots can be compared byte by byte
+	struct snapshot {
+		uint64_t screen[PLANES][SCREEN_HEIGHT][2];
+		uint8_t  mem[MEMORY_SIZE];
+		uint32_t rng;
+		uint16_t stack[12];
+		uint16_t pc;
+		uint16_t i;
+		short    stack_addr;
+		uint8_t  v[16];
+		bool     keypad[16];
+		uint8_t  delay;
+		uint8_t  sound;
+		uint8_t  held_key;
+		uint8_t  fault;
+		uint8_t  mode;
+		uint8_t  quirks;
+		bool     hires;
+		uint8_t  planes;
+		uint8_t  flags[16];
+		uint8_t  pattern[16];
+		uint8_t  pitch;
+	};
+
+// history of frames - only the newest one is kept whole, every older one is the
+// xor of it and the frame after it, with the runs of zeros squeezed out
+	struct rewind;
+
+// SNAPSHOTS
+void snapshot_save(const struct chip8_machine* m, struct snapshot* s);
+void snapshot_load(struct chip8_machine* m, const struct snapshot* s);
+
+// REWIND
+struct rewind* rewind_create(size_t capacity, uint32_t max_frames);
+void rewind_destroy(struct rewind* r);
+void rewind_push(struct rewind* r, const struct chip8_machine* m);
+bool rewind_step_back(struct rewind* r, struct chip8_machine* m);
+uint32_t rewind_frames(const struct rewind* r);
+size_t rewind_bytes(const struct rewind* r);
+
+#endif
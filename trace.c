@@ -0,0 +1,175 @@
+// EXECUTION TRACE
+// the emulator fills one buffer of records while the writer thread saves the ones before it.
+// when a buffer fills up it's handed over and the next one is started - the emulator only
+// waits if the writer is TRACE_BUFFERS buffers behind, which a disk can't let happen for long
+
+// C LIBRARIES
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "core.h"
+#include "trace.h"
+
+	struct trace {
+		FILE* file;
+	
+	// buffers are handed over in order - handed counts the ones given to the writer, written the
+	// ones it has saved, so buffer handed % TRACE_BUFFERS is the one being filled
+		struct trace_record buffers[TRACE_BUFFERS][TRACE_BUFFER_RECORDS];
+		uint32_t            used[TRACE_BUFFERS];
+		uint64_t            handed;
+		uint64_t            written;
+		bool                closing;
+	
+	// the buffer being filled, and how much of it is
+		struct trace_record* filling;
+		uint32_t             count;
+	
+		pthread_t       writer;
+		pthread_mutex_t lock;
+		pthread_cond_t  changed;
+	};
+
+// saves full buffers until the trace is closed and everything is out
+static void* writer(void* arg) {
+	struct trace* t = arg;
+	
+	pthread_mutex_lock(&t->lock);
+	
+	while (true) {
+		while (t->written == t->handed && !t->closing) {
+			pthread_cond_wait(&t->changed, &t->lock);
+		}
+		
+		if (t->written == t->handed) {
+			break;
+		}
+		
+		// nobody touches a handed buffer until it's written, so the lock can go while saving it
+		uint32_t b = t->written % TRACE_BUFFERS;
+		pthread_mutex_unlock(&t->lock);
+		
+		fwrite(t->buffers[b], sizeof(struct trace_record), t->used[b], t->file);
+		
+		pthread_mutex_lock(&t->lock);
+		t->written++;
+		pthread_cond_signal(&t->changed);
+	}
+	
+	pthread_mutex_unlock(&t->lock);
+	
+	return NULL;
+}
+
+// gives the buffer being filled to the writer and moves on to the next one
+static void hand_over(struct trace* t) {
+	pthread_mutex_lock(&t->lock);
+	
+	t->used[t->handed % TRACE_BUFFERS] = t->count;
+	t->handed++;
+	pthread_cond_signal(&t->changed);
+	
+	// every buffer is waiting to be written - wait for one to come free
+	while (t->handed - t->written == TRACE_BUFFERS) {
+		pthread_cond_wait(&t->changed, &t->lock);
+	}
+	
+	t->filling = t->buffers[t->handed % TRACE_BUFFERS];
+	t->count   = 0;
+	
+	pthread_mutex_unlock(&t->lock);
+}
+
+// NULL if the file can't be made
+struct trace* trace_open(const char* name) {
+	struct trace* t = calloc(1, sizeof(struct trace));
+	
+	if (!t) {
+		return NULL;
+	}
+	
+	t->file = fopen(name, "wb");
+	
+	if (!t->file) {
+		LOG("couldn't open trace file %s", name);
+		free(t);
+		return NULL;
+	}
+	
+	struct trace_header header = {TRACE_MAGIC, TRACE_VERSION, sizeof(struct trace_record)};
+	fwrite(&header, sizeof(header), 1, t->file);
+	
+	t->filling = t->buffers[0];
+	
+	pthread_mutex_init(&t->lock, NULL);
+	pthread_cond_init(&t->changed, NULL);
+	
+	if (pthread_create(&t->writer, NULL, writer, t) != 0) {
+		LOG("couldn't start the trace writer");
+		fclose(t->file);
+		free(t);
+		return NULL;
+	}
+	
+	return t;
+}
+
+// writes out whatever is left and closes the file
+void trace_close(struct trace* t) {
+	if (!t) {
+		return;
+	}
+	
+	if (t->count > 0) {
+		hand_over(t);
+	}
+	
+	pthread_mutex_lock(&t->lock);
+	t->closing = true;
+	pthread_cond_signal(&t->changed);
+	pthread_mutex_unlock(&t->lock);
+	
+	pthread_join(t->writer, NULL);
+	
+	fclose(t->file);
+	pthread_mutex_destroy(&t->lock);
+	pthread_cond_destroy(&t->changed);
+	free(t);
+}
+
+// runs up to n instructions one at a time, recording each - the machine ends up exactly where
+// any other engine would leave it, only slower
+// returns how many of the n are left if it halted
+uint32_t run_traced(struct chip8_machine* m, uint32_t n) {
+	struct trace* t = m->trace;
+	
+	for (; n > 0 && !m->halted; n--) {
+		uint16_t pc = m->pc;
+		uint16_t instr = pc < sizeof(m->mem) - 1 ? m->mem[pc] << 8 | m->mem[pc + 1] : 0;
+		
+		uint8_t before[16];
+		memcpy(before, m->v, sizeof(before));
+		
+		step_decoded(m);
+		
+		uint8_t reg = 0;
+		while (reg < 16 && before[reg] == m->v[reg]) {
+			reg++;
+		}
+		
+		struct trace_record* r = &t->filling[t->count];
+		r->pc    = pc;
+		r->instr = instr;
+		r->i     = m->i;
+		r->reg   = reg < 16 ? reg : TRACE_NO_REGISTER;
+		r->value = reg < 16 ? m->v[reg] : 0;
+		
+		if (++t->count == TRACE_BUFFER_RECORDS) {
+			hand_over(t);
+		}
+	}
+	
+	return n;
+}
@@ -0,0 +1,43 @@
+// EXECUTION TRACE
+// records every instruction a machine runs into a compact binary file, written out by its own
+// thread so tracing costs the emulator one 8-byte store per instruction
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+// start of every trace file, then records until the end
+#define TRACE_MAGIC   "C8TR"
+#define TRACE_VERSION 1
+
+// records per buffer, and buffers in flight between the emulator and the writer
+#define TRACE_BUFFER_RECORDS (1 << 16)
+#define TRACE_BUFFERS        4
+
+// reg in a record when no register changed
+#define TRACE_NO_REGISTER 0xFF
+
+struct chip8_machine;
+
+	struct trace_header {
+		char     magic[4];
+		uint16_t version;
+		uint16_t record_size;
+	};
+
+// one instruction - the state is what it is after the instruction ran
+	struct trace_record {
+		uint16_t pc;		// where the instruction was
+		uint16_t instr;		// the opcode
+		uint16_t i;			// index register
+		uint8_t  reg;		// first register the instruction changed, or TRACE_NO_REGISTER
+		uint8_t  value;		// its new value
+	};
+
+	struct trace;
+
+struct trace* trace_open(const char* name);
+void trace_close(struct trace* t);
+uint32_t run_traced(struct chip8_machine* m, uint32_t n);
+
+#endif